@@ -23,6 +23,7 @@
 #include "blk-mq.h"
 #include "blk-mq-debugfs.h"
 #include "blk-mq-tag.h"
+#include "blk-wbt.h"
 
 static int blk_flags_show(struct seq_file *m, const unsigned long flags,
 			  const char *const *flag_name, int flag_name_count)
@@ -158,6 +159,38 @@ static ssize_t queue_write_hint_store(void *data, const char __user *buf,
 	return count;
 }
 
+static int queue_wbt_show(void *data, struct seq_file *m)
+{
+	static const char *const rwq_name[] = {
+		[WBT_RWQ_NORMAL]	= "normal",
+		[WBT_RWQ_KSWAPD]	= "kswapd",
+		[WBT_RWQ_BG]		= "background",
+	};
+	struct request_queue *q = data;
+	struct rq_wb *rwb = q->rq_wb;
+	int i;
+
+	if (!rwb) {
+		seq_puts(m, "disabled\n");
+		return 0;
+	}
+
+	seq_printf(m, "enable_state=%d\n", rwb->enable_state);
+	seq_printf(m, "min_lat_nsec=%lu\n", rwb->min_lat_nsec);
+	seq_printf(m, "win_nsec=%llu cur_win_nsec=%llu win_shift=%u\n",
+		   rwb->win_nsec, rwb->cur_win_nsec, rwb->win_shift);
+	seq_printf(m, "scale_step=%d bg_scale_step=%d scaled_max=%d\n",
+		   rwb->scale_step, rwb->bg_scale_step, rwb->scaled_max);
+	seq_printf(m, "wb_background=%u wb_normal=%u wb_max=%u wb_bg=%u\n",
+		   rwb->wb_background, rwb->wb_normal, rwb->wb_max,
+		   rwb->wb_bg);
+	for (i = 0; i < WBT_NUM_RWQ; i++)
+		seq_printf(m, "%s: inflight=%d waiting=%d\n", rwq_name[i],
+			   atomic_read(&rwb->rq_wait[i].inflight),
+			   waitqueue_active(&rwb->rq_wait[i].wait));
+	return 0;
+}
+
 static int queue_poll_stat_show(void *data, struct seq_file *m)
 {
 	struct request_queue *q = data;
@@ -759,6 +792,7 @@ static const struct blk_mq_debugfs_attr blk_mq_debugfs_queue_attrs[] = {
 	{"requeue_list", 0400, .seq_ops = &queue_requeue_list_seq_ops},
 	{"state", 0600, queue_state_show, queue_state_write},
 	{"write_hints", 0600, queue_write_hint_show, queue_write_hint_store},
+	{"wbt", 0400, queue_wbt_show},
 	{},
 };
 
@@ -14,6 +14,11 @@
  *   scaling step of 0 if reads show up or the heavy writers finish. Unlike
  *   positive scaling steps where we shrink the monitoring window, a negative
  *   scaling step retains the default step==0 window size.
+ * - Writers in a background (non-root) blkio cgroup are counted separately
+ *   and get their own limit, which is cut further on every latency violation
+ *   and only recovers once reads meet the target again.
+ * - While the read tail latency is well above the target, shrink the window
+ *   further so we react quicker, and grow it back once reads recover.
  *
  * Copyright (C) 2016 Jens Axboe
  *
@@ -22,6 +27,7 @@
 #include <linux/blk_types.h>
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
+#include <linux/blk-cgroup.h>
 #include <linux/swap.h>
 
 #include "blk-wbt.h"
@@ -51,6 +57,19 @@ enum {
 	 * information to scale up or down, scale up.
 	 */
 	RWB_UNKNOWN_BUMP	= 5,
+
+	/*
+	 * Background cgroup writers are limited to wb_background shifted
+	 * down by up to this many extra steps.
+	 */
+	RWB_BG_MAX_STEP		= 4,
+
+	/*
+	 * Shrink the window by up to 1 << RWB_MAX_WIN_SHIFT while the read
+	 * tail exceeds RWB_TAIL_FACTOR times the latency target.
+	 */
+	RWB_MAX_WIN_SHIFT	= 2,
+	RWB_TAIL_FACTOR		= 4,
 };
 
 static inline bool rwb_enabled(struct rq_wb *rwb)
@@ -101,9 +120,15 @@ static bool wb_recent_wait(struct rq_wb *rwb)
 	return time_before(jiffies, wb->dirty_sleep + HZ);
 }
 
-static inline struct rq_wait *get_rq_wait(struct rq_wb *rwb, bool is_kswapd)
+static inline struct rq_wait *get_rq_wait(struct rq_wb *rwb,
+					  enum wbt_flags wb_acct)
 {
-	return &rwb->rq_wait[is_kswapd];
+	if (wb_acct & WBT_KSWAPD)
+		return &rwb->rq_wait[WBT_RWQ_KSWAPD];
+	else if (wb_acct & WBT_BACKGROUND)
+		return &rwb->rq_wait[WBT_RWQ_BG];
+
+	return &rwb->rq_wait[WBT_RWQ_NORMAL];
 }
 
 static void rwb_wake_all(struct rq_wb *rwb)
@@ -126,7 +151,7 @@ void __wbt_done(struct rq_wb *rwb, enum wbt_flags wb_acct)
 	if (!(wb_acct & WBT_TRACKED))
 		return;
 
-	rqw = get_rq_wait(rwb, wb_acct & WBT_KSWAPD);
+	rqw = get_rq_wait(rwb, wb_acct);
 	inflight = atomic_dec_return(&rqw->inflight);
 
 	/*
@@ -196,6 +221,7 @@ static bool calc_wb_limits(struct rq_wb *rwb)
 
 	if (!rwb->min_lat_nsec) {
 		rwb->wb_max = rwb->wb_normal = rwb->wb_background = 0;
+		rwb->wb_bg = 0;
 		return false;
 	}
 
@@ -244,6 +270,7 @@ static bool calc_wb_limits(struct rq_wb *rwb)
 		rwb->wb_background = (rwb->wb_max + 3) / 4;
 	}
 
+	rwb->wb_bg = max(1U, rwb->wb_background >> rwb->bg_scale_step);
 	return ret;
 }
 
@@ -266,7 +293,11 @@ static u64 rwb_sync_issue_lat(struct rq_wb *rwb)
 	if (!issue || !rwb->sync_cookie)
 		return 0;
 
-	now = ktime_to_ns(ktime_get());
+	/* sync_issue is a masked blk_stat_time(), compare like with like */
+	now = __blk_stat_time(ktime_to_ns(ktime_get()));
+	if (now < issue)
+		return 0;
+
 	return now - issue;
 }
 
@@ -380,6 +411,44 @@ static void scale_down(struct rq_wb *rwb, bool hard_throttle)
 	rwb_trace_step(rwb, "step down");
 }
 
+/*
+ * Move the extra background cgroup step by 'delta'. Background writers are
+ * cut on every latency violation, even once the shared limits bottomed out.
+ */
+static void scale_bg(struct rq_wb *rwb, int delta)
+{
+	int step = clamp(rwb->bg_scale_step + delta, 0, (int)RWB_BG_MAX_STEP);
+	struct rq_wait *rqw = &rwb->rq_wait[WBT_RWQ_BG];
+
+	if (step == rwb->bg_scale_step)
+		return;
+
+	rwb->bg_scale_step = step;
+	if (rwb_enabled(rwb))
+		rwb->wb_bg = max(1U, rwb->wb_background >> step);
+
+	if (delta < 0 && waitqueue_active(&rqw->wait))
+		wake_up_all(&rqw->wait);
+}
+
+/*
+ * blk-stat only keeps min/mean/max per window, so the read max stands in
+ * for the tail latency here.
+ */
+static void adapt_window(struct rq_wb *rwb, struct blk_rq_stat *stat)
+{
+	if (!stat[READ].nr_samples)
+		return;
+
+	if (stat[READ].max > RWB_TAIL_FACTOR * rwb->min_lat_nsec) {
+		if (rwb->win_shift < RWB_MAX_WIN_SHIFT)
+			rwb->win_shift++;
+	} else if (stat[READ].max <= rwb->min_lat_nsec) {
+		if (rwb->win_shift)
+			rwb->win_shift--;
+	}
+}
+
 static void rwb_arm_timer(struct rq_wb *rwb)
 {
 	if (rwb->scale_step > 0) {
@@ -398,6 +467,7 @@ static void rwb_arm_timer(struct rq_wb *rwb)
 		 */
 		rwb->cur_win_nsec = rwb->win_nsec;
 	}
+	rwb->cur_win_nsec >>= rwb->win_shift;
 
 	blk_stat_activate_nsecs(rwb->cb, rwb->cur_win_nsec);
 }
@@ -409,6 +479,7 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	int status;
 
 	status = latency_exceeded(rwb, cb->stat);
+	adapt_window(rwb, cb->stat);
 
 	trace_wbt_timer(rwb->queue->backing_dev_info, status, rwb->scale_step,
 			inflight);
@@ -421,9 +492,11 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	switch (status) {
 	case LAT_EXCEEDED:
 		scale_down(rwb, true);
+		scale_bg(rwb, 1);
 		break;
 	case LAT_OK:
 		scale_up(rwb);
+		scale_bg(rwb, -1);
 		break;
 	case LAT_UNKNOWN_WRITES:
 		/*
@@ -432,6 +505,7 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 		 * Allow step to go negative, to increase write perf.
 		 */
 		scale_up(rwb);
+		scale_bg(rwb, -1);
 		break;
 	case LAT_UNKNOWN:
 		if (++rwb->unknown_cnt < RWB_UNKNOWN_BUMP)
@@ -445,6 +519,7 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 			scale_up(rwb);
 		else if (rwb->scale_step < 0)
 			scale_down(rwb, false);
+		scale_bg(rwb, -1);
 		break;
 	default:
 		break;
@@ -453,13 +528,15 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	/*
 	 * Re-arm timer, if we have IO in flight
 	 */
-	if (rwb->scale_step || inflight)
+	if (rwb->scale_step || rwb->bg_scale_step || inflight)
 		rwb_arm_timer(rwb);
 }
 
 void wbt_update_limits(struct rq_wb *rwb)
 {
 	rwb->scale_step = 0;
+	rwb->bg_scale_step = 0;
+	rwb->win_shift = 0;
 	rwb->scaled_max = false;
 	calc_wb_limits(rwb);
 
@@ -476,10 +553,18 @@ static bool close_io(struct rq_wb *rwb)
 
 #define REQ_HIPRIO	(REQ_SYNC | REQ_META | REQ_PRIO)
 
-static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
+static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw,
+				     enum wbt_flags wb_acct)
 {
 	unsigned int limit;
 
+	/*
+	 * Background cgroup writers only get the regular limits while nothing
+	 * else is going on and reads have been meeting the target.
+	 */
+	if ((wb_acct & WBT_BACKGROUND) && (rwb->bg_scale_step || close_io(rwb)))
+		return rwb->wb_bg;
+
 	/*
 	 * At this point we know it's a buffered write. If this is
 	 * kswapd trying to free memory, or REQ_SYNC is set, set, then
@@ -503,7 +588,8 @@ static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
 }
 
 static inline bool may_queue(struct rq_wb *rwb, struct rq_wait *rqw,
-			     wait_queue_entry_t *wait, unsigned long rw)
+			     wait_queue_entry_t *wait, unsigned long rw,
+			     enum wbt_flags wb_acct)
 {
 	/*
 	 * inc it here even if disabled, since we'll dec it at completion.
@@ -523,28 +609,29 @@ static inline bool may_queue(struct rq_wb *rwb, struct rq_wait *rqw,
 	    rqw->wait.head.next != &wait->entry)
 		return false;
 
-	return atomic_inc_below(&rqw->inflight, get_limit(rwb, rw));
+	return atomic_inc_below(&rqw->inflight, get_limit(rwb, rw, wb_acct));
 }
 
 /*
  * Block if we will exceed our limit, or if we are currently waiting for
  * the timer to kick off queuing again.
  */
-static void __wbt_wait(struct rq_wb *rwb, unsigned long rw, spinlock_t *lock)
+static void __wbt_wait(struct rq_wb *rwb, enum wbt_flags wb_acct,
+		       unsigned long rw, spinlock_t *lock)
 	__releases(lock)
 	__acquires(lock)
 {
-	struct rq_wait *rqw = get_rq_wait(rwb, current_is_kswapd());
+	struct rq_wait *rqw = get_rq_wait(rwb, wb_acct);
 	DEFINE_WAIT(wait);
 
-	if (may_queue(rwb, rqw, &wait, rw))
+	if (may_queue(rwb, rqw, &wait, rw, wb_acct))
 		return;
 
 	do {
 		prepare_to_wait_exclusive(&rqw->wait, &wait,
 						TASK_UNINTERRUPTIBLE);
 
-		if (may_queue(rwb, rqw, &wait, rw))
+		if (may_queue(rwb, rqw, &wait, rw, wb_acct))
 			break;
 
 		if (lock) {
@@ -577,6 +664,25 @@ static inline bool wbt_should_throttle(struct rq_wb *rwb, struct bio *bio)
 	return true;
 }
 
+/*
+ * Which class of writer this is: kswapd, a task in a background cgroup, or
+ * anything else.
+ */
+static enum wbt_flags wbt_writer_class(struct bio *bio)
+{
+	bool background = false;
+
+	if (current_is_kswapd())
+		return WBT_KSWAPD;
+
+#ifdef CONFIG_BLK_CGROUP
+	rcu_read_lock();
+	background = bio_blkcg(bio) != &blkcg_root;
+	rcu_read_unlock();
+#endif
+	return background ? WBT_BACKGROUND : 0;
+}
+
 /*
  * Returns true if the IO request should be accounted, false if not.
  * May sleep, if we have exceeded the writeback limits. Caller can pass
@@ -599,14 +705,12 @@ enum wbt_flags wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
 		return ret;
 	}
 
-	__wbt_wait(rwb, bio->bi_opf, lock);
+	ret |= wbt_writer_class(bio);
+	__wbt_wait(rwb, ret, bio->bi_opf, lock);
 
 	if (!blk_stat_is_active(rwb->cb))
 		rwb_arm_timer(rwb);
 
-	if (current_is_kswapd())
-		ret |= WBT_KSWAPD;
-
 	return ret | WBT_TRACKED;
 }
 
@@ -14,12 +14,20 @@ enum wbt_flags {
 	WBT_TRACKED		= 1,	/* write, tracked for throttling */
 	WBT_READ		= 2,	/* read */
 	WBT_KSWAPD		= 4,	/* write, from kswapd */
+	WBT_BACKGROUND		= 8,	/* write, from a background cgroup */
 
-	WBT_NR_BITS		= 3,	/* number of bits */
+	WBT_NR_BITS		= 4,	/* number of bits */
 };
 
+/*
+ * Writers are split into classes that are counted and woken separately, so
+ * that background cgroup writeback never queues ahead of foreground writes.
+ */
 enum {
-	WBT_NUM_RWQ		= 2,
+	WBT_RWQ_NORMAL		= 0,
+	WBT_RWQ_KSWAPD,
+	WBT_RWQ_BG,
+	WBT_NUM_RWQ,
 };
 
 /*
@@ -68,7 +76,9 @@ struct rq_wb {
 	unsigned int wb_background;		/* background writeback */
 	unsigned int wb_normal;			/* normal writeback */
 	unsigned int wb_max;			/* max throughput writeback */
+	unsigned int wb_bg;			/* background cgroup writeback */
 	int scale_step;
+	int bg_scale_step;			/* extra step for wb_bg, >= 0 */
 	bool scaled_max;
 
 	short enable_state;			/* WBT_STATE_* */
@@ -81,6 +91,7 @@ struct rq_wb {
 
 	u64 win_nsec;				/* default window size */
 	u64 cur_win_nsec;			/* current window size */
+	unsigned int win_shift;			/* window shrink from read tail */
 
 	struct blk_stat_callback *cb;
 
@@ -20,9 +20,13 @@
 #include <linux/kernel.h>
 #include <linux/blkdev.h>
 #include <linux/blk-mq.h>
+#include <linux/blk-cgroup.h>
 #include <linux/elevator.h>
+#include <linux/iocontext.h>
+#include <linux/ioprio.h>
 #include <linux/module.h>
 #include <linux/sbitmap.h>
+#include <linux/swap.h>
 
 #include "blk.h"
 #include "blk-mq.h"
@@ -36,9 +40,17 @@ enum {
 	KYBER_READ,
 	KYBER_SYNC_WRITE,
 	KYBER_OTHER, /* Async writes, discard, etc. */
+	/*
+	 * All requests issued from a background context: a non-root blkio
+	 * cgroup, the idle I/O class or kswapd. These never share tokens with
+	 * the foreground domains above.
+	 */
+	KYBER_BACKGROUND,
 	KYBER_NUM_DOMAINS,
 };
 
+#define KYBER_NUM_FG_DOMAINS KYBER_BACKGROUND
+
 enum {
 	KYBER_MIN_DEPTH = 256,
 
@@ -48,6 +60,12 @@ enum {
 	 * operations.
 	 */
 	KYBER_ASYNC_PERCENT = 75,
+
+	/*
+	 * The background domain only gets a batch when no foreground domain
+	 * can dispatch, or after it has been passed over this many times.
+	 */
+	KYBER_BG_MAX_SKIP = 8,
 };
 
 /*
@@ -61,6 +79,7 @@ static const unsigned int kyber_depth[] = {
 	[KYBER_READ] = 256,
 	[KYBER_SYNC_WRITE] = 128,
 	[KYBER_OTHER] = 64,
+	[KYBER_BACKGROUND] = 32,
 };
 
 /*
@@ -70,6 +89,7 @@ static const unsigned int kyber_batch_size[] = {
 	[KYBER_READ] = 16,
 	[KYBER_SYNC_WRITE] = 8,
 	[KYBER_OTHER] = 8,
+	[KYBER_BACKGROUND] = 4,
 };
 
 struct kyber_queue_data {
@@ -91,7 +111,7 @@ struct kyber_queue_data {
 	unsigned int async_depth;
 
 	/* Target latencies in nanoseconds. */
-	u64 read_lat_nsec, write_lat_nsec;
+	u64 read_lat_nsec, write_lat_nsec, bg_lat_nsec;
 };
 
 struct kyber_hctx_data {
@@ -99,11 +119,37 @@ struct kyber_hctx_data {
 	struct list_head rqs[KYBER_NUM_DOMAINS];
 	unsigned int cur_domain;
 	unsigned int batching;
+	unsigned int bg_skipped;
 	wait_queue_entry_t domain_wait[KYBER_NUM_DOMAINS];
 	atomic_t wait_index[KYBER_NUM_DOMAINS];
 };
 
-static int rq_sched_domain(const struct request *rq)
+static bool kyber_bio_is_background(struct bio *bio)
+{
+	struct io_context *ioc = current->io_context;
+	bool background = false;
+
+	/* Reclaim writeback must never compete with foreground reads. */
+	if (current_is_kswapd())
+		return true;
+
+	if (IOPRIO_PRIO_CLASS(bio_prio(bio)) == IOPRIO_CLASS_IDLE ||
+	    (ioc && IOPRIO_PRIO_CLASS(ioc->ioprio) == IOPRIO_CLASS_IDLE))
+		return true;
+
+#ifdef CONFIG_BLK_CGROUP
+	/*
+	 * Android keeps foreground tasks in the root blkio cgroup and moves
+	 * everything else into child groups.
+	 */
+	rcu_read_lock();
+	background = bio_blkcg(bio) != &blkcg_root;
+	rcu_read_unlock();
+#endif
+	return background;
+}
+
+static int rq_op_sched_domain(const struct request *rq)
 {
 	unsigned int op = rq->cmd_flags;
 
@@ -115,6 +161,18 @@ static int rq_sched_domain(const struct request *rq)
 		return KYBER_OTHER;
 }
 
+/*
+ * The domain is picked once in kyber_prepare_request(), while the submitting
+ * task is still known, and stashed in the request. Requests that bypassed the
+ * scheduler are classified by operation only.
+ */
+static int rq_sched_domain(const struct request *rq)
+{
+	if (rq->rq_flags & RQF_ELVPRIV)
+		return (long)rq->elv.priv[1];
+	return rq_op_sched_domain(rq);
+}
+
 enum {
 	NONE = 0,
 	GOOD = 1,
@@ -244,6 +302,48 @@ static void kyber_adjust_other_depth(struct kyber_queue_data *kqd,
 		sbitmap_queue_resize(&kqd->domain_tokens[KYBER_OTHER], depth);
 }
 
+/*
+ * Adjust the depth of background requests. Unlike other requests, background
+ * requests are throttled as soon as either foreground domain misses its
+ * target, and only grow while the foreground is meeting its targets.
+ */
+static void kyber_adjust_bg_depth(struct kyber_queue_data *kqd,
+				  int read_status, int write_status,
+				  int bg_status)
+{
+	unsigned int orig_depth, depth;
+	int fg_status;
+
+	orig_depth = depth = kqd->domain_tokens[KYBER_BACKGROUND].sb.depth;
+
+	if (read_status == NONE)
+		fg_status = write_status;
+	else if (write_status == NONE)
+		fg_status = read_status;
+	else
+		fg_status = min(read_status, write_status);
+
+	switch (fg_status) {
+	case AWFUL:
+		depth /= 2;
+		break;
+	case BAD:
+		depth -= max(depth / 4, 1U);
+		break;
+	default:
+		if (fg_status == NONE || IS_BAD(bg_status))
+			depth += 2;
+		else if (bg_status != NONE)
+			depth++;
+		break;
+	}
+
+	depth = clamp(depth, 1U, kyber_depth[KYBER_BACKGROUND]);
+	if (depth != orig_depth)
+		sbitmap_queue_resize(&kqd->domain_tokens[KYBER_BACKGROUND],
+				     depth);
+}
+
 /*
  * Apply heuristics for limiting queue depths based on gathered latency
  * statistics.
@@ -251,23 +351,27 @@ static void kyber_adjust_other_depth(struct kyber_queue_data *kqd,
 static void kyber_stat_timer_fn(struct blk_stat_callback *cb)
 {
 	struct kyber_queue_data *kqd = cb->data;
-	int read_status, write_status;
+	int read_status, write_status, bg_status;
 
 	read_status = kyber_lat_status(cb, KYBER_READ, kqd->read_lat_nsec);
 	write_status = kyber_lat_status(cb, KYBER_SYNC_WRITE, kqd->write_lat_nsec);
+	bg_status = kyber_lat_status(cb, KYBER_BACKGROUND, kqd->bg_lat_nsec);
 
 	kyber_adjust_rw_depth(kqd, KYBER_READ, read_status, write_status);
 	kyber_adjust_rw_depth(kqd, KYBER_SYNC_WRITE, write_status, read_status);
 	kyber_adjust_other_depth(kqd, read_status, write_status,
 				 cb->stat[KYBER_OTHER].nr_samples != 0);
+	kyber_adjust_bg_depth(kqd, read_status, write_status, bg_status);
 
 	/*
 	 * Continue monitoring latencies if we aren't hitting the targets or
-	 * we're still throttling other requests.
+	 * we're still throttling other or background requests.
 	 */
 	if (!blk_stat_is_active(kqd->cb) &&
 	    ((IS_BAD(read_status) || IS_BAD(write_status) ||
-	      kqd->domain_tokens[KYBER_OTHER].sb.depth < kyber_depth[KYBER_OTHER])))
+	      kqd->domain_tokens[KYBER_OTHER].sb.depth < kyber_depth[KYBER_OTHER] ||
+	      kqd->domain_tokens[KYBER_BACKGROUND].sb.depth <
+			kyber_depth[KYBER_BACKGROUND])))
 		blk_stat_activate_msecs(kqd->cb, 100);
 }
 
@@ -324,6 +428,7 @@ static struct kyber_queue_data *kyber_queue_data_alloc(struct request_queue *q)
 
 	kqd->read_lat_nsec = 2000000ULL;
 	kqd->write_lat_nsec = 10000000ULL;
+	kqd->bg_lat_nsec = 50000000ULL;
 
 	return kqd;
 
@@ -391,6 +496,7 @@ static int kyber_init_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
 
 	khd->cur_domain = 0;
 	khd->batching = 0;
+	khd->bg_skipped = 0;
 
 	hctx->sched_data = khd;
 
@@ -441,7 +547,14 @@ static void kyber_limit_depth(unsigned int op, struct blk_mq_alloc_data *data)
 
 static void kyber_prepare_request(struct request *rq, struct bio *bio)
 {
+	int sched_domain;
+
 	rq_set_domain_token(rq, -1);
+	if (bio && kyber_bio_is_background(bio))
+		sched_domain = KYBER_BACKGROUND;
+	else
+		sched_domain = rq_op_sched_domain(rq);
+	rq->elv.priv[1] = (void *)(long)sched_domain;
 }
 
 static void kyber_finish_request(struct request *rq)
@@ -470,6 +583,9 @@ static void kyber_completed_request(struct request *rq)
 	case KYBER_SYNC_WRITE:
 		target = kqd->write_lat_nsec;
 		break;
+	case KYBER_BACKGROUND:
+		target = kqd->bg_lat_nsec;
+		break;
 	default:
 		return;
 	}
@@ -611,21 +727,44 @@ static struct request *kyber_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	 * 2. The domain we were batching didn't have any requests.
 	 * 3. The domain we were batching was out of tokens.
 	 *
-	 * Start another batch. Note that this wraps back around to the original
-	 * domain if no other domains have requests or tokens.
+	 * Start another batch. A background batch that has been passed over
+	 * too often goes first so that background requests make progress.
 	 */
 	khd->batching = 0;
-	for (i = 0; i < KYBER_NUM_DOMAINS; i++) {
-		if (khd->cur_domain == KYBER_NUM_DOMAINS - 1)
+	if (khd->bg_skipped >= KYBER_BG_MAX_SKIP) {
+		khd->bg_skipped = 0;
+		khd->cur_domain = KYBER_BACKGROUND;
+		rq = kyber_dispatch_cur_domain(kqd, khd, hctx, &flushed);
+		if (rq)
+			goto out;
+	}
+
+	/*
+	 * Otherwise rotate through the foreground domains. Note that this
+	 * wraps back around to the original domain if no other foreground
+	 * domains have requests or tokens.
+	 */
+	for (i = 0; i < KYBER_NUM_FG_DOMAINS; i++) {
+		if (khd->cur_domain >= KYBER_NUM_FG_DOMAINS - 1)
 			khd->cur_domain = 0;
 		else
 			khd->cur_domain++;
 
 		rq = kyber_dispatch_cur_domain(kqd, khd, hctx, &flushed);
-		if (rq)
+		if (rq) {
+			if (!list_empty_careful(&khd->rqs[KYBER_BACKGROUND]))
+				khd->bg_skipped++;
 			goto out;
+		}
 	}
 
+	/* Background requests are only dispatched when the foreground is idle. */
+	khd->cur_domain = KYBER_BACKGROUND;
+	khd->bg_skipped = 0;
+	rq = kyber_dispatch_cur_domain(kqd, khd, hctx, &flushed);
+	if (rq)
+		goto out;
+
 	rq = NULL;
 out:
 	spin_unlock(&khd->lock);
@@ -670,12 +809,14 @@ static ssize_t kyber_##op##_lat_store(struct elevator_queue *e,		\
 }
 KYBER_LAT_SHOW_STORE(read);
 KYBER_LAT_SHOW_STORE(write);
+KYBER_LAT_SHOW_STORE(bg);
 #undef KYBER_LAT_SHOW_STORE
 
 #define KYBER_LAT_ATTR(op) __ATTR(op##_lat_nsec, 0644, kyber_##op##_lat_show, kyber_##op##_lat_store)
 static struct elv_fs_entry kyber_sched_attrs[] = {
 	KYBER_LAT_ATTR(read),
 	KYBER_LAT_ATTR(write),
+	KYBER_LAT_ATTR(bg),
 	__ATTR_NULL
 };
 #undef KYBER_LAT_ATTR
@@ -738,6 +879,7 @@ static int kyber_##name##_waiting_show(void *data, struct seq_file *m)	\
 KYBER_DEBUGFS_DOMAIN_ATTRS(KYBER_READ, read)
 KYBER_DEBUGFS_DOMAIN_ATTRS(KYBER_SYNC_WRITE, sync_write)
 KYBER_DEBUGFS_DOMAIN_ATTRS(KYBER_OTHER, other)
+KYBER_DEBUGFS_DOMAIN_ATTRS(KYBER_BACKGROUND, background)
 #undef KYBER_DEBUGFS_DOMAIN_ATTRS
 
 static int kyber_async_depth_show(void *data, struct seq_file *m)
@@ -764,6 +906,9 @@ static int kyber_cur_domain_show(void *data, struct seq_file *m)
 	case KYBER_OTHER:
 		seq_puts(m, "OTHER\n");
 		break;
+	case KYBER_BACKGROUND:
+		seq_puts(m, "BACKGROUND\n");
+		break;
 	default:
 		seq_printf(m, "%u\n", khd->cur_domain);
 		break;
@@ -780,12 +925,22 @@ static int kyber_batching_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int kyber_bg_skipped_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	struct kyber_hctx_data *khd = hctx->sched_data;
+
+	seq_printf(m, "%u\n", khd->bg_skipped);
+	return 0;
+}
+
 #define KYBER_QUEUE_DOMAIN_ATTRS(name)	\
 	{#name "_tokens", 0400, kyber_##name##_tokens_show}
 static const struct blk_mq_debugfs_attr kyber_queue_debugfs_attrs[] = {
 	KYBER_QUEUE_DOMAIN_ATTRS(read),
 	KYBER_QUEUE_DOMAIN_ATTRS(sync_write),
 	KYBER_QUEUE_DOMAIN_ATTRS(other),
+	KYBER_QUEUE_DOMAIN_ATTRS(background),
 	{"async_depth", 0400, kyber_async_depth_show},
 	{},
 };
@@ -798,8 +953,10 @@ static const struct blk_mq_debugfs_attr kyber_hctx_debugfs_attrs[] = {
 	KYBER_HCTX_DOMAIN_ATTRS(read),
 	KYBER_HCTX_DOMAIN_ATTRS(sync_write),
 	KYBER_HCTX_DOMAIN_ATTRS(other),
+	KYBER_HCTX_DOMAIN_ATTRS(background),
 	{"cur_domain", 0400, kyber_cur_domain_show},
 	{"batching", 0400, kyber_batching_show},
+	{"bg_skipped", 0400, kyber_bg_skipped_show},
 	{},
 };
 #undef KYBER_HCTX_DOMAIN_ATTRS
@@ -231,6 +231,87 @@ static void sha256_transform(u32 *state, const u8 *input)
 	memzero_explicit(W, 64 * sizeof(u32));
 }
 
+/*
+ * Two independent messages hashed with their rounds interleaved, which lets
+ * superscalar CPUs overlap the two dependency chains of the compression
+ * function. Used by sha256_finup_mb().
+ */
+static const u32 sha256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA256_ROUND_2X(a, b, c, d, e, f, g, h, i) do {			\
+	u32 t1_0 = h##_0 + e1(e##_0) + Ch(e##_0, f##_0, g##_0) +		\
+		   sha256_K[i] + W0[i];						\
+	u32 t1_1 = h##_1 + e1(e##_1) + Ch(e##_1, f##_1, g##_1) +		\
+		   sha256_K[i] + W1[i];						\
+	u32 t2_0 = e0(a##_0) + Maj(a##_0, b##_0, c##_0);			\
+	u32 t2_1 = e0(a##_1) + Maj(a##_1, b##_1, c##_1);			\
+									\
+	d##_0 += t1_0;							\
+	d##_1 += t1_1;							\
+	h##_0 = t1_0 + t2_0;						\
+	h##_1 = t1_1 + t2_1;						\
+} while (0)
+
+static void sha256_transform_2x(u32 *state0, u32 *state1,
+				const u8 *input0, const u8 *input1)
+{
+	u32 a_0, b_0, c_0, d_0, e_0, f_0, g_0, h_0;
+	u32 a_1, b_1, c_1, d_1, e_1, f_1, g_1, h_1;
+	u32 W0[64], W1[64];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		LOAD_OP(i, W0, input0);
+		LOAD_OP(i, W1, input1);
+	}
+
+	for (i = 16; i < 64; i++) {
+		BLEND_OP(i, W0);
+		BLEND_OP(i, W1);
+	}
+
+	a_0 = state0[0]; b_0 = state0[1]; c_0 = state0[2]; d_0 = state0[3];
+	e_0 = state0[4]; f_0 = state0[5]; g_0 = state0[6]; h_0 = state0[7];
+	a_1 = state1[0]; b_1 = state1[1]; c_1 = state1[2]; d_1 = state1[3];
+	e_1 = state1[4]; f_1 = state1[5]; g_1 = state1[6]; h_1 = state1[7];
+
+	for (i = 0; i < 64; i += 8) {
+		SHA256_ROUND_2X(a, b, c, d, e, f, g, h, i + 0);
+		SHA256_ROUND_2X(h, a, b, c, d, e, f, g, i + 1);
+		SHA256_ROUND_2X(g, h, a, b, c, d, e, f, i + 2);
+		SHA256_ROUND_2X(f, g, h, a, b, c, d, e, i + 3);
+		SHA256_ROUND_2X(e, f, g, h, a, b, c, d, i + 4);
+		SHA256_ROUND_2X(d, e, f, g, h, a, b, c, i + 5);
+		SHA256_ROUND_2X(c, d, e, f, g, h, a, b, i + 6);
+		SHA256_ROUND_2X(b, c, d, e, f, g, h, a, i + 7);
+	}
+
+	state0[0] += a_0; state0[1] += b_0; state0[2] += c_0; state0[3] += d_0;
+	state0[4] += e_0; state0[5] += f_0; state0[6] += g_0; state0[7] += h_0;
+	state1[0] += a_1; state1[1] += b_1; state1[2] += c_1; state1[3] += d_1;
+	state1[4] += e_1; state1[5] += f_1; state1[6] += g_1; state1[7] += h_1;
+
+	memzero_explicit(W0, sizeof(W0));
+	memzero_explicit(W1, sizeof(W1));
+}
+
 static void sha256_generic_block_fn(struct sha256_state *sst, u8 const *src,
 				    int blocks)
 {
@@ -261,13 +342,64 @@ int crypto_sha256_finup(struct shash_desc *desc, const u8 *data,
 }
 EXPORT_SYMBOL(crypto_sha256_finup);
 
+static int sha256_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			   unsigned int len, u8 * const outs[],
+			   unsigned int num_msgs)
+{
+	SHASH_DESC_ON_STACK(desc2, desc->tfm);
+	struct sha256_state *sctx0, *sctx1;
+	unsigned int head, blocks;
+	const u8 *src0, *src1;
+	int err;
+
+	/* crypto_shash_finup_mb() never passes more than mb_max_msgs */
+	if (WARN_ON_ONCE(num_msgs != 2))
+		return -EINVAL;
+
+	desc2->tfm = desc->tfm;
+	desc2->flags = desc->flags;
+	sctx0 = shash_desc_ctx(desc2);
+	sctx1 = shash_desc_ctx(desc);
+	*sctx0 = *sctx1;
+
+	/* first complete the block partially filled by the common prefix */
+	head = -sctx1->count % SHA256_BLOCK_SIZE;
+	if (len < head + SHA256_BLOCK_SIZE) {
+		err = crypto_sha256_finup(desc2, data[0], len, outs[0]) ?:
+		      crypto_sha256_finup(desc, data[1], len, outs[1]);
+		goto out;
+	}
+	sha256_base_do_update(desc2, data[0], head, sha256_generic_block_fn);
+	sha256_base_do_update(desc, data[1], head, sha256_generic_block_fn);
+	src0 = data[0] + head;
+	src1 = data[1] + head;
+
+	blocks = (len - head) / SHA256_BLOCK_SIZE;
+	sctx0->count += blocks * SHA256_BLOCK_SIZE;
+	sctx1->count += blocks * SHA256_BLOCK_SIZE;
+	while (blocks--) {
+		sha256_transform_2x(sctx0->state, sctx1->state, src0, src1);
+		src0 += SHA256_BLOCK_SIZE;
+		src1 += SHA256_BLOCK_SIZE;
+	}
+
+	len = (len - head) % SHA256_BLOCK_SIZE;
+	err = crypto_sha256_finup(desc2, src0, len, outs[0]) ?:
+	      crypto_sha256_finup(desc, src1, len, outs[1]);
+out:
+	shash_desc_zero(desc2);
+	return err;
+}
+
 static struct shash_alg sha256_algs[2] = { {
 	.digestsize	=	SHA256_DIGEST_SIZE,
 	.init		=	sha256_base_init,
 	.update		=	crypto_sha256_update,
 	.final		=	sha256_final,
 	.finup		=	crypto_sha256_finup,
+	.finup_mb	=	sha256_finup_mb,
 	.descsize	=	sizeof(struct sha256_state),
+	.mb_max_msgs	=	2,
 	.base		=	{
 		.cra_name	=	"sha256",
 		.cra_driver_name=	"sha256-generic",
@@ -281,7 +413,9 @@ static struct shash_alg sha256_algs[2] = { {
 	.update		=	crypto_sha256_update,
 	.final		=	sha256_final,
 	.finup		=	crypto_sha256_finup,
+	.finup_mb	=	sha256_finup_mb,
 	.descsize	=	sizeof(struct sha256_state),
+	.mb_max_msgs	=	2,
 	.base		=	{
 		.cra_name	=	"sha224",
 		.cra_driver_name=	"sha224-generic",
@@ -195,6 +195,52 @@ int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 }
 EXPORT_SYMBOL_GPL(crypto_shash_finup);
 
+static bool shash_mb_aligned(struct crypto_shash *tfm, const u8 * const data[],
+			     u8 * const outs[], unsigned int num_msgs)
+{
+	unsigned long alignmask = crypto_shash_alignmask(tfm);
+	unsigned int i;
+
+	for (i = 0; i < num_msgs; i++)
+		if (((unsigned long)data[i] | (unsigned long)outs[i]) &
+		    alignmask)
+			return false;
+	return true;
+}
+
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	struct shash_alg *shash = crypto_shash_alg(tfm);
+	SHASH_DESC_ON_STACK(desc2, tfm);
+	unsigned int i;
+	int err;
+
+	if (unlikely(!num_msgs))
+		return 0;
+	if (num_msgs == 1)
+		return crypto_shash_finup(desc, data[0], len, outs[0]);
+
+	if (shash->finup_mb && num_msgs <= shash->mb_max_msgs &&
+	    shash_mb_aligned(tfm, data, outs, num_msgs))
+		return shash->finup_mb(desc, data, len, outs, num_msgs);
+
+	/* all but the last message hash a copy of the common prefix */
+	for (i = 0; i < num_msgs - 1; i++) {
+		memcpy(desc2, desc, sizeof(*desc) + crypto_shash_descsize(tfm));
+		err = crypto_shash_finup(desc2, data[i], len, outs[i]);
+		if (err)
+			goto out;
+	}
+	err = crypto_shash_finup(desc, data[i], len, outs[i]);
+out:
+	shash_desc_zero(desc2);
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_shash_finup_mb);
+
 static int shash_digest_unaligned(struct shash_desc *desc, const u8 *data,
 				  unsigned int len, u8 *out)
 {
@@ -498,6 +544,10 @@ static int shash_prepare_alg(struct shash_alg *alg)
 	}
 	if (!alg->setkey)
 		alg->setkey = shash_no_setkey;
+	if (!alg->finup_mb)
+		alg->mb_max_msgs = 1;
+	else if (alg->mb_max_msgs < 2)
+		return -EINVAL;
 
 	return 0;
 }
@@ -86,7 +86,7 @@ bool zcomp_available_algorithm(const char *comp)
 }
 
 /* show available compressors */
-ssize_t zcomp_available_show(const char *comp, char *buf)
+ssize_t zcomp_available_show(const char *comp, char *buf, size_t len)
 {
 	bool known_algorithm = false;
 	ssize_t sz = 0;
@@ -95,10 +95,10 @@ ssize_t zcomp_available_show(const char *comp, char *buf)
 	for (; backends[i]; i++) {
 		if (!strcmp(comp, backends[i])) {
 			known_algorithm = true;
-			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+			sz += scnprintf(buf + sz, len - sz - 2,
 					"[%s] ", backends[i]);
 		} else {
-			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+			sz += scnprintf(buf + sz, len - sz - 2,
 					"%s ", backends[i]);
 		}
 	}
@@ -108,10 +108,10 @@ ssize_t zcomp_available_show(const char *comp, char *buf)
 	 * entry in `backends'.
 	 */
 	if (!known_algorithm && crypto_has_comp(comp, 0, 0) == 1)
-		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+		sz += scnprintf(buf + sz, len - sz - 2,
 				"[%s] ", comp);
 
-	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+	sz += scnprintf(buf + sz, len - sz, "\n");
 	return sz;
 }
 
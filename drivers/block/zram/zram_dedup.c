@@ -8,15 +8,26 @@
  */
 
 #include <linux/vmalloc.h>
-#include <linux/jhash.h>
+#include <linux/xxhash.h>
 #include <linux/highmem.h>
+#include <linux/log2.h>
 
 #include "zram_drv.h"
 
-/* One slot will contain 128 pages theoretically */
-#define ZRAM_HASH_SHIFT		7
-#define ZRAM_HASH_SIZE_MIN	(1 << 10)
-#define ZRAM_HASH_SIZE_MAX	(1 << 31)
+/*
+ * Entries live in fixed size buckets, so a lookup touches a single cache
+ * friendly array instead of walking a tree. A bucket holds the upper half
+ * of each fingerprint as a tag to avoid dereferencing non-matching
+ * entries. A full bucket spills over to its buddy bucket (index ^ 1),
+ * which is covered by the same lock. When both are full the new entry
+ * is not indexed, which only costs potential future dedup hits; such
+ * entries are counted in dedup_unindexed.
+ */
+/* Index one entry per two pages theoretically */
+#define ZRAM_HASH_SHIFT		1
+#define ZRAM_HASH_SIZE_MIN	(1 << 7)
+#define ZRAM_HASH_SIZE_MAX	(1 << 24)
+#define ZRAM_HASH_LOCKS_PER_CPU	4
 
 u64 zram_dedup_dup_size(struct zram *zram)
 {
@@ -28,42 +39,86 @@ u64 zram_dedup_meta_size(struct zram *zram)
 	return (u64)atomic64_read(&zram->stats.meta_data_size);
 }
 
-static u32 zram_dedup_checksum(unsigned char *mem)
+u64 zram_dedup_hits(struct zram *zram)
+{
+	return (u64)atomic64_read(&zram->stats.dedup_hits);
+}
+
+u64 zram_dedup_misses(struct zram *zram)
+{
+	return (u64)atomic64_read(&zram->stats.dedup_misses);
+}
+
+u64 zram_dedup_collisions(struct zram *zram)
+{
+	return (u64)atomic64_read(&zram->stats.dedup_collisions);
+}
+
+u64 zram_dedup_unindexed(struct zram *zram)
+{
+	return (u64)atomic64_read(&zram->stats.dedup_unindexed);
+}
+
+static u64 zram_dedup_checksum(unsigned char *mem)
+{
+	return xxh64(mem, PAGE_SIZE, 0);
+}
+
+static inline u32 zram_dedup_tag(u64 checksum)
+{
+	return checksum >> 32;
+}
+
+static inline struct zram_hash *zram_dedup_bucket(struct zram *zram,
+				u64 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+static inline struct zram_hash *zram_dedup_buddy(struct zram *zram,
+				struct zram_hash *hash)
+{
+	return &zram->hash[(hash - zram->hash) ^ 1];
+}
+
+/*
+ * hash_lock_mask < hash_size, so one bucket always maps to one lock, and
+ * a bucket and its buddy always map to the same one.
+ */
+static inline spinlock_t *zram_dedup_lock(struct zram *zram, u64 checksum)
 {
-	return jhash(mem, PAGE_SIZE, 0);
+	return &zram->hash_locks[((checksum & (zram->hash_size - 1)) >> 1) &
+				 zram->hash_lock_mask];
 }
 
 void zram_dedup_insert(struct zram *zram, struct zram_entry *new,
-				u32 checksum)
+				u64 checksum)
 {
 	struct zram_hash *hash;
-	struct rb_root *rb_root;
-	struct rb_node **rb_node, *parent = NULL;
-	struct zram_entry *entry;
+	spinlock_t *lock;
+	int b, i;
 
 	if (!zram_dedup_enabled(zram))
 		return;
 
 	new->checksum = checksum;
-	hash = &zram->hash[checksum % zram->hash_size];
-	rb_root = &hash->rb_root;
-
-	spin_lock(&hash->lock);
-	rb_node = &rb_root->rb_node;
-	while (*rb_node) {
-		parent = *rb_node;
-		entry = rb_entry(parent, struct zram_entry, rb_node);
-		if (checksum < entry->checksum)
-			rb_node = &parent->rb_left;
-		else if (checksum > entry->checksum)
-			rb_node = &parent->rb_right;
-		else
-			rb_node = &parent->rb_left;
+	hash = zram_dedup_bucket(zram, checksum);
+	lock = zram_dedup_lock(zram, checksum);
+
+	spin_lock(lock);
+	for (b = 0; b < 2; b++, hash = zram_dedup_buddy(zram, hash)) {
+		for (i = 0; i < ZRAM_HASH_BUCKET_SLOTS; i++) {
+			if (hash->entry[i])
+				continue;
+
+			hash->tag[i] = zram_dedup_tag(checksum);
+			hash->entry[i] = new;
+			spin_unlock(lock);
+			return;
+		}
 	}
-
-	rb_link_node(&new->rb_node, parent, rb_node);
-	rb_insert_color(&new->rb_node, rb_root);
-	spin_unlock(&hash->lock);
+	spin_unlock(lock);
+	atomic64_inc(&zram->stats.dedup_unindexed);
 }
 
 static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
@@ -77,10 +132,12 @@ static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
 	if (entry->len == PAGE_SIZE) {
 		match = !memcmp(mem, cmem, PAGE_SIZE);
 	} else {
-		zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp *comp = zram->comps[ZRAM_PRIMARY_COMP];
+
+		zstrm = zcomp_stream_get(comp);
 		if (!zcomp_decompress(zstrm, cmem, entry->len, zstrm->buffer))
 			match = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, entry->handle);
 
@@ -91,98 +148,81 @@ static unsigned long zram_dedup_put(struct zram *zram,
 				struct zram_entry *entry)
 {
 	struct zram_hash *hash;
-	u32 checksum;
+	spinlock_t *lock;
 	unsigned long val;
+	int b, i;
 
-	checksum = entry->checksum;
-	hash = &zram->hash[checksum % zram->hash_size];
+	hash = zram_dedup_bucket(zram, entry->checksum);
+	lock = zram_dedup_lock(zram, entry->checksum);
 
-	spin_lock(&hash->lock);
+	spin_lock(lock);
 
 	val = --entry->refcount;
-	if (!entry->refcount)
-		rb_erase(&entry->rb_node, &hash->rb_root);
-	else
+	if (!entry->refcount) {
+		for (b = 0; b < 2; b++, hash = zram_dedup_buddy(zram, hash)) {
+			for (i = 0; i < ZRAM_HASH_BUCKET_SLOTS; i++) {
+				if (hash->entry[i] == entry) {
+					hash->entry[i] = NULL;
+					goto unlock;
+				}
+			}
+		}
+	} else {
 		atomic64_sub(entry->len, &zram->stats.dup_data_size);
-
-	spin_unlock(&hash->lock);
-
-	return val;
-}
-
-static struct zram_entry *__zram_dedup_get(struct zram *zram,
-				struct zram_hash *hash, unsigned char *mem,
-				struct zram_entry *entry)
-{
-	struct zram_entry *tmp, *prev = NULL;
-	struct rb_node *rb_node;
-
-	/* find left-most entry with same checksum */
-	while ((rb_node = rb_prev(&entry->rb_node))) {
-		tmp = rb_entry(rb_node, struct zram_entry, rb_node);
-		if (tmp->checksum != entry->checksum)
-			break;
-
-		entry = tmp;
 	}
 
-again:
-	entry->refcount++;
-	atomic64_add(entry->len, &zram->stats.dup_data_size);
-	spin_unlock(&hash->lock);
-
-	if (prev)
-		zram_entry_free(zram, prev);
+unlock:
+	spin_unlock(lock);
 
-	if (zram_dedup_match(zram, entry, mem))
-		return entry;
-
-	spin_lock(&hash->lock);
-	tmp = NULL;
-	rb_node = rb_next(&entry->rb_node);
-	if (rb_node)
-		tmp = rb_entry(rb_node, struct zram_entry, rb_node);
-
-	if (tmp && (tmp->checksum == entry->checksum)) {
-		prev = entry;
-		entry = tmp;
-		goto again;
-	}
-
-	spin_unlock(&hash->lock);
-	zram_entry_free(zram, entry);
-
-	return NULL;
+	return val;
 }
 
 static struct zram_entry *zram_dedup_get(struct zram *zram,
-				unsigned char *mem, u32 checksum)
+				unsigned char *mem, u64 checksum)
 {
 	struct zram_hash *hash;
 	struct zram_entry *entry;
-	struct rb_node *rb_node;
-
-	hash = &zram->hash[checksum % zram->hash_size];
-
-	spin_lock(&hash->lock);
-	rb_node = hash->rb_root.rb_node;
-	while (rb_node) {
-		entry = rb_entry(rb_node, struct zram_entry, rb_node);
-		if (checksum == entry->checksum)
-			return __zram_dedup_get(zram, hash, mem, entry);
-
-		if (checksum < entry->checksum)
-			rb_node = rb_node->rb_left;
-		else
-			rb_node = rb_node->rb_right;
+	spinlock_t *lock;
+	u32 tag = zram_dedup_tag(checksum);
+	int b, i;
+
+	hash = zram_dedup_bucket(zram, checksum);
+	lock = zram_dedup_lock(zram, checksum);
+
+	spin_lock(lock);
+	for (b = 0; b < 2; b++, hash = zram_dedup_buddy(zram, hash)) {
+		for (i = 0; i < ZRAM_HASH_BUCKET_SLOTS; i++) {
+			entry = hash->entry[i];
+			if (!entry || hash->tag[i] != tag ||
+					entry->checksum != checksum)
+				continue;
+
+			entry->refcount++;
+			atomic64_add(entry->len, &zram->stats.dup_data_size);
+			spin_unlock(lock);
+
+			if (zram_dedup_match(zram, entry, mem)) {
+				atomic64_inc(&zram->stats.dedup_hits);
+				return entry;
+			}
+
+			/*
+			 * A 64-bit fingerprint collision is rare enough that
+			 * we do not bother looking for a second candidate.
+			 */
+			atomic64_inc(&zram->stats.dedup_collisions);
+			zram_entry_free(zram, entry);
+			return NULL;
+		}
 	}
-	spin_unlock(&hash->lock);
+	spin_unlock(lock);
+	atomic64_inc(&zram->stats.dedup_misses);
 
 	return NULL;
 }
 
 struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
-				u32 *checksum)
+				u64 *checksum)
 {
 	void *mem;
 	struct zram_entry *entry;
@@ -223,32 +263,47 @@ bool zram_dedup_put_entry(struct zram *zram, struct zram_entry *entry)
 
 int zram_dedup_init(struct zram *zram, size_t num_pages)
 {
+	unsigned int nr_locks;
+	size_t hash_size;
 	int i;
-	struct zram_hash *hash;
 
 	if (!zram_dedup_enabled(zram))
 		return 0;
 
-	zram->hash_size = num_pages >> ZRAM_HASH_SHIFT;
-	zram->hash_size = min_t(size_t, ZRAM_HASH_SIZE_MAX, zram->hash_size);
-	zram->hash_size = max_t(size_t, ZRAM_HASH_SIZE_MIN, zram->hash_size);
+	hash_size = (num_pages >> ZRAM_HASH_SHIFT) / ZRAM_HASH_BUCKET_SLOTS;
+	hash_size = min_t(size_t, ZRAM_HASH_SIZE_MAX, hash_size);
+	hash_size = max_t(size_t, ZRAM_HASH_SIZE_MIN, hash_size);
+	zram->hash_size = rounddown_pow_of_two(hash_size);
 	zram->hash = vzalloc(zram->hash_size * sizeof(struct zram_hash));
 	if (!zram->hash) {
 		pr_err("Error allocating zram entry hash\n");
 		return -ENOMEM;
 	}
 
-	for (i = 0; i < zram->hash_size; i++) {
-		hash = &zram->hash[i];
-		spin_lock_init(&hash->lock);
-		hash->rb_root = RB_ROOT;
+	nr_locks = roundup_pow_of_two(num_possible_cpus() *
+				      ZRAM_HASH_LOCKS_PER_CPU);
+	nr_locks = min_t(size_t, nr_locks, zram->hash_size);
+	zram->hash_locks = kmalloc_array(nr_locks, sizeof(spinlock_t),
+					 GFP_KERNEL);
+	if (!zram->hash_locks) {
+		pr_err("Error allocating zram entry hash locks\n");
+		vfree(zram->hash);
+		zram->hash = NULL;
+		return -ENOMEM;
 	}
 
+	for (i = 0; i < nr_locks; i++)
+		spin_lock_init(&zram->hash_locks[i]);
+	zram->hash_lock_mask = nr_locks - 1;
+
 	return 0;
 }
 
 void zram_dedup_fini(struct zram *zram)
 {
+	kfree(zram->hash_locks);
+	zram->hash_locks = NULL;
+	zram->hash_lock_mask = 0;
 	vfree(zram->hash);
 	zram->hash = NULL;
 	zram->hash_size = 0;
@@ -8,11 +8,15 @@ struct zram_entry;
 
 u64 zram_dedup_dup_size(struct zram *zram);
 u64 zram_dedup_meta_size(struct zram *zram);
+u64 zram_dedup_hits(struct zram *zram);
+u64 zram_dedup_misses(struct zram *zram);
+u64 zram_dedup_collisions(struct zram *zram);
+u64 zram_dedup_unindexed(struct zram *zram);
 
 void zram_dedup_insert(struct zram *zram, struct zram_entry *new,
-				u32 checksum);
+				u64 checksum);
 struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
-				u32 *checksum);
+				u64 *checksum);
 
 void zram_dedup_init_entry(struct zram *zram, struct zram_entry *entry,
 				unsigned long handle, unsigned int len);
@@ -24,11 +28,15 @@ void zram_dedup_fini(struct zram *zram);
 
 static inline u64 zram_dedup_dup_size(struct zram *zram) { return 0; }
 static inline u64 zram_dedup_meta_size(struct zram *zram) { return 0; }
+static inline u64 zram_dedup_hits(struct zram *zram) { return 0; }
+static inline u64 zram_dedup_misses(struct zram *zram) { return 0; }
+static inline u64 zram_dedup_collisions(struct zram *zram) { return 0; }
+static inline u64 zram_dedup_unindexed(struct zram *zram) { return 0; }
 
 static inline void zram_dedup_insert(struct zram *zram, struct zram_entry *new,
-			u32 checksum) { }
+			u64 checksum) { }
 static inline struct zram_entry *zram_dedup_find(struct zram *zram,
-			struct page *page, u32 *checksum) { return NULL; }
+			struct page *page, u64 *checksum) { return NULL; }
 
 static inline void zram_dedup_init_entry(struct zram *zram,
 			struct zram_entry *entry, unsigned long handle,
@@ -50,6 +50,8 @@ static const char *default_compressor = "lzo-rle";
 static unsigned int num_devices = 1;
 
 static void zram_free_page(struct zram *zram, size_t index);
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io, bool accessed);
 
 static inline bool init_done(struct zram *zram)
 {
@@ -61,6 +63,16 @@ static inline struct zram *dev_to_zram(struct device *dev)
 	return (struct zram *)dev_to_disk(dev)->private_data;
 }
 
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
 static struct zram_entry *zram_get_entry(struct zram *zram, u32 index)
 {
 	return zram->table[index].entry;
@@ -115,6 +127,95 @@ static void zram_set_obj_size(struct zram *zram,
 	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+static void zram_set_priority(struct zram *zram, u32 index, u32 prio)
+{
+	prio &= ZRAM_COMP_PRIORITY_MASK;
+	/*
+	 * Clear previous priority value first, in case if we recompress
+	 * further an already recompressed page
+	 */
+	zram->table[index].value &= ~(ZRAM_COMP_PRIORITY_MASK <<
+				      ZRAM_COMP_PRIORITY_BIT1);
+	zram->table[index].value |= (prio << ZRAM_COMP_PRIORITY_BIT1);
+}
+
+static inline u32 zram_get_priority(struct zram *zram, u32 index)
+{
+	u32 prio = zram->table[index].value >> ZRAM_COMP_PRIORITY_BIT1;
+
+	return prio & ZRAM_COMP_PRIORITY_MASK;
+}
+
+static inline bool zram_allocated(struct zram *zram, u32 index)
+{
+	return zram_get_obj_size(zram, index) ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB);
+}
+
+/* caller should hold the slot lock */
+static void zram_accessed(struct zram *zram, u32 index)
+{
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	zram->table[index].ac_time = ktime_get_boottime();
+#endif
+}
+
+#ifdef CONFIG_ZRAM_MEMCG
+static inline unsigned short zram_get_memcg(struct zram *zram, u32 index)
+{
+	return zram->table[index].memcg_id;
+}
+
+static inline void zram_set_memcg(struct zram *zram, u32 index,
+				  unsigned short memcg_id)
+{
+	zram->table[index].memcg_id = memcg_id;
+}
+
+static inline int zram_memcg_charge(struct page *page, unsigned int size,
+				    unsigned short *memcg_id)
+{
+	return mem_cgroup_zram_charge(page, size, memcg_id);
+}
+
+static inline void zram_memcg_shrink(unsigned short memcg_id,
+				     unsigned int size)
+{
+	if (memcg_id)
+		mem_cgroup_zram_shrink(memcg_id, size);
+}
+
+/* caller should hold the slot lock */
+static void zram_memcg_uncharge(struct zram *zram, u32 index)
+{
+	unsigned short memcg_id = zram_get_memcg(zram, index);
+
+	if (!memcg_id)
+		return;
+
+	zram_set_memcg(zram, index, 0);
+	mem_cgroup_zram_uncharge(memcg_id, zram_get_obj_size(zram, index));
+}
+#else
+static inline unsigned short zram_get_memcg(struct zram *zram, u32 index)
+{
+	return 0;
+}
+static inline void zram_set_memcg(struct zram *zram, u32 index,
+				  unsigned short memcg_id) {}
+static inline int zram_memcg_charge(struct page *page, unsigned int size,
+				    unsigned short *memcg_id)
+{
+	*memcg_id = 0;
+	return 0;
+}
+static inline void zram_memcg_shrink(unsigned short memcg_id,
+				     unsigned int size) {}
+static inline void zram_memcg_uncharge(struct zram *zram, u32 index) {}
+#endif
+
 #if PAGE_SIZE != 4096
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
@@ -427,6 +528,31 @@ static unsigned long get_entry_bdev(struct zram *zram)
 
 	set_bit(entry, zram->bitmap);
 	spin_unlock(&zram->bitmap_lock);
+	atomic64_inc(&zram->stats.bd_count);
+
+	return entry;
+}
+
+/*
+ * Reserve @nr contiguous blocks on the backing device so a writeback
+ * batch can go out as a single bio. Returns the first block or 0.
+ */
+static unsigned long get_entries_bdev(struct zram *zram, unsigned int nr)
+{
+	unsigned long entry;
+
+	spin_lock(&zram->bitmap_lock);
+	/* skip 0 bit to confuse zram.handle = 0 */
+	entry = bitmap_find_next_zero_area(zram->bitmap, zram->nr_pages,
+					   1, nr, 0);
+	if (entry >= zram->nr_pages) {
+		spin_unlock(&zram->bitmap_lock);
+		return 0;
+	}
+
+	bitmap_set(zram->bitmap, entry, nr);
+	spin_unlock(&zram->bitmap_lock);
+	atomic64_add(nr, &zram->stats.bd_count);
 
 	return entry;
 }
@@ -439,6 +565,7 @@ static void put_entry_bdev(struct zram *zram, unsigned long entry)
 	was_set = test_and_clear_bit(entry, zram->bitmap);
 	spin_unlock(&zram->bitmap_lock);
 	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
 }
 
 void zram_page_end_io(struct bio *bio)
@@ -462,6 +589,7 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 	if (!bio)
 		return -ENOMEM;
 
+	atomic64_inc(&zram->stats.bd_reads);
 	bio->bi_iter.bi_sector = entry * (PAGE_SIZE >> 9);
 	bio_set_dev(bio, zram->bdev);
 	if (!bio_add_page(bio, bvec->bv_page, bvec->bv_len, bvec->bv_offset)) {
@@ -575,6 +703,7 @@ static int write_to_bdev(struct zram *zram, struct bio_vec *bvec,
 	}
 
 	submit_bio(bio);
+	atomic64_inc(&zram->stats.bd_writes);
 	*pentry = entry;
 
 	return 0;
@@ -590,6 +719,260 @@ static void zram_wb_clear(struct zram *zram, u32 index)
 	put_entry_bdev(zram, entry);
 }
 
+#define IDLE_WRITEBACK			(1 << 0)
+#define HUGE_WRITEBACK			(1 << 1)
+#define INCOMPRESSIBLE_WRITEBACK	(1 << 2)
+
+/* pages written back per bio */
+#define ZRAM_WB_BATCH	32
+
+struct zram_wb_batch {
+	struct page *pages[ZRAM_WB_BATCH];
+	u32 index[ZRAM_WB_BATCH];
+	unsigned int nr;
+};
+
+static void zram_wb_abort(struct zram *zram, u32 index)
+{
+	zram_slot_lock(zram, index);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_slot_unlock(zram, index);
+}
+
+static struct bio *zram_wb_bio_alloc(struct zram *zram,
+				     unsigned long blk_idx, unsigned int nr)
+{
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_KERNEL, nr);
+	bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+	bio_set_dev(bio, zram->bdev);
+	bio->bi_opf = REQ_OP_WRITE | REQ_SYNC;
+	return bio;
+}
+
+/*
+ * Write @nr pages of the batch starting at @off to contiguous blocks
+ * of the backing device and move the slots over to them. One bio is
+ * used unless the queue limits make bio_add_page() refuse a page, in
+ * which case the bio is submitted and a new one started.
+ */
+static int zram_wb_submit(struct zram *zram, struct zram_wb_batch *wb,
+			  unsigned int off, unsigned int nr,
+			  unsigned long blk_idx)
+{
+	struct bio *bio = NULL;
+	unsigned int i = 0;
+	int ret = 0;
+
+	while (i < nr) {
+		if (!bio)
+			bio = zram_wb_bio_alloc(zram, blk_idx + i, nr - i);
+
+		if (bio_add_page(bio, wb->pages[off + i], PAGE_SIZE, 0)) {
+			i++;
+			continue;
+		}
+
+		/* not even one page fits an empty bio */
+		if (!bio->bi_vcnt) {
+			ret = -EIO;
+			break;
+		}
+
+		ret = submit_bio_wait(bio);
+		bio_put(bio);
+		bio = NULL;
+		if (ret)
+			break;
+	}
+
+	if (bio) {
+		if (!ret)
+			ret = submit_bio_wait(bio);
+		bio_put(bio);
+	}
+
+	for (i = 0; i < nr; i++, blk_idx++) {
+		u32 index = wb->index[off + i];
+
+		if (ret) {
+			put_entry_bdev(zram, blk_idx);
+			zram_wb_abort(zram, index);
+			continue;
+		}
+
+		atomic64_inc(&zram->stats.bd_writes);
+		/*
+		 * We released zram_slot_lock so need to check if the slot
+		 * was changed. If there is freeing for the slot, we can
+		 * catch it easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		zram_slot_lock(zram, index);
+		if (!zram_allocated(zram, index) ||
+				!zram_test_flag(zram, index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			put_entry_bdev(zram, blk_idx);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, blk_idx);
+		zram_slot_unlock(zram, index);
+		atomic64_inc(&zram->stats.pages_stored);
+	}
+
+	return ret;
+}
+
+static int zram_wb_flush(struct zram *zram, struct zram_wb_batch *wb)
+{
+	unsigned int off = 0, nr;
+	unsigned long blk_idx;
+	int ret = 0;
+
+	while (off < wb->nr) {
+		/*
+		 * Prefer one contiguous run for the whole batch, but fall
+		 * back to smaller runs when the backing device is fragmented.
+		 */
+		nr = wb->nr - off;
+		while (nr && !(blk_idx = get_entries_bdev(zram, nr)))
+			nr >>= 1;
+		if (!nr) {
+			ret = -ENOSPC;
+			break;
+		}
+
+		ret = zram_wb_submit(zram, wb, off, nr, blk_idx);
+		off += nr;
+		if (ret)
+			break;
+	}
+
+	while (off < wb->nr && ret)
+		zram_wb_abort(zram, wb->index[off++]);
+
+	wb->nr = 0;
+	return ret;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_wb_batch *wb;
+	unsigned long nr_pages, index;
+	unsigned int i;
+	int mode;
+	ssize_t ret = len;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_WRITEBACK;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_WRITEBACK;
+	else if (sysfs_streq(buf, "incompressible"))
+		mode = INCOMPRESSIBLE_WRITEBACK;
+	else
+		return -EINVAL;
+
+	wb = kzalloc(sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		wb->pages[i] = alloc_page(GFP_KERNEL);
+		if (!wb->pages[i]) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		if (!zram_allocated(zram, index))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+				zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_UNDER_WB))
+			goto next;
+
+		if (mode == IDLE_WRITEBACK &&
+				!zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+		if (mode == HUGE_WRITEBACK &&
+				!zram_test_flag(zram, index, ZRAM_HUGE))
+			goto next;
+		if (mode == INCOMPRESSIBLE_WRITEBACK &&
+				!zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+			goto next;
+
+		/*
+		 * Clearing ZRAM_UNDER_WB is duty of caller.
+		 * IOW, zram_free_page never clear it.
+		 */
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		/* Need for huge page writeback racing */
+		zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+
+		if (__zram_bvec_read(zram, wb->pages[wb->nr], index,
+					NULL, false, false)) {
+			zram_wb_abort(zram, index);
+			continue;
+		}
+
+		wb->index[wb->nr++] = index;
+		if (wb->nr == ZRAM_WB_BATCH) {
+			ret = zram_wb_flush(zram, wb);
+			if (ret)
+				goto out_unlock;
+			ret = len;
+		}
+		cond_resched();
+		continue;
+next:
+		zram_slot_unlock(zram, index);
+	}
+
+	if (wb->nr) {
+		ret = zram_wb_flush(zram, wb);
+		if (!ret)
+			ret = len;
+	}
+out_unlock:
+	up_read(&zram->init_lock);
+out_free:
+	for (i = 0; i < ZRAM_WB_BATCH; i++)
+		if (wb->pages[i])
+			__free_page(wb->pages[i]);
+	kfree(wb);
+
+	return ret;
+}
+
 #else
 static bool zram_wb_enabled(struct zram *zram) { return false; }
 static inline void reset_bdev(struct zram *zram) {};
@@ -609,6 +992,52 @@ static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
 static void zram_wb_clear(struct zram *zram, u32 index) {}
 #endif
 
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+	ktime_t cutoff = 0;
+	u64 age_sec;
+	bool all;
+
+	all = sysfs_streq(buf, "all");
+	if (!all) {
+		/* otherwise mark slots not accessed for age_sec seconds */
+		if (kstrtoull(buf, 10, &age_sec))
+			return -EINVAL;
+		cutoff = ktime_sub(ktime_get_boottime(),
+				   ns_to_ktime(age_sec * NSEC_PER_SEC));
+	}
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		/*
+		 * Do not mark ZRAM_UNDER_WB slot as ZRAM_IDLE to close race.
+		 * See the comment in zram_wb_submit.
+		 */
+		zram_slot_lock(zram, index);
+		if (zram_allocated(zram, index) &&
+				!zram_test_flag(zram, index, ZRAM_WB) &&
+				!zram_test_flag(zram, index, ZRAM_UNDER_WB) &&
+				(all || ktime_before(zram->table[index].ac_time,
+						     cutoff)))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+		cond_resched();
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+#endif
 
 /*
  * We switched to per-cpu streams and this attr is not needed anymore.
@@ -631,24 +1060,21 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
-static ssize_t comp_algorithm_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
+static ssize_t __comp_algorithm_show(struct zram *zram, u32 prio,
+				     char *buf, size_t len)
 {
 	size_t sz;
-	struct zram *zram = dev_to_zram(dev);
 
 	down_read(&zram->init_lock);
-	sz = zcomp_available_show(zram->compressor, buf);
+	sz = zcomp_available_show(zram->comp_algs[prio], buf, len);
 	up_read(&zram->init_lock);
 
 	return sz;
 }
 
-static ssize_t comp_algorithm_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
+static int __comp_algorithm_store(struct zram *zram, u32 prio, const char *buf)
 {
-	struct zram *zram = dev_to_zram(dev);
-	char compressor[ARRAY_SIZE(zram->compressor)];
+	char compressor[ARRAY_SIZE(zram->comp_algs[prio])];
 	size_t sz;
 
 	strlcpy(compressor, buf, sizeof(compressor));
@@ -667,10 +1093,102 @@ static ssize_t comp_algorithm_store(struct device *dev,
 		return -EBUSY;
 	}
 
-	strcpy(zram->compressor, compressor);
+	strcpy(zram->comp_algs[prio], compressor);
 	up_write(&zram->init_lock);
-	return len;
+	return 0;
+}
+
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return __comp_algorithm_show(zram, ZRAM_PRIMARY_COMP, buf, PAGE_SIZE);
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	ret = __comp_algorithm_store(zram, ZRAM_PRIMARY_COMP, buf);
+	return ret ? ret : len;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz = 0;
+	u32 prio;
+
+	for (prio = ZRAM_SECONDARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio][0])
+			continue;
+
+		/* keep room for the "#N: " prefix and the newline */
+		if (sz + 2 >= PAGE_SIZE)
+			break;
+
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2, "#%u: ", prio);
+		sz += __comp_algorithm_show(zram, prio, buf + sz,
+					    PAGE_SIZE - sz);
+	}
+
+	return sz;
+}
+
+/*
+ * Accepts "algo=NAME [priority=N]"; priority defaults to the first
+ * secondary slot.
+ */
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	u32 prio = ZRAM_SECONDARY_COMP;
+	char *tmp, *args, *param, *val;
+	char *alg = NULL;
+	int ret;
+
+	tmp = kstrdup(buf, GFP_KERNEL);
+	if (!tmp)
+		return -ENOMEM;
+
+	args = tmp;
+	ret = -EINVAL;
+	while (*args) {
+		args = next_arg(args, &param, &val);
+
+		if (!val || !*val)
+			goto out;
+
+		if (!strcmp(param, "algo")) {
+			alg = val;
+			continue;
+		}
+
+		if (!strcmp(param, "priority")) {
+			if (kstrtouint(val, 10, &prio))
+				goto out;
+			continue;
+		}
+	}
+
+	if (!alg)
+		goto out;
+
+	if (prio < ZRAM_SECONDARY_COMP || prio >= ZRAM_MAX_COMPS)
+		goto out;
+
+	ret = __comp_algorithm_store(zram, prio, alg);
+out:
+	kfree(tmp);
+	return ret ? ret : len;
 }
+#endif
 
 static ssize_t use_dedup_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
@@ -763,7 +1281,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -772,7 +1290,11 @@ static ssize_t mm_stat_show(struct device *dev,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			atomic_long_read(&pool_stats.pages_compacted),
 			zram_dedup_dup_size(zram),
-			zram_dedup_meta_size(zram));
+			zram_dedup_meta_size(zram),
+			zram_dedup_hits(zram),
+			zram_dedup_misses(zram),
+			zram_dedup_collisions(zram),
+			zram_dedup_unindexed(zram));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -787,16 +1309,41 @@ static ssize_t debug_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-			"version: %d\n%8llu\n",
+			"version: %d\n%8llu %8llu %8llu\n",
 			version,
-			(u64)atomic64_read(&zram->stats.writestall));
+			(u64)atomic64_read(&zram->stats.writestall),
+			(u64)atomic64_read(&zram->stats.num_recompressed),
+			(u64)atomic64_read(&zram->stats.memcg_overflow));
 	up_read(&zram->init_lock);
 
 	return ret;
 }
 
-static DEVICE_ATTR_RO(io_stat);
-static DEVICE_ATTR_RO(mm_stat);
+#ifdef CONFIG_ZRAM_WRITEBACK
+#define FOUR_K(x) ((x) * (1 << (PAGE_SHIFT - 12)))
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+		"%8llu %8llu %8llu\n",
+		FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
+		FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
+		FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
+static DEVICE_ATTR_RO(io_stat);
+static DEVICE_ATTR_RO(mm_stat);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RO(bd_stat);
+#endif
 static DEVICE_ATTR_RO(debug_stat);
 
 static unsigned long zram_entry_handle(struct zram *zram,
@@ -808,16 +1355,6 @@ static unsigned long zram_entry_handle(struct zram *zram,
 		return (unsigned long)entry;
 }
 
-static void zram_slot_lock(struct zram *zram, u32 index)
-{
-	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].value);
-}
-
-static void zram_slot_unlock(struct zram *zram, u32 index)
-{
-	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
-}
-
 static struct zram_entry *zram_entry_alloc(struct zram *zram,
 					   unsigned int len, gfp_t flags)
 {
@@ -906,6 +1443,14 @@ static void zram_free_page(struct zram *zram, size_t index)
 {
 	struct zram_entry *entry;
 
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	zram->table[index].ac_time = 0;
+#endif
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_HUGE);
+	zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+	zram_set_priority(zram, index, 0);
+
 	if (zram_wb_enabled(zram) && zram_test_flag(zram, index, ZRAM_WB)) {
 		zram_wb_clear(zram, index);
 		atomic64_dec(&zram->stats.pages_stored);
@@ -928,6 +1473,7 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (!entry)
 		return;
 
+	zram_memcg_uncharge(zram, index);
 	zram_entry_free(zram, entry);
 
 	atomic64_sub(zram_get_obj_size(zram, index),
@@ -938,32 +1484,18 @@ static void zram_free_page(struct zram *zram, size_t index)
 	zram_set_obj_size(zram, index, 0);
 }
 
-static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
-				struct bio *bio, bool partial_io)
+/*
+ * Caller should hold the slot lock. The slot must not be written back
+ * to the backing device.
+ */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				 u32 index)
 {
 	int ret;
 	struct zram_entry *entry;
 	unsigned int size;
 	void *src, *dst;
 
-	if (zram_wb_enabled(zram)) {
-		zram_slot_lock(zram, index);
-		if (zram_test_flag(zram, index, ZRAM_WB)) {
-			struct bio_vec bvec;
-
-			zram_slot_unlock(zram, index);
-
-			bvec.bv_page = page;
-			bvec.bv_len = PAGE_SIZE;
-			bvec.bv_offset = 0;
-			return read_from_bdev(zram, &bvec,
-					zram_get_element(zram, index),
-					bio, partial_io);
-		}
-		zram_slot_unlock(zram, index);
-	}
-
-	zram_slot_lock(zram, index);
 	entry = zram_get_entry(zram, index);
 	if (!entry || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -973,7 +1505,6 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		mem = kmap_atomic(page);
 		zram_fill_page(mem, PAGE_SIZE, value);
 		kunmap_atomic(mem);
-		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
@@ -987,14 +1518,48 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		kunmap_atomic(dst);
 		ret = 0;
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp *comp;
+		struct zcomp_strm *zstrm;
 
+		comp = zram->comps[zram_get_priority(zram, index)];
+		zstrm = zcomp_stream_get(comp);
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
+
+	return ret;
+}
+
+/*
+ * @accessed marks the slot as accessed under the same slot lock the read
+ * takes; internal readers such as writeback must not clear ZRAM_IDLE.
+ */
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io, bool accessed)
+{
+	int ret;
+
+	zram_slot_lock(zram, index);
+	if (zram_wb_enabled(zram) && zram_test_flag(zram, index, ZRAM_WB)) {
+		struct bio_vec bvec;
+		unsigned long entry = zram_get_element(zram, index);
+
+		if (accessed)
+			zram_accessed(zram, index);
+		zram_slot_unlock(zram, index);
+
+		bvec.bv_page = page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		return read_from_bdev(zram, &bvec, entry, bio, partial_io);
+	}
+
+	ret = zram_read_from_zspool(zram, page, index);
+	if (!ret && accessed)
+		zram_accessed(zram, index);
 	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
@@ -1018,7 +1583,8 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			return -ENOMEM;
 	}
 
-	ret = __zram_bvec_read(zram, page, index, bio, is_partial_io(bvec));
+	ret = __zram_bvec_read(zram, page, index, bio, is_partial_io(bvec),
+			       true);
 	if (unlikely(ret))
 		goto out;
 
@@ -1037,6 +1603,55 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+/*
+ * A page the primary algorithm could not shrink is only incompressible
+ * when no secondary algorithm is configured.  Otherwise recompression
+ * marks it ZRAM_INCOMPRESSIBLE once the secondary algorithms failed too.
+ */
+static bool zram_can_recompress(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	u32 prio;
+
+	for (prio = ZRAM_SECONDARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (zram->comps[prio])
+			return true;
+	}
+#endif
+	return false;
+}
+
+/*
+ * Free memory associated with this sector before overwriting unused
+ * sectors and publish the new object (or same/wb element) in the slot.
+ */
+static void zram_slot_store(struct zram *zram, u32 index,
+			    struct zram_entry *entry, unsigned int comp_len,
+			    enum zram_pageflags flags, unsigned long element,
+			    bool incompressible, unsigned short memcg_id)
+{
+	zram_slot_lock(zram, index);
+	zram_free_page(zram, index);
+
+	if (flags) {
+		zram_set_flag(zram, index, flags);
+		zram_set_element(zram, index, element);
+	}  else {
+		zram_set_entry(zram, index, entry);
+		zram_set_obj_size(zram, index, comp_len);
+		zram_set_memcg(zram, index, memcg_id);
+		if (comp_len == PAGE_SIZE)
+			zram_set_flag(zram, index, ZRAM_HUGE);
+		if (incompressible)
+			zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+	}
+	zram_accessed(zram, index);
+	zram_slot_unlock(zram, index);
+
+	/* Update stats */
+	atomic64_inc(&zram->stats.pages_stored);
+}
+
 static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 				u32 index, struct bio *bio)
 {
@@ -1046,11 +1661,14 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	unsigned int comp_len = 0;
 	void *src, *dst, *mem;
 	struct zcomp_strm *zstrm;
+	struct zcomp *comp = zram->comps[ZRAM_PRIMARY_COMP];
 	struct page *page = bvec->bv_page;
-	u32 checksum;
+	u64 checksum;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
 	bool allow_wb = true;
+	bool incompressible = false;
+	unsigned short memcg_id = 0;
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -1065,17 +1683,21 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	entry = zram_dedup_find(zram, page, &checksum);
 	if (entry) {
 		comp_len = entry->len;
+		if (zram_memcg_charge(page, comp_len, &memcg_id)) {
+			zram_entry_free(zram, entry);
+			goto memcg_overflow;
+		}
 		goto out;
 	}
 
 compress_again:
-	zstrm = zcomp_stream_get(zram->comp);
+	zstrm = zcomp_stream_get(comp);
 	src = kmap_atomic(page);
 	ret = zcomp_compress(zstrm, src, &comp_len);
 	kunmap_atomic(src);
 
 	if (unlikely(ret)) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 		pr_err("Compression failed! err=%d\n", ret);
 		if (entry)
 			zram_entry_free(zram, entry);
@@ -1083,8 +1705,10 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}
 
 	if (unlikely(comp_len > max_zpage_size)) {
+		incompressible = comp_len >= PAGE_SIZE &&
+				 !zram_can_recompress(zram);
 		if (zram_wb_enabled(zram) && allow_wb) {
-			zcomp_stream_put(zram->comp);
+			zcomp_stream_put(comp);
 			ret = write_to_bdev(zram, bvec, index, bio, &element);
 			if (!ret) {
 				flags = ZRAM_WB;
@@ -1092,7 +1716,8 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 				goto out;
 			}
 			allow_wb = false;
-			goto compress_again;
+			/* stored uncompressed, no need to compress it again */
+			zstrm = zcomp_stream_get(comp);
 		}
 		comp_len = PAGE_SIZE;
 	}
@@ -1118,7 +1743,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 				__GFP_MOVABLE |
 				__GFP_CMA);
 	if (!entry) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 		atomic64_inc(&zram->stats.writestall);
 		entry = zram_entry_alloc(zram, comp_len,
 				GFP_NOIO | __GFP_HIGHMEM |
@@ -1132,7 +1757,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	update_used_max(zram, alloced_pages);
 
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 		zram_entry_free(zram, entry);
 		return -ENOMEM;
 	}
@@ -1147,30 +1772,33 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	if (comp_len == PAGE_SIZE)
 		kunmap_atomic(src);
 
-	zcomp_stream_put(zram->comp);
+	zcomp_stream_put(comp);
 	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
+
+	if (zram_memcg_charge(page, comp_len, &memcg_id)) {
+		zram_entry_free(zram, entry);
+		goto memcg_overflow;
+	}
+
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
 	zram_dedup_insert(zram, entry, checksum);
 out:
-	/*
-	 * Free memory associated with this sector
-	 * before overwriting unused sectors.
-	 */
-	zram_slot_lock(zram, index);
-	zram_free_page(zram, index);
+	zram_slot_store(zram, index, entry, comp_len, flags, element,
+			incompressible, memcg_id);
+	return ret;
 
-	if (flags) {
-		zram_set_flag(zram, index, flags);
-		zram_set_element(zram, index, element);
-	}  else {
-		zram_set_entry(zram, index, entry);
-		zram_set_obj_size(zram, index, comp_len);
+memcg_overflow:
+	/* the memcg is over its zram quota: push the page out or reject it */
+	atomic64_inc(&zram->stats.memcg_overflow);
+	if (zram_wb_enabled(zram)) {
+		ret = write_to_bdev(zram, bvec, index, bio, &element);
+		if (!ret) {
+			flags = ZRAM_WB;
+			ret = 1;
+			goto out;
+		}
 	}
-	zram_slot_unlock(zram, index);
-
-	/* Update stats */
-	atomic64_inc(&zram->stats.pages_stored);
-	return ret;
+	return -ENOMEM;
 }
 
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
@@ -1192,7 +1820,7 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 		if (!page)
 			return -ENOMEM;
 
-		ret = __zram_bvec_read(zram, page, index, bio, true);
+		ret = __zram_bvec_read(zram, page, index, bio, true, false);
 		if (ret)
 			goto out;
 
@@ -1214,6 +1842,294 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define RECOMPRESS_IDLE		(1 << 0)
+#define RECOMPRESS_HUGE		(1 << 1)
+
+/*
+ * This function will decompress (unless it's ZRAM_HUGE) the page and then
+ * attempt to compress it using provided compression algorithm priority
+ * (which is potentially more effective).
+ *
+ * Corresponding ZRAM slot should be locked.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page,
+			   u32 threshold, u32 prio, u32 prio_max)
+{
+	struct zcomp_strm *zstrm = NULL;
+	struct zcomp *comp = NULL;
+	struct zram_entry *entry;
+	unsigned int comp_len_old;
+	unsigned int comp_len_new = 0;
+	unsigned short memcg_id;
+	bool idle;
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	ktime_t ac_time;
+#endif
+	void *src, *dst;
+	int ret;
+
+	comp_len_old = zram_get_obj_size(zram, index);
+	/*
+	 * Do not recompress objects that are already "small enough".
+	 */
+	if (comp_len_old < threshold)
+		return 0;
+
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	/*
+	 * Iterate the secondary comp algorithms list (in order of priority)
+	 * and try to recompress the page.
+	 */
+	for (; prio < prio_max; prio++) {
+		if (!zram->comps[prio])
+			continue;
+
+		/*
+		 * Skip if the object is already re-compressed with a higher
+		 * priority algorithm (or same algorithm).
+		 */
+		if (prio <= zram_get_priority(zram, index))
+			continue;
+
+		comp = zram->comps[prio];
+		zstrm = zcomp_stream_get(comp);
+		src = kmap_atomic(page);
+		ret = zcomp_compress(zstrm, src, &comp_len_new);
+		kunmap_atomic(src);
+
+		if (ret) {
+			zcomp_stream_put(comp);
+			return ret;
+		}
+
+		/* Continue until we make progress */
+		if (comp_len_new > max_zpage_size ||
+		    comp_len_new >= comp_len_old ||
+		    (threshold && comp_len_new >= threshold)) {
+			zcomp_stream_put(comp);
+			zstrm = NULL;
+			continue;
+		}
+
+		/* Recompression was successful so break out */
+		break;
+	}
+
+	/*
+	 * We did not try to recompress, e.g. when we have only one
+	 * secondary algorithm and the page is already recompressed
+	 * using that algorithm
+	 */
+	if (!zstrm) {
+		/*
+		 * Secondary algorithms failed to re-compress the page in a
+		 * way that would save memory, mark the object as
+		 * incompressible so that we will not try to compress it
+		 * again.
+		 */
+		if (comp && prio_max == ZRAM_MAX_COMPS)
+			zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	/*
+	 * We are holding the slot lock so we cannot sleep: a failed
+	 * allocation just leaves the old object in place.
+	 */
+	entry = zram_entry_alloc(zram, comp_len_new,
+				 __GFP_KSWAPD_RECLAIM |
+				 __GFP_NOWARN |
+				 __GFP_HIGHMEM |
+				 __GFP_MOVABLE |
+				 __GFP_CMA);
+	if (!entry) {
+		zcomp_stream_put(comp);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(zram->mem_pool,
+			    zram_entry_handle(zram, entry), ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(comp);
+	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
+
+	/* Recompression is not an access, keep the slot's idle state */
+	idle = zram_test_flag(zram, index, ZRAM_IDLE);
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	ac_time = zram->table[index].ac_time;
+#endif
+	/* the memcg charge stays with the slot, only shrunk below */
+	memcg_id = zram_get_memcg(zram, index);
+	zram_set_memcg(zram, index, 0);
+	zram_free_page(zram, index);
+	zram_set_entry(zram, index, entry);
+	zram_set_obj_size(zram, index, comp_len_new);
+	zram_set_priority(zram, index, prio);
+	zram_set_memcg(zram, index, memcg_id);
+	zram_memcg_shrink(memcg_id, comp_len_old - comp_len_new);
+	if (idle)
+		zram_set_flag(zram, index, ZRAM_IDLE);
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	zram->table[index].ac_time = ac_time;
+#endif
+
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.num_recompressed);
+
+	return 0;
+}
+
+/*
+ * Accepts "type=idle|huge|huge_idle [threshold=N] [algo=NAME]". Without
+ * algo= every configured secondary algorithm is tried in priority order.
+ */
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	u32 prio = ZRAM_SECONDARY_COMP, prio_max = ZRAM_MAX_COMPS;
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+	char *tmp, *args, *param, *val, *algo = NULL;
+	u32 mode = 0, threshold = 0;
+	struct page *page;
+	ssize_t ret;
+
+	tmp = kstrdup(buf, GFP_KERNEL);
+	if (!tmp)
+		return -ENOMEM;
+
+	args = tmp;
+	ret = -EINVAL;
+	while (*args) {
+		args = next_arg(args, &param, &val);
+
+		if (!val || !*val)
+			goto out_free_args;
+
+		if (!strcmp(param, "type")) {
+			if (!strcmp(val, "idle"))
+				mode = RECOMPRESS_IDLE;
+			else if (!strcmp(val, "huge"))
+				mode = RECOMPRESS_HUGE;
+			else if (!strcmp(val, "huge_idle"))
+				mode = RECOMPRESS_IDLE | RECOMPRESS_HUGE;
+			else
+				goto out_free_args;
+			continue;
+		}
+
+		if (!strcmp(param, "threshold")) {
+			/*
+			 * We will re-compress only idle objects equal or
+			 * greater in size than watermark.
+			 */
+			if (kstrtouint(val, 10, &threshold) ||
+			    threshold >= PAGE_SIZE)
+				goto out_free_args;
+			continue;
+		}
+
+		if (!strcmp(param, "algo")) {
+			algo = val;
+			continue;
+		}
+	}
+
+	if (!mode)
+		goto out_free_args;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	/*
+	 * Dedup entries are shared between slots and matched with the
+	 * primary algorithm, so they cannot be re-encoded per slot.
+	 */
+	if (zram_dedup_enabled(zram)) {
+		ret = -EOPNOTSUPP;
+		goto out_unlock;
+	}
+
+	if (algo) {
+		bool found = false;
+
+		for (; prio < ZRAM_MAX_COMPS; prio++) {
+			if (!zram->comp_algs[prio][0])
+				continue;
+
+			if (!strcmp(zram->comp_algs[prio], algo)) {
+				prio_max = prio + 1;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found) {
+			ret = -EINVAL;
+			goto out_unlock;
+		}
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	ret = len;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+
+		if (!zram_allocated(zram, index))
+			goto next;
+
+		if (mode & RECOMPRESS_IDLE &&
+		    !zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+
+		if (mode & RECOMPRESS_HUGE &&
+		    !zram_test_flag(zram, index, ZRAM_HUGE))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+		    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+		    zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+			goto next;
+
+		err = zram_recompress(zram, index, page, threshold,
+				      prio, prio_max);
+next:
+		zram_slot_unlock(zram, index);
+		if (err) {
+			ret = err;
+			break;
+		}
+
+		cond_resched();
+	}
+
+	__free_page(page);
+
+out_unlock:
+	up_read(&zram->init_lock);
+out_free_args:
+	kfree(tmp);
+	return ret;
+}
+#endif
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -1289,6 +2205,61 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+static bool zram_can_batch_write(struct bio *bio, int offset)
+{
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+
+	if (bio_op(bio) != REQ_OP_WRITE || offset)
+		return false;
+
+	if (bio->bi_iter.bi_size <= PAGE_SIZE)
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_len != PAGE_SIZE || bvec.bv_offset)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Write a multi-page bio of full pages, such as a THP swap-out or a
+ * filesystem writeback bio, accounting the I/O once for the whole bio.
+ * Single page swap-out goes through zram_rw_page() and never gets here.
+ */
+static void zram_bio_write_batch(struct zram *zram, struct bio *bio, u32 index)
+{
+	unsigned long start_time = jiffies;
+	struct request_queue *q = zram->disk->queue;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	int ret = 0;
+
+	generic_start_io_acct(q, REQ_OP_WRITE, bio_sectors(bio),
+			&zram->disk->part0);
+
+	bio_for_each_segment(bvec, bio, iter) {
+		atomic64_inc(&zram->stats.num_writes);
+
+		ret = __zram_bvec_write(zram, &bvec, index, bio);
+		if (unlikely(ret < 0)) {
+			atomic64_inc(&zram->stats.failed_writes);
+			break;
+		}
+
+		index++;
+	}
+
+	generic_end_io_acct(q, REQ_OP_WRITE, &zram->disk->part0, start_time);
+
+	if (unlikely(ret < 0))
+		bio_io_error(bio);
+	else
+		bio_endio(bio);
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
@@ -1310,6 +2281,11 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		break;
 	}
 
+	if (zram_can_batch_write(bio, offset)) {
+		zram_bio_write_batch(zram, bio, index);
+		return;
+	}
+
 	bio_for_each_segment(bvec, bio, iter) {
 		struct bio_vec bv = bvec;
 		unsigned int unwritten = bvec.bv_len;
@@ -1420,9 +2396,22 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	return ret;
 }
 
+static void zram_destroy_comps(struct zram *zram)
+{
+	u32 prio;
+
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		struct zcomp *comp = zram->comps[prio];
+
+		zram->comps[prio] = NULL;
+		if (!comp)
+			continue;
+		zcomp_destroy(comp);
+	}
+}
+
 static void zram_reset_device(struct zram *zram)
 {
-	struct zcomp *comp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1434,7 +2423,6 @@ static void zram_reset_device(struct zram *zram)
 		return;
 	}
 
-	comp = zram->comp;
 	disksize = zram->disksize;
 	zram->disksize = 0;
 
@@ -1445,7 +2433,7 @@ static void zram_reset_device(struct zram *zram)
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
-	zcomp_destroy(comp);
+	zram_destroy_comps(zram);
 	reset_bdev(zram);
 }
 
@@ -1456,6 +2444,7 @@ static ssize_t disksize_store(struct device *dev,
 	struct zcomp *comp;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
+	u32 prio;
 
 	disksize = memparse(buf, NULL);
 	if (!disksize)
@@ -1474,15 +2463,21 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_unlock;
 	}
 
-	comp = zcomp_create(zram->compressor);
-	if (IS_ERR(comp)) {
-		pr_err("Cannot initialise %s compressing backend\n",
-				zram->compressor);
-		err = PTR_ERR(comp);
-		goto out_free_meta;
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio][0])
+			continue;
+
+		comp = zcomp_create(zram->comp_algs[prio]);
+		if (IS_ERR(comp)) {
+			pr_err("Cannot initialise %s compressing backend\n",
+					zram->comp_algs[prio]);
+			err = PTR_ERR(comp);
+			goto out_free_comps;
+		}
+
+		zram->comps[prio] = comp;
 	}
 
-	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
@@ -1491,7 +2486,8 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
-out_free_meta:
+out_free_comps:
+	zram_destroy_comps(zram);
 	zram_meta_free(zram, disksize);
 out_unlock:
 	up_write(&zram->init_lock);
@@ -1575,6 +2571,14 @@ static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+#endif
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+static DEVICE_ATTR_WO(idle);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
 #endif
 #ifdef CONFIG_ZRAM_DEDUP
 static DEVICE_ATTR_RW(use_dedup);
@@ -1593,10 +2597,21 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_comp_algorithm.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+#endif
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	&dev_attr_idle.attr,
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
 #endif
 	&dev_attr_use_dedup.attr,
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_bd_stat.attr,
+#endif
 	&dev_attr_debug_stat.attr,
 	NULL,
 };
@@ -1693,7 +2708,8 @@ static int zram_add(void)
 	disk_to_dev(zram->disk)->groups = zram_disk_attr_groups;
 	add_disk(zram->disk);
 
-	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
+	strlcpy(zram->comp_algs[ZRAM_PRIMARY_COMP], default_compressor,
+		sizeof(zram->comp_algs[ZRAM_PRIMARY_COMP]));
 
 	pr_info("Added device: %s\n", zram->disk->disk_name);
 	return device_id;
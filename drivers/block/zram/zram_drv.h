@@ -19,6 +19,8 @@
 #include <linux/zsmalloc.h>
 #include <linux/crypto.h>
 #include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/memcontrol.h>
 
 #include "zcomp.h"
 #include "zram_dedup.h"
@@ -57,7 +59,10 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
  * The lower ZRAM_FLAG_SHIFT bits is for object size (excluding header),
  * the higher bits is for zram_pageflags.
  */
-#define ZRAM_FLAG_SHIFT 24
+#define ZRAM_FLAG_SHIFT (PAGE_SHIFT + 1)
+
+/* Only 2 bits are allowed for comp priority index */
+#define ZRAM_COMP_PRIORITY_MASK	0x3
 
 /* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
@@ -65,16 +70,31 @@ enum zram_pageflags {
 	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
 	ZRAM_WB,	/* page is stored on backing_device */
+	ZRAM_UNDER_WB,	/* page is under writeback */
+	ZRAM_HUGE,	/* page is stored uncompressed */
+	ZRAM_INCOMPRESSIBLE,	/* compressor could not shrink the page */
+	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_COMP_PRIORITY_BIT1, /* First bit of comp priority index */
+	ZRAM_COMP_PRIORITY_BIT2, /* Second bit of comp priority index */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define ZRAM_PRIMARY_COMP	0U
+#define ZRAM_SECONDARY_COMP	1U
+#define ZRAM_MAX_COMPS	4U
+#else
+#define ZRAM_PRIMARY_COMP	0U
+#define ZRAM_SECONDARY_COMP	0U
+#define ZRAM_MAX_COMPS	1U
+#endif
+
 /*-- Data structures */
 
 struct zram_entry {
-	struct rb_node rb_node;
+	u64 checksum;
 	u32 len;
-	u32 checksum;
 	unsigned long refcount;
 	unsigned long handle;
 };
@@ -86,6 +106,12 @@ struct zram_table_entry {
 		unsigned long element;
 	};
 	unsigned long value;
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	ktime_t ac_time;	/* last access time, for idle marking */
+#endif
+#ifdef CONFIG_ZRAM_MEMCG
+	unsigned short memcg_id;	/* memcg charged for this slot */
+#endif
 };
 
 struct zram_stats {
@@ -100,25 +126,41 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+	atomic64_t num_recompressed;	/* no. of recompressed pages */
+	atomic64_t memcg_overflow;	/* no. of pages over memcg quota */
 	atomic64_t dup_data_size;	/*
 					 * compressed size of pages
 					 * duplicated
 					 */
 	atomic64_t meta_data_size;	/* size of zram_entries */
+	atomic64_t dedup_hits;		/* no. of pages deduplicated */
+	atomic64_t dedup_misses;	/* no. of lookups without candidate */
+	atomic64_t dedup_collisions;	/* no. of fingerprint collisions */
+	atomic64_t dedup_unindexed;	/* no. of entries left out of hash */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes from backing device */
+#endif
 };
 
+#define ZRAM_HASH_BUCKET_SLOTS	8
+
 struct zram_hash {
-	spinlock_t lock;
-	struct rb_root rb_root;
+	u32 tag[ZRAM_HASH_BUCKET_SLOTS];
+	struct zram_entry *entry[ZRAM_HASH_BUCKET_SLOTS];
 };
 
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
-	struct zcomp *comp;
+	struct zcomp *comps[ZRAM_MAX_COMPS];
 	struct gendisk *disk;
 	struct zram_hash *hash;
 	size_t hash_size;
+	/* bucket locks, striped by CPU count */
+	spinlock_t *hash_locks;
+	unsigned int hash_lock_mask;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
 	/*
@@ -132,7 +174,8 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	char compressor[CRYPTO_MAX_ALG_NAME];
+	/* empty name means the priority slot is not configured */
+	char comp_algs[ZRAM_MAX_COMPS][CRYPTO_MAX_ALG_NAME];
 	/*
 	 * zram is claimed so open request will be failed
 	 */
@@ -95,6 +95,12 @@ module_param_named(lpm_prediction, lpm_prediction, bool, 0664);
 static uint32_t bias_hyst;
 module_param_named(bias_hyst, bias_hyst, uint, 0664);
 
+static bool lpm_teo;
+module_param_named(lpm_teo, lpm_teo, bool, 0664);
+
+#define TEO_PULSE 1024
+#define TEO_DECAY_SHIFT 3
+
 struct lpm_history {
 	uint32_t resi[MAXSAMPLES];
 	int mode[MAXSAMPLES];
@@ -107,6 +113,27 @@ struct lpm_history {
 
 static DEFINE_PER_CPU(struct lpm_history, hist);
 
+/*
+ * Timer events oriented wakeup statistics. There is one bin per cpu level,
+ * covering [min_residency, max_residency] of that level. A wakeup that
+ * happens around the timer known at selection time is a hit for the bin of
+ * that sleep length, any earlier wakeup is an intercept for the bin of the
+ * measured idle duration.
+ */
+struct lpm_teo_bin {
+	uint32_t hits;
+	uint32_t intercepts;
+};
+
+struct lpm_teo {
+	struct lpm_teo_bin bins[NR_LPM_LEVELS];
+	uint32_t sleep_us;
+	uint32_t htmr_wkup;
+	int64_t stime;
+};
+
+static DEFINE_PER_CPU(struct lpm_teo, teo_data);
+
 static DEFINE_PER_CPU(struct lpm_cpu*, cpu_lpm);
 static bool suspend_in_progress;
 static struct hrtimer lpm_hrtimer;
@@ -358,6 +385,7 @@ static enum hrtimer_restart histtimer_fn(struct hrtimer *h)
 	struct lpm_history *history = &per_cpu(hist, cpu);
 
 	history->hinvalid = 1;
+	per_cpu(teo_data, cpu).htmr_wkup = 1;
 	return HRTIMER_NORESTART;
 }
 
@@ -644,6 +672,101 @@ static inline bool is_cpu_biased(int cpu, uint64_t *bias_time)
 	return false;
 }
 
+static int teo_bin_idx(struct lpm_cpu *cpu, uint32_t duration_us)
+{
+	int i;
+
+	for (i = cpu->nlevels - 1; i > 0; i--) {
+		if (duration_us >= cpu->levels[i].pwr.min_residency)
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * Starting from the level picked by the timer sleep length, move to a
+ * shallower level if the wakeups that were intercepted before the timer in
+ * the bins below it outweigh the rest. The level returned is the one whose
+ * bin holds the median of those intercepts.
+ */
+static int teo_select(struct cpuidle_device *dev, struct lpm_cpu *cpu,
+		int idx)
+{
+	struct lpm_teo *teo = &per_cpu(teo_data, dev->cpu);
+	uint32_t total = 0, hit_sum = 0, intercept_sum = 0, sum = 0;
+	int i, best = idx;
+
+	for (i = 0; i < cpu->nlevels; i++) {
+		struct lpm_teo_bin *bin = &teo->bins[i];
+
+		total += bin->hits + bin->intercepts;
+		if (i < idx) {
+			hit_sum += bin->hits;
+			intercept_sum += bin->intercepts;
+		}
+	}
+
+	if (2 * intercept_sum <= total - hit_sum)
+		return idx;
+
+	for (i = idx - 1; i >= 0; i--) {
+		if (i && !lpm_cpu_mode_allow(dev->cpu, i, true))
+			continue;
+
+		best = i;
+		sum += teo->bins[i].intercepts;
+		if (2 * sum > intercept_sum)
+			break;
+	}
+
+	return best;
+}
+
+static void teo_update(struct cpuidle_device *dev, struct lpm_cpu *cpu,
+		int idx)
+{
+	struct lpm_teo *teo = &per_cpu(teo_data, dev->cpu);
+	uint32_t measured_us = dev->last_residency;
+	uint32_t sleep_us = teo->sleep_us;
+	uint32_t lat_us = cpu->levels[idx].pwr.exit_latency;
+	int i, hit = 0;
+
+	teo->stime = 0;
+	if (!sleep_us)
+		return;
+
+	teo->sleep_us = 0;
+
+	/*
+	 * The history timer only fires when a shallower level was picked
+	 * on intercepts, the cpu would otherwise have slept until the timer.
+	 */
+	if (teo->htmr_wkup) {
+		teo->htmr_wkup = 0;
+		measured_us = sleep_us;
+	}
+
+	for (i = 0; i < cpu->nlevels; i++) {
+		struct lpm_teo_bin *bin = &teo->bins[i];
+
+		bin->hits -= bin->hits >> TEO_DECAY_SHIFT;
+		bin->intercepts -= bin->intercepts >> TEO_DECAY_SHIFT;
+	}
+
+	if (measured_us + lat_us >= sleep_us) {
+		i = teo_bin_idx(cpu, sleep_us);
+		teo->bins[i].hits += TEO_PULSE;
+		hit = 1;
+	} else {
+		measured_us = measured_us > lat_us ? measured_us - lat_us : 0;
+		i = teo_bin_idx(cpu, measured_us);
+		teo->bins[i].intercepts += TEO_PULSE;
+	}
+
+	trace_cpu_pred_teo(i, measured_us, sleep_us, hit);
+}
+
 static int cpu_power_select(struct cpuidle_device *dev,
 		struct lpm_cpu *cpu)
 {
@@ -670,6 +793,14 @@ static int cpu_power_select(struct cpuidle_device *dev,
 
 	next_event_us = (uint32_t)(ktime_to_us(get_next_event_time(dev->cpu)));
 
+	if (lpm_teo) {
+		struct lpm_teo *teo = &per_cpu(teo_data, dev->cpu);
+
+		teo->sleep_us = (next_event_us && next_event_us < sleep_us) ?
+					next_event_us : sleep_us;
+		teo->stime = 0;
+	}
+
 	if (is_cpu_biased(dev->cpu, &bias_time) && (!cpu_isolated(dev->cpu))) {
 		cpu->bias = bias_time;
 		goto done_select;
@@ -700,7 +831,7 @@ static int cpu_power_select(struct cpuidle_device *dev,
 				next_wakeup_us = next_event_us - lvl_latency_us;
 		}
 
-		if (!i && !cpu_isolated(dev->cpu)) {
+		if (!i && !cpu_isolated(dev->cpu) && !lpm_teo) {
 			/*
 			 * If the next_wake_us itself is not sufficient for
 			 * deeper low power modes than clock gating do not
@@ -733,6 +864,22 @@ static int cpu_power_select(struct cpuidle_device *dev,
 	if (modified_time_us)
 		msm_pm_set_timer(modified_time_us);
 
+	if (lpm_teo && !cpu_isolated(dev->cpu)) {
+		int idx = teo_select(dev, cpu, best_level);
+
+		if (idx < best_level) {
+			max_residency = cpu->levels[idx].pwr.max_residency;
+			per_cpu(teo_data, dev->cpu).stime =
+				ktime_to_us(ktime_get()) + max_residency;
+			best_level = idx;
+
+			htime = max_residency + cpu->tmr_add;
+			if ((next_wakeup_us > htime) &&
+				((next_wakeup_us - htime) > max_residency))
+				histtimer_start(htime);
+		}
+	}
+
 	/*
 	 * Start timer to avoid staying in shallower mode forever
 	 * incase of misprediciton
@@ -792,6 +939,7 @@ static uint64_t get_cluster_sleep_time(struct lpm_cluster *cluster,
 	ktime_t next_event;
 	struct cpumask online_cpus_in_cluster;
 	struct lpm_history *history;
+	struct lpm_teo *teo;
 	int64_t prediction = LONG_MAX;
 
 	if (!from_idle)
@@ -808,14 +956,18 @@ static uint64_t get_cluster_sleep_time(struct lpm_cluster *cluster,
 		if (*next_event_c < next_event)
 			next_event = *next_event_c;
 
-		if (from_idle && lpm_prediction && cluster->lpm_prediction) {
+		if (lpm_teo) {
+			teo = &per_cpu(teo_data, cpu);
+			if (teo->stime && (teo->stime < prediction))
+				prediction = teo->stime;
+		} else if (lpm_prediction && cluster->lpm_prediction) {
 			history = &per_cpu(hist, cpu);
 			if (history->stime && (history->stime < prediction))
 				prediction = history->stime;
 		}
 	}
 
-	if (from_idle && lpm_prediction && cluster->lpm_prediction) {
+	if (lpm_teo || (lpm_prediction && cluster->lpm_prediction)) {
 		if (prediction > ktime_to_us(ktime_get()))
 			*pred_time = prediction - ktime_to_us(ktime_get());
 	}
@@ -1003,10 +1155,15 @@ static int cluster_select(struct lpm_cluster *cluster, bool from_idle,
 	if (from_idle) {
 		pred_mode = cluster_predict(cluster, &pred_us);
 
-		if (cpupred_us && pred_mode && (cpupred_us < pred_us))
+		/*
+		 * With lpm_teo the cpus report when their intercepts are
+		 * expected, which is enough to predict without cluster history.
+		 */
+		if (cpupred_us && (pred_mode || lpm_teo) &&
+				(!pred_us || (cpupred_us < pred_us)))
 			pred_us = cpupred_us;
 
-		if (pred_us && pred_mode && (pred_us < sleep_us))
+		if (pred_us && (pred_mode || lpm_teo) && (pred_us < sleep_us))
 			predicted = 1;
 
 		if (predicted && (pred_us == cpupred_us))
@@ -1433,6 +1590,9 @@ static void update_history(struct cpuidle_device *dev, int idx)
 	uint32_t tmr = 0;
 	struct lpm_cpu *lpm_cpu = per_cpu(cpu_lpm, dev->cpu);
 
+	if (lpm_teo)
+		teo_update(dev, lpm_cpu, idx);
+
 	if (!lpm_prediction || !lpm_cpu->lpm_prediction)
 		return;
 
@@ -1490,7 +1650,7 @@ static int lpm_cpuidle_enter(struct cpuidle_device *dev,
 	dev->last_residency = ktime_us_delta(ktime_get(), start);
 	update_history(dev, idx);
 	trace_cpu_idle_exit(idx, success);
-	if (lpm_prediction && cpu->lpm_prediction) {
+	if (lpm_teo || (lpm_prediction && cpu->lpm_prediction)) {
 		histtimer_cancel();
 		clusttimer_cancel();
 	}
@@ -13,6 +13,9 @@
 
 #define DM_MSG_PREFIX "bow"
 
+/* Number of blocks read ahead at once when copying a range */
+#define COPY_BATCH_BLOCKS 64
+
 struct log_entry {
 	u64 source;
 	u64 dest;
@@ -92,6 +95,16 @@ struct bow_context {
 	struct log_sector *log_sector;
 	struct list_head trimmed_list;
 	bool forward_trims;
+	struct bow_range *last_range; /* Last lookup hit, under ranges_lock */
+};
+
+static struct kmem_cache *bow_range_cache;
+
+/* Per-bio data for writes deferred to the workqueue */
+struct write_work {
+	struct work_struct work;
+	struct bow_context *bc;
+	struct bio *bio;
 };
 
 sector_t range_top(struct bow_range *br)
@@ -110,32 +123,66 @@ static sector_t bvec_top(struct bvec_iter *bi_iter)
 	return bi_iter->bi_sector + bi_iter->bi_size / SECTOR_SIZE;
 }
 
+static struct bow_range *alloc_range(struct bow_context *bc)
+{
+	return kmem_cache_zalloc(bow_range_cache, GFP_NOIO);
+}
+
+/* br must already be erased from bc->ranges */
+static void free_range(struct bow_context *bc, struct bow_range *br)
+{
+	if (bc->last_range == br)
+		bc->last_range = NULL;
+	kmem_cache_free(bow_range_cache, br);
+}
+
+/* br must not be the TOP range */
+static bool range_contains(struct bow_range *br, sector_t sector)
+{
+	return br->sector <= sector && sector < range_top(br);
+}
+
 /*
  * Find the first range that overlaps with bi_iter
  * bi_iter is set to the size of the overlapping sub-range
  */
-static struct bow_range *find_first_overlapping_range(struct rb_root *ranges,
+static struct bow_range *find_first_overlapping_range(struct bow_context *bc,
 						      struct bvec_iter *bi_iter)
 {
-	struct rb_node *node = ranges->rb_node;
-	struct bow_range *br;
+	struct rb_node *node;
+	struct bow_range *br = bc->last_range;
 
-	while (node) {
-		br = container_of(node, struct bow_range, node);
+	/*
+	 * A bio is walked range by range and writes are mostly sequential, so
+	 * try the last hit and the range after it before searching the tree
+	 */
+	if (br && !range_contains(br, bi_iter->bi_sector)) {
+		br = container_of(rb_next(&br->node), struct bow_range, node);
+		if (br->type == TOP || !range_contains(br, bi_iter->bi_sector))
+			br = NULL;
+	}
 
-		if (br->sector <= bi_iter->bi_sector
-		    && bi_iter->bi_sector < range_top(br))
-			break;
+	if (!br) {
+		node = bc->ranges.rb_node;
+		while (node) {
+			br = container_of(node, struct bow_range, node);
 
-		if (bi_iter->bi_sector < br->sector)
-			node = node->rb_left;
-		else
-			node = node->rb_right;
-	}
+			if (br->sector <= bi_iter->bi_sector
+			    && bi_iter->bi_sector < range_top(br))
+				break;
 
-	WARN_ON(!node);
-	if (!node)
-		return NULL;
+			if (bi_iter->bi_sector < br->sector)
+				node = node->rb_left;
+			else
+				node = node->rb_right;
+		}
+
+		WARN_ON(!node);
+		if (!node)
+			return NULL;
+
+		bc->last_range = br;
+	}
 
 	if (range_top(br) - bi_iter->bi_sector
 	    < bi_iter->bi_size >> SECTOR_SHIFT)
@@ -179,8 +226,7 @@ static int split_range(struct bow_context *bc, struct bow_range **br,
 	}
 
 	if (bi_iter->bi_sector > (*br)->sector) {
-		struct bow_range *leading_br =
-			kzalloc(sizeof(*leading_br), GFP_KERNEL);
+		struct bow_range *leading_br = alloc_range(bc);
 
 		if (!leading_br)
 			return BLK_STS_RESOURCE;
@@ -200,7 +246,7 @@ static int split_range(struct bow_context *bc, struct bow_range **br,
 	}
 
 	/* new_br will be the beginning, existing br will be the tail */
-	new_br = kzalloc(sizeof(*new_br), GFP_KERNEL);
+	new_br = alloc_range(bc);
 	if (!new_br)
 		return BLK_STS_RESOURCE;
 
@@ -240,14 +286,14 @@ static void set_type(struct bow_context *bc, struct bow_range **br, int type)
 		if (type == TRIMMED)
 			list_del(&next->trimmed_list);
 		rb_erase(&next->node, &bc->ranges);
-		kfree(next);
+		free_range(bc, next);
 	}
 
 	if (prev->type == type) {
 		if (type == TRIMMED)
 			list_del(&(*br)->trimmed_list);
 		rb_erase(&(*br)->node, &bc->ranges);
-		kfree(*br);
+		free_range(bc, *br);
 	}
 
 	*br = NULL;
@@ -275,7 +321,7 @@ static int copy_data(struct bow_context const *bc,
 		     struct bow_range *source, struct bow_range *dest,
 		     u32 *checksum)
 {
-	int i;
+	u64 i, blocks;
 
 	if (range_size(source) != range_size(dest)) {
 		WARN_ON(1);
@@ -285,11 +331,18 @@ static int copy_data(struct bow_context const *bc,
 	if (checksum)
 		*checksum = sector_to_page(bc, source->sector);
 
-	for (i = 0; i < range_size(source) >> bc->block_shift; ++i) {
+	blocks = range_size(source) >> bc->block_shift;
+	for (i = 0; i < blocks; ++i) {
 		struct dm_buffer *read_buffer, *write_buffer;
 		u8 *read, *write;
 		sector_t page = sector_to_page(bc, source->sector) + i;
 
+		/* Issue the reads for a batch of blocks rather than one by one */
+		if (!(i % COPY_BATCH_BLOCKS))
+			dm_bufio_prefetch(bc->bufio, page,
+					  min_t(u64, blocks - i,
+						COPY_BATCH_BLOCKS));
+
 		read = dm_bufio_read(bc->bufio, page, &read_buffer);
 		if (IS_ERR(read)) {
 			DMERR("Cannot read page %llu",
@@ -497,7 +550,7 @@ static struct bow_range *find_sector0_current(struct bow_context *bc)
 
 	bi_iter.bi_sector = bc->log_sector->sector0;
 	bi_iter.bi_size = bc->block_size;
-	return find_first_overlapping_range(&bc->ranges, &bi_iter);
+	return find_first_overlapping_range(bc, &bi_iter);
 }
 
 /****** sysfs interface functions ******/
@@ -604,7 +657,7 @@ static void dm_bow_dtr(struct dm_target *ti)
 						    struct bow_range, node);
 
 		rb_erase(&br->node, &bc->ranges);
-		kfree(br);
+		free_range(bc, br);
 	}
 	if (bc->workqueue)
 		destroy_workqueue(bc->workqueue);
@@ -642,6 +695,7 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	ti->num_flush_bios = 1;
 	ti->num_discard_bios = 1;
 	ti->num_write_same_bios = 1;
+	ti->per_io_data_size = sizeof(struct write_work);
 	ti->private = bc;
 
 	ret = dm_get_device(ti, argv[0], dm_table_get_mode(ti->table),
@@ -665,6 +719,7 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	bc->log_sector = kzalloc(bc->block_size, GFP_KERNEL);
 	if (!bc->log_sector) {
 		ti->error = "Cannot allocate log sector";
+		ret = -ENOMEM;
 		goto bad;
 	}
 
@@ -699,7 +754,7 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 
 	INIT_LIST_HEAD(&bc->trimmed_list);
 
-	br = kzalloc(sizeof(*br), GFP_KERNEL);
+	br = alloc_range(bc);
 	if (!br) {
 		ti->error = "Cannot allocate ranges";
 		ret = -ENOMEM;
@@ -711,7 +766,7 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	rb_link_node(&br->node, NULL, &bc->ranges.rb_node);
 	rb_insert_color(&br->node, &bc->ranges);
 
-	br = kzalloc(sizeof(*br), GFP_KERNEL);
+	br = alloc_range(bc);
 	if (!br) {
 		ti->error = "Cannot allocate ranges";
 		ret = -ENOMEM;
@@ -838,8 +893,7 @@ static int prepare_changed_range(struct bow_context *bc, struct bow_range *br,
 static int prepare_one_range(struct bow_context *bc,
 			     struct bvec_iter *bi_iter)
 {
-	struct bow_range *br = find_first_overlapping_range(&bc->ranges,
-							    bi_iter);
+	struct bow_range *br = find_first_overlapping_range(bc, bi_iter);
 	switch (br->type) {
 	case CHANGED:
 		return prepare_changed_range(bc, br, bi_iter);
@@ -866,12 +920,6 @@ static int prepare_one_range(struct bow_context *bc,
 	}
 }
 
-struct write_work {
-	struct work_struct work;
-	struct bow_context *bc;
-	struct bio *bio;
-};
-
 static void bow_write(struct work_struct *work)
 {
 	struct write_work *ww = container_of(work, struct write_work, work);
@@ -880,8 +928,6 @@ static void bow_write(struct work_struct *work)
 	struct bvec_iter bi_iter = bio->bi_iter;
 	int ret = BLK_STS_OK;
 
-	kfree(ww);
-
 	mutex_lock(&bc->ranges_lock);
 	do {
 		ret = prepare_one_range(bc, &bi_iter);
@@ -905,12 +951,7 @@ static void bow_write(struct work_struct *work)
 
 static int queue_write(struct bow_context *bc, struct bio *bio)
 {
-	struct write_work *ww = kmalloc(sizeof(*ww), GFP_NOIO | __GFP_NORETRY
-					| __GFP_NOMEMALLOC | __GFP_NOWARN);
-	if (!ww) {
-		DMERR("Failed to allocate write_work");
-		return -ENOMEM;
-	}
+	struct write_work *ww = dm_per_bio_data(bio, sizeof(*ww));
 
 	INIT_WORK(&ww->work, bow_write);
 	ww->bc = bc;
@@ -959,7 +1000,7 @@ static int add_trim(struct bow_context *bc, struct bio *bio)
 		bio->bi_iter.bi_size);
 
 	do {
-		br = find_first_overlapping_range(&bc->ranges, &bi_iter);
+		br = find_first_overlapping_range(bc, &bi_iter);
 
 		switch (br->type) {
 		case UNCHANGED:
@@ -998,7 +1039,7 @@ static int remove_trim(struct bow_context *bc, struct bio *bio)
 		bio->bi_iter.bi_size);
 
 	do {
-		br = find_first_overlapping_range(&bc->ranges, &bi_iter);
+		br = find_first_overlapping_range(bc, &bi_iter);
 
 		switch (br->type) {
 		case UNCHANGED:
@@ -1214,16 +1255,24 @@ static struct target_type bow_target = {
 
 int __init dm_bow_init(void)
 {
-	int r = dm_register_target(&bow_target);
+	int r;
 
-	if (r < 0)
+	bow_range_cache = KMEM_CACHE(bow_range, 0);
+	if (!bow_range_cache)
+		return -ENOMEM;
+
+	r = dm_register_target(&bow_target);
+	if (r < 0) {
 		DMERR("registering bow failed %d", r);
+		kmem_cache_destroy(bow_range_cache);
+	}
 	return r;
 }
 
 void dm_bow_exit(void)
 {
 	dm_unregister_target(&bow_target);
+	kmem_cache_destroy(bow_range_cache);
 }
 
 MODULE_LICENSE("GPL");
@@ -12,6 +12,10 @@
  * hash device. Setting this greatly improves performance when data and hash
  * are on the same disk on different partitions on devices with poor random
  * access behavior.
+ *
+ * With the "try_verify_in_tasklet" option, reads no larger than
+ * "/sys/module/dm_verity/parameters/tasklet_max_bytes" are verified in
+ * softirq context when their hashes are cached, instead of in kverityd.
  */
 
 #include "dm-verity.h"
@@ -19,6 +23,8 @@
 
 #include <linux/module.h>
 #include <linux/reboot.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
 
 #define DM_MSG_PREFIX			"verity"
 
@@ -26,6 +32,10 @@
 #define DM_VERITY_ENV_VAR_NAME		"DM_VERITY_ERR_BLOCK_NR"
 
 #define DM_VERITY_DEFAULT_PREFETCH_SIZE	262144
+#define DM_VERITY_DEFAULT_TASKLET_BYTES	8192
+
+#define DM_VERITY_BENCH_DEFAULT_BLOCKS	256
+#define DM_VERITY_BENCH_MAX_BLOCKS	16384
 
 #define DM_VERITY_MAX_CORRUPTED_ERRS	100
 
@@ -33,13 +43,18 @@
 #define DM_VERITY_OPT_RESTART		"restart_on_corruption"
 #define DM_VERITY_OPT_IGN_ZEROES	"ignore_zero_blocks"
 #define DM_VERITY_OPT_AT_MOST_ONCE	"check_at_most_once"
+#define DM_VERITY_OPT_TASKLET_VERIFY	"try_verify_in_tasklet"
 
-#define DM_VERITY_OPTS_MAX		(2 + DM_VERITY_OPTS_FEC)
+#define DM_VERITY_OPTS_MAX		(4 + DM_VERITY_OPTS_FEC)
 
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
 module_param_named(prefetch_cluster, dm_verity_prefetch_cluster, uint, S_IRUGO | S_IWUSR);
 
+static unsigned dm_verity_tasklet_bytes = DM_VERITY_DEFAULT_TASKLET_BYTES;
+
+module_param_named(tasklet_max_bytes, dm_verity_tasklet_bytes, uint, S_IRUGO | S_IWUSR);
+
 struct dm_verity_prefetch_work {
 	struct work_struct work;
 	struct dm_verity *v;
@@ -247,6 +262,53 @@ static void verity_hash_at_level(struct dm_verity *v, sector_t block, int level,
 		*offset = idx << (v->hash_dev_block_bits - v->hash_per_block_bits);
 }
 
+static inline u8 *verity_hash_cache_slot(struct dm_verity *v, unsigned slot)
+{
+	return v->hash_cache_data + ((size_t)slot << v->hash_dev_block_bits);
+}
+
+/*
+ * Remember a verified level-0 hash block for verity_verify_io_atomic().
+ */
+static void verity_hash_cache_store(struct dm_verity *v, sector_t hash_block,
+				    const u8 *data)
+{
+	unsigned slot = hash_block & (DM_VERITY_HASH_CACHE_SLOTS - 1);
+
+	if (READ_ONCE(v->hash_cache_block[slot]) == hash_block)
+		return;
+
+	spin_lock_bh(&v->hash_cache_lock);
+	memcpy(verity_hash_cache_slot(v, slot), data,
+	       1 << v->hash_dev_block_bits);
+	v->hash_cache_block[slot] = hash_block;
+	spin_unlock_bh(&v->hash_cache_lock);
+}
+
+/*
+ * Copy the wanted digest of a data block to "digest" if its level-0 hash
+ * block is cached. Called in softirq context.
+ */
+static bool verity_hash_cache_lookup(struct dm_verity *v, sector_t block,
+				     u8 *digest)
+{
+	sector_t hash_block;
+	unsigned offset, slot;
+	bool hit;
+
+	verity_hash_at_level(v, block, 0, &hash_block, &offset);
+	slot = hash_block & (DM_VERITY_HASH_CACHE_SLOTS - 1);
+
+	spin_lock(&v->hash_cache_lock);
+	hit = v->hash_cache_block[slot] == hash_block;
+	if (hit)
+		memcpy(digest, verity_hash_cache_slot(v, slot) + offset,
+		       v->digest_size);
+	spin_unlock(&v->hash_cache_lock);
+
+	return hit;
+}
+
 /*
  * Handle verification errors.
  */
@@ -332,6 +394,14 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 
 	aux = dm_bufio_get_aux_data(buf);
 
+	/*
+	 * The buffer may have been evicted and read again since the block
+	 * was verified; with check_at_most_once, don't hash it again.
+	 */
+	if (!aux->hash_verified && v->validated_hash_blocks &&
+	    test_bit(hash_block - v->hash_start, v->validated_hash_blocks))
+		aux->hash_verified = 1;
+
 	if (!aux->hash_verified) {
 		if (skip_unverified) {
 			r = 1;
@@ -345,9 +415,12 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 			goto release_ret_r;
 
 		if (likely(memcmp(verity_io_real_digest(v, io), want_digest,
-				  v->digest_size) == 0))
+				  v->digest_size) == 0)) {
 			aux->hash_verified = 1;
-		else if (verity_fec_decode(v, io,
+			if (v->validated_hash_blocks)
+				set_bit(hash_block - v->hash_start,
+					v->validated_hash_blocks);
+		} else if (verity_fec_decode(v, io,
 					   DM_VERITY_BLOCK_TYPE_METADATA,
 					   hash_block, data, NULL) == 0)
 			aux->hash_verified = 1;
@@ -359,6 +432,9 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 		}
 	}
 
+	if (!level && v->hash_cache_data && aux->hash_verified)
+		verity_hash_cache_store(v, hash_block, data);
+
 	data += offset;
 	memcpy(want_digest, data, v->digest_size);
 	r = 0;
@@ -506,6 +582,92 @@ static inline void verity_bv_skip_block(struct dm_verity *v,
 	bio_advance_iter(bio, iter, 1 << v->data_dev_block_bits);
 }
 
+/*
+ * Data blocks of one io waiting to be hashed together.
+ */
+struct verity_mb_pending {
+	unsigned n;
+	sector_t blocks[DM_VERITY_MAX_MB_BLOCKS];
+	struct bvec_iter starts[DM_VERITY_MAX_MB_BLOCKS];
+};
+
+/*
+ * Hash v->mb_msgs (or fewer) data blocks with one crypto_shash_finup_mb()
+ * call. The blocks must be virtually contiguous.
+ */
+static int verity_hash_mb(struct dm_verity *v, const u8 * const data[],
+			  u8 * const digests[], unsigned n)
+{
+	SHASH_DESC_ON_STACK(desc, v->shash_tfm);
+	int r;
+
+	desc->tfm = v->shash_tfm;
+	desc->flags = 0;
+
+	r = crypto_shash_init(desc);
+	if (likely(!r) && v->salt_size)
+		r = crypto_shash_update(desc, v->salt, v->salt_size);
+	if (likely(!r))
+		r = crypto_shash_finup_mb(desc, data,
+					  1 << v->data_dev_block_bits,
+					  digests, n);
+	if (unlikely(r < 0))
+		DMERR("verity_hash_mb: crypto op failed: %d", r);
+
+	return r;
+}
+
+static int verity_verify_pending(struct dm_verity_io *io,
+				 struct verity_mb_pending *pending)
+{
+	struct dm_verity *v = io->v;
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	const u8 *data[DM_VERITY_MAX_MB_BLOCKS];
+	u8 *digests[DM_VERITY_MAX_MB_BLOCKS];
+	u8 *pages[DM_VERITY_MAX_MB_BLOCKS];
+	unsigned i, n = pending->n;
+	int r;
+
+	if (!n)
+		return 0;
+	pending->n = 0;
+
+	for (i = 0; i < n; i++) {
+		struct bio_vec bv = bio_iter_iovec(bio, pending->starts[i]);
+
+		pages[i] = kmap_atomic(bv.bv_page);
+		data[i] = pages[i] + bv.bv_offset;
+		digests[i] = verity_io_mb_real_digest(v, io, i);
+	}
+	r = verity_hash_mb(v, data, digests, n);
+	for (i = n; i-- > 0; )
+		kunmap_atomic(pages[i]);
+	if (unlikely(r < 0))
+		return r;
+
+	for (i = 0; i < n; i++) {
+		sector_t cur_block = pending->blocks[i];
+
+		if (likely(memcmp(digests[i], verity_io_mb_want_digest(v, io, i),
+				  v->digest_size) == 0)) {
+			if (v->validated_blocks)
+				set_bit(cur_block, v->validated_blocks);
+			continue;
+		}
+
+		/* FEC compares against the single want digest */
+		memcpy(verity_io_want_digest(v, io),
+		       verity_io_mb_want_digest(v, io, i), v->digest_size);
+		if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+				      cur_block, NULL, &pending->starts[i]) == 0)
+			continue;
+		if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA, cur_block))
+			return -EIO;
+	}
+
+	return 0;
+}
+
 /*
  * Verify one "dm_verity_io" structure.
  */
@@ -513,14 +675,17 @@ static int verity_verify_io(struct dm_verity_io *io)
 {
 	bool is_zero;
 	struct dm_verity *v = io->v;
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
 	struct bvec_iter start;
 	unsigned b;
 	struct verity_result res;
+	struct verity_mb_pending pending = { .n = 0 };
 
 	for (b = 0; b < io->n_blocks; b++) {
 		int r;
 		sector_t cur_block = io->block + b;
 		struct ahash_request *req = verity_io_hash_req(v, io);
+		bool batch;
 
 		if (v->validated_blocks &&
 		    likely(test_bit(cur_block, v->validated_blocks))) {
@@ -528,6 +693,11 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
+		/* only blocks within one page can be hashed in a batch */
+		batch = v->mb_msgs > 1 &&
+			bio_iter_iovec(bio, io->iter).bv_len >=
+			1 << v->data_dev_block_bits;
+
 		r = verity_hash_for_block(v, io, cur_block,
 					  verity_io_want_digest(v, io),
 					  &is_zero);
@@ -547,6 +717,20 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
+		if (batch) {
+			memcpy(verity_io_mb_want_digest(v, io, pending.n),
+			       verity_io_want_digest(v, io), v->digest_size);
+			pending.blocks[pending.n] = cur_block;
+			pending.starts[pending.n] = io->iter;
+			verity_bv_skip_block(v, io, &io->iter);
+			if (++pending.n < v->mb_msgs)
+				continue;
+			r = verity_verify_pending(io, &pending);
+			if (unlikely(r < 0))
+				return r;
+			continue;
+		}
+
 		r = verity_hash_init(v, req, &res);
 		if (unlikely(r < 0))
 			return r;
@@ -575,6 +759,77 @@ static int verity_verify_io(struct dm_verity_io *io)
 			return -EIO;
 	}
 
+	return verity_verify_pending(io, &pending);
+}
+
+/*
+ * Verify one "dm_verity_io" structure in softirq context, using the
+ * synchronous hash and the level-0 hash blocks cached by
+ * verity_hash_cache_store(). Anything else (a cache miss, a zero block,
+ * a mismatch that needs FEC or error handling) returns -EAGAIN and the
+ * whole io is verified again by verity_work().
+ */
+static int verity_verify_io_atomic(struct dm_verity_io *io)
+{
+	struct dm_verity *v = io->v;
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	struct bvec_iter iter = io->iter;
+	u8 *want_digest = verity_io_want_digest(v, io);
+	u8 *real_digest = verity_io_real_digest(v, io);
+	SHASH_DESC_ON_STACK(desc, v->shash_tfm);
+	unsigned b;
+
+	desc->tfm = v->shash_tfm;
+	desc->flags = 0;
+
+	for (b = 0; b < io->n_blocks; b++) {
+		sector_t cur_block = io->block + b;
+		unsigned todo = 1 << v->data_dev_block_bits;
+		int r;
+
+		if (v->validated_blocks &&
+		    likely(test_bit(cur_block, v->validated_blocks))) {
+			bio_advance_iter(bio, &iter, todo);
+			continue;
+		}
+
+		if (!v->levels ||
+		    !verity_hash_cache_lookup(v, cur_block, want_digest))
+			return -EAGAIN;
+
+		if (v->zero_digest &&
+		    !memcmp(v->zero_digest, want_digest, v->digest_size))
+			return -EAGAIN;
+
+		r = crypto_shash_init(desc);
+		if (likely(!r) && v->salt_size && v->version >= 1)
+			r = crypto_shash_update(desc, v->salt, v->salt_size);
+
+		while (likely(!r) && todo) {
+			struct bio_vec bv = bio_iter_iovec(bio, iter);
+			unsigned len = min(bv.bv_len, todo);
+			u8 *page = kmap_atomic(bv.bv_page);
+
+			r = crypto_shash_update(desc, page + bv.bv_offset, len);
+			kunmap_atomic(page);
+
+			bio_advance_iter(bio, &iter, len);
+			todo -= len;
+		}
+
+		if (likely(!r) && v->salt_size && !v->version)
+			r = crypto_shash_update(desc, v->salt, v->salt_size);
+		if (likely(!r))
+			r = crypto_shash_final(desc, real_digest);
+
+		if (unlikely(r) ||
+		    memcmp(real_digest, want_digest, v->digest_size))
+			return -EAGAIN;
+
+		if (v->validated_blocks)
+			set_bit(cur_block, v->validated_blocks);
+	}
+
 	return 0;
 }
 
@@ -610,20 +865,44 @@ static void verity_work(struct work_struct *w)
 	verity_finish_io(io, errno_to_blk_status(verity_verify_io(io)));
 }
 
+static void verity_tasklet(unsigned long data)
+{
+	struct dm_verity_io *io = (struct dm_verity_io *)data;
+	int r;
+
+	r = verity_verify_io_atomic(io);
+	if (r == -EAGAIN) {
+		INIT_WORK(&io->work, verity_work);
+		queue_work(io->v->verify_wq, &io->work);
+		return;
+	}
+
+	verity_finish_io(io, errno_to_blk_status(r));
+}
+
 static void verity_end_io(struct bio *bio)
 {
 	struct dm_verity_io *io = bio->bi_private;
+	struct dm_verity *v = io->v;
 
 	if (bio->bi_status &&
-	    (!verity_fec_is_enabled(io->v) ||
+	    (!verity_fec_is_enabled(v) ||
 	     verity_is_system_shutting_down() ||
 	     (bio->bi_opf & REQ_RAHEAD))) {
 		verity_finish_io(io, bio->bi_status);
 		return;
 	}
 
+	if (v->use_tasklet && !bio->bi_status &&
+	    ((size_t)io->n_blocks << v->data_dev_block_bits) <=
+	    READ_ONCE(dm_verity_tasklet_bytes)) {
+		tasklet_init(&io->tasklet, verity_tasklet, (unsigned long)io);
+		tasklet_schedule(&io->tasklet);
+		return;
+	}
+
 	INIT_WORK(&io->work, verity_work);
-	queue_work(io->v->verify_wq, &io->work);
+	queue_work(v->verify_wq, &io->work);
 }
 
 /*
@@ -731,7 +1010,9 @@ int verity_map(struct dm_target *ti, struct bio *bio)
 EXPORT_SYMBOL_GPL(verity_map);
 
 /*
- * Status: V (valid) or C (corruption found)
+ * Status: V (valid) or C (corruption found), followed by the hash
+ * throughput in MB/s, one block at a time and batched, once a "benchmark"
+ * message has been sent.
  */
 void verity_status(struct dm_target *ti, status_type_t type,
 			  unsigned status_flags, char *result, unsigned maxlen)
@@ -744,6 +1025,8 @@ void verity_status(struct dm_target *ti, status_type_t type,
 	switch (type) {
 	case STATUSTYPE_INFO:
 		DMEMIT("%c", v->hash_failed ? 'C' : 'V');
+		if (v->bench_mbps)
+			DMEMIT(" %u %u", v->bench_mbps, v->bench_mb_mbps);
 		break;
 	case STATUSTYPE_TABLE:
 		DMEMIT("%u %s %s %u %u %llu %llu %s ",
@@ -772,6 +1055,8 @@ void verity_status(struct dm_target *ti, status_type_t type,
 			args++;
 		if (v->validated_blocks)
 			args++;
+		if (v->use_tasklet)
+			args++;
 		if (!args)
 			return;
 		DMEMIT(" %u", args);
@@ -792,12 +1077,102 @@ void verity_status(struct dm_target *ti, status_type_t type,
 			DMEMIT(" " DM_VERITY_OPT_IGN_ZEROES);
 		if (v->validated_blocks)
 			DMEMIT(" " DM_VERITY_OPT_AT_MOST_ONCE);
+		if (v->use_tasklet)
+			DMEMIT(" " DM_VERITY_OPT_TASKLET_VERIFY);
 		sz = verity_fec_status_table(v, sz, result, maxlen);
 		break;
 	}
 }
 EXPORT_SYMBOL_GPL(verity_status);
 
+static unsigned verity_bench_mbps(u64 bytes, u64 ns)
+{
+	return div64_u64(bytes * NSEC_PER_SEC, max_t(u64, ns, 1)) >> 20;
+}
+
+/*
+ * Hash random data blocks one at a time as verity_verify_io() does without
+ * batching, then in batches if the algorithm supports them, and remember
+ * the throughput of both.
+ */
+static int verity_benchmark(struct dm_verity *v, unsigned nr_blocks)
+{
+	size_t block_size = 1 << v->data_dev_block_bits;
+	struct ahash_request *req;
+	u8 *data, *digests;
+	unsigned b, i;
+	u64 start;
+	int r = -ENOMEM;
+
+	data = vmalloc(nr_blocks * block_size);
+	digests = kmalloc(v->digest_size * DM_VERITY_MAX_MB_BLOCKS, GFP_KERNEL);
+	req = kmalloc(v->ahash_reqsize, GFP_KERNEL);
+	if (!data || !digests || !req)
+		goto out;
+	get_random_bytes(data, nr_blocks * block_size);
+
+	start = ktime_get_ns();
+	for (b = 0; b < nr_blocks; b++) {
+		r = verity_hash(v, req, data + b * block_size, block_size,
+				digests);
+		if (unlikely(r < 0))
+			goto out;
+	}
+	v->bench_mbps = verity_bench_mbps(nr_blocks * block_size,
+					  ktime_get_ns() - start);
+
+	v->bench_mb_mbps = 0;
+	if (v->mb_msgs > 1) {
+		const u8 *mb_data[DM_VERITY_MAX_MB_BLOCKS];
+		u8 *mb_digests[DM_VERITY_MAX_MB_BLOCKS];
+
+		start = ktime_get_ns();
+		for (b = 0; b < nr_blocks; b += i) {
+			for (i = 0; i < v->mb_msgs && b + i < nr_blocks; i++) {
+				mb_data[i] = data + (b + i) * block_size;
+				mb_digests[i] = digests + i * v->digest_size;
+			}
+			r = verity_hash_mb(v, mb_data, mb_digests, i);
+			if (unlikely(r < 0))
+				goto out;
+		}
+		v->bench_mb_mbps = verity_bench_mbps(nr_blocks * block_size,
+						     ktime_get_ns() - start);
+	}
+	r = 0;
+out:
+	kfree(req);
+	kfree(digests);
+	vfree(data);
+	return r;
+}
+
+/*
+ * Messages:
+ *	benchmark [<number of blocks>]
+ */
+int verity_message(struct dm_target *ti, unsigned argc, char **argv)
+{
+	struct dm_verity *v = ti->private;
+	unsigned nr_blocks = DM_VERITY_BENCH_DEFAULT_BLOCKS;
+	char dummy;
+
+	if (argc < 1 || argc > 2 || strcasecmp(argv[0], "benchmark"))
+		goto invalid;
+
+	if (argc == 2 &&
+	    (sscanf(argv[1], "%u%c", &nr_blocks, &dummy) != 1 ||
+	     !nr_blocks || nr_blocks > DM_VERITY_BENCH_MAX_BLOCKS))
+		goto invalid;
+
+	return verity_benchmark(v, nr_blocks);
+
+invalid:
+	DMWARN("Unrecognised message received.");
+	return -EINVAL;
+}
+EXPORT_SYMBOL_GPL(verity_message);
+
 int verity_prepare_ioctl(struct dm_target *ti,
 		struct block_device **bdev, fmode_t *mode)
 {
@@ -846,6 +1221,8 @@ void verity_dtr(struct dm_target *ti)
 		dm_bufio_client_destroy(v->bufio);
 
 	kvfree(v->validated_blocks);
+	kvfree(v->validated_hash_blocks);
+	kvfree(v->hash_cache_data);
 	kfree(v->salt);
 	kfree(v->root_digest);
 	kfree(v->zero_digest);
@@ -853,6 +1230,9 @@ void verity_dtr(struct dm_target *ti)
 	if (v->tfm)
 		crypto_free_ahash(v->tfm);
 
+	if (v->shash_tfm)
+		crypto_free_shash(v->shash_tfm);
+
 	kfree(v->alg_name);
 
 	if (v->hash_dev)
@@ -887,6 +1267,90 @@ static int verity_alloc_most_once(struct dm_verity *v)
 	return 0;
 }
 
+/*
+ * Like the data block bitset, but for hash blocks, so that a hash block
+ * evicted from dm-bufio is not hashed again when it is read back.
+ */
+static int verity_alloc_hash_most_once(struct dm_verity *v)
+{
+	struct dm_target *ti = v->ti;
+	sector_t nr_hash_blocks = v->hash_blocks - v->hash_start;
+
+	if (nr_hash_blocks > INT_MAX) {
+		ti->error = "hash device too large to use check_at_most_once";
+		return -E2BIG;
+	}
+
+	v->validated_hash_blocks = kvzalloc(BITS_TO_LONGS(nr_hash_blocks) *
+					    sizeof(unsigned long), GFP_KERNEL);
+	if (!v->validated_hash_blocks) {
+		ti->error = "failed to allocate hash bitset for check_at_most_once";
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int verity_alloc_tasklet_verify(struct dm_verity *v)
+{
+	struct dm_target *ti = v->ti;
+	unsigned i;
+	int r;
+
+	if (!v->shash_tfm) {
+		v->shash_tfm = crypto_alloc_shash(v->alg_name, 0, 0);
+		if (IS_ERR(v->shash_tfm)) {
+			ti->error = "Cannot initialize synchronous hash function";
+			r = PTR_ERR(v->shash_tfm);
+			v->shash_tfm = NULL;
+			return r;
+		}
+	}
+
+	v->hash_cache_data = kvmalloc(DM_VERITY_HASH_CACHE_SLOTS <<
+				     v->hash_dev_block_bits, GFP_KERNEL);
+	if (!v->hash_cache_data) {
+		ti->error = "Cannot allocate hash block cache";
+		return -ENOMEM;
+	}
+
+	spin_lock_init(&v->hash_cache_lock);
+	for (i = 0; i < DM_VERITY_HASH_CACHE_SLOTS; i++)
+		v->hash_cache_block[i] = (sector_t)-1;
+
+	return 0;
+}
+
+/*
+ * Hash data blocks in batches if the synchronous version of the algorithm
+ * is the implementation already in use and interleaves several messages.
+ * Only format 1 is supported: with format 0 the salt comes after the data,
+ * so the blocks don't share a prefix.
+ */
+static void verity_init_mb_hash(struct dm_verity *v)
+{
+	struct crypto_shash *tfm;
+
+	v->mb_msgs = 1;
+	if (!v->version)
+		return;
+
+	tfm = crypto_alloc_shash(v->alg_name, 0, 0);
+	if (IS_ERR(tfm))
+		return;
+
+	if (crypto_shash_mb_max_msgs(tfm) < 2 ||
+	    strcmp(crypto_tfm_alg_driver_name(crypto_shash_tfm(tfm)),
+		   crypto_tfm_alg_driver_name(crypto_ahash_tfm(v->tfm)))) {
+		crypto_free_shash(tfm);
+		return;
+	}
+
+	v->shash_tfm = tfm;
+	v->mb_msgs = min_t(unsigned, crypto_shash_mb_max_msgs(tfm),
+			   DM_VERITY_MAX_MB_BLOCKS);
+}
+
 static int verity_alloc_zero_digest(struct dm_verity *v)
 {
 	int r = -ENOMEM;
@@ -962,6 +1426,10 @@ static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v)
 				return r;
 			continue;
 
+		} else if (!strcasecmp(arg_name, DM_VERITY_OPT_TASKLET_VERIFY)) {
+			v->use_tasklet = true;
+			continue;
+
 		} else if (verity_is_fec_opt_arg(arg_name)) {
 			r = verity_fec_parse_opt_args(as, v, &argc, arg_name);
 			if (r)
@@ -1112,6 +1580,8 @@ int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	v->ahash_reqsize = sizeof(struct ahash_request) +
 		crypto_ahash_reqsize(v->tfm);
 
+	verity_init_mb_hash(v);
+
 	v->root_digest = kmalloc(v->digest_size, GFP_KERNEL);
 	if (!v->root_digest) {
 		ti->error = "Cannot allocate root digest";
@@ -1193,6 +1663,18 @@ int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	}
 	v->hash_blocks = hash_position;
 
+	if (v->validated_blocks) {
+		r = verity_alloc_hash_most_once(v);
+		if (r)
+			goto bad;
+	}
+
+	if (v->use_tasklet) {
+		r = verity_alloc_tasklet_verify(v);
+		if (r)
+			goto bad;
+	}
+
 	v->bufio = dm_bufio_client_create(v->hash_dev->bdev,
 		1 << v->hash_dev_block_bits, 1, sizeof(struct buffer_aux),
 		dm_bufio_alloc_callback, NULL);
@@ -1219,6 +1701,8 @@ int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 
 	ti->per_io_data_size = sizeof(struct dm_verity_io) +
 				v->ahash_reqsize + v->digest_size * 2;
+	if (v->mb_msgs > 1)
+		ti->per_io_data_size += v->digest_size * 2 * v->mb_msgs;
 
 	r = verity_fec_ctr(v);
 	if (r)
@@ -1239,12 +1723,13 @@ EXPORT_SYMBOL_GPL(verity_ctr);
 static struct target_type verity_target = {
 	.name		= "verity",
 	.features	= DM_TARGET_IMMUTABLE,
-	.version	= {1, 4, 0},
+	.version	= {1, 6, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
 	.map		= verity_map,
 	.status		= verity_status,
+	.message	= verity_message,
 	.prepare_ioctl	= verity_prepare_ioctl,
 	.iterate_devices = verity_iterate_devices,
 	.io_hints	= verity_io_hints,
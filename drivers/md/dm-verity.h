@@ -14,10 +14,17 @@
 
 #include "dm-bufio.h"
 #include <linux/device-mapper.h>
+#include <linux/interrupt.h>
 #include <crypto/hash.h>
 
 #define DM_VERITY_MAX_LEVELS		63
 
+/* the number of level-0 hash blocks kept for verification in softirq */
+#define DM_VERITY_HASH_CACHE_SLOTS	16
+
+/* the maximum number of data blocks hashed by one crypto_shash_finup_mb() */
+#define DM_VERITY_MAX_MB_BLOCKS		2
+
 enum verity_mode {
 	DM_VERITY_MODE_EIO,
 	DM_VERITY_MODE_LOGGING,
@@ -64,6 +71,19 @@ struct dm_verity {
 
 	struct dm_verity_fec *fec;	/* forward error correction */
 	unsigned long *validated_blocks; /* bitset blocks validated */
+	unsigned long *validated_hash_blocks; /* bitset hash blocks validated */
+
+	/* verification in softirq, see verity_verify_io_atomic() */
+	bool use_tasklet;
+	struct crypto_shash *shash_tfm;	/* also used for batched hashing */
+	unsigned mb_msgs;	/* data blocks hashed per batch, 1 if none */
+	spinlock_t hash_cache_lock;
+	sector_t hash_cache_block[DM_VERITY_HASH_CACHE_SLOTS];
+	u8 *hash_cache_data;	/* DM_VERITY_HASH_CACHE_SLOTS hash blocks */
+
+	/* results of the last "benchmark" message, in MB/s */
+	unsigned bench_mbps;
+	unsigned bench_mb_mbps;
 };
 
 struct dm_verity_io {
@@ -78,6 +98,7 @@ struct dm_verity_io {
 	struct bvec_iter iter;
 
 	struct work_struct work;
+	struct tasklet_struct tasklet;
 
 	/*
 	 * Three variably-size fields follow this struct:
@@ -88,6 +109,14 @@ struct dm_verity_io {
 	 *
 	 * To access them use: verity_io_hash_req(), verity_io_real_digest()
 	 * and verity_io_want_digest().
+	 *
+	 * If data blocks are hashed in batches (v->mb_msgs > 1), these follow:
+	 *
+	 * u8 mb_real_digests[v->mb_msgs][v->digest_size];
+	 * u8 mb_want_digests[v->mb_msgs][v->digest_size];
+	 *
+	 * To access them use: verity_io_mb_real_digest() and
+	 * verity_io_mb_want_digest().
 	 */
 };
 
@@ -114,6 +143,19 @@ static inline u8 *verity_io_want_digest(struct dm_verity *v,
 	return (u8 *)(io + 1) + v->ahash_reqsize + v->digest_size;
 }
 
+static inline u8 *verity_io_mb_real_digest(struct dm_verity *v,
+					   struct dm_verity_io *io, unsigned i)
+{
+	return verity_io_want_digest(v, io) + v->digest_size * (1 + i);
+}
+
+static inline u8 *verity_io_mb_want_digest(struct dm_verity *v,
+					   struct dm_verity_io *io, unsigned i)
+{
+	return verity_io_want_digest(v, io) +
+		v->digest_size * (1 + v->mb_msgs + i);
+}
+
 extern int verity_for_bv_block(struct dm_verity *v, struct dm_verity_io *io,
 			       struct bvec_iter *iter,
 			       int (*process)(struct dm_verity *v,
@@ -136,5 +178,6 @@ extern void verity_io_hints(struct dm_target *ti, struct queue_limits *limits);
 extern void verity_dtr(struct dm_target *ti);
 extern int verity_ctr(struct dm_target *ti, unsigned argc, char **argv);
 extern int verity_map(struct dm_target *ti, struct bio *bio);
+extern int verity_message(struct dm_target *ti, unsigned argc, char **argv);
 extern void dm_verity_avb_error_handler(void);
 #endif /* DM_VERITY_H */
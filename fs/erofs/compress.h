@@ -80,7 +80,33 @@ static inline bool z_erofs_put_shortlivedpage(struct list_head *pagepool,
 	return true;
 }
 
+/*
+ * Only lz4 (with enough inplace margin) can decode in place.  Streaming
+ * decoders (zstd) may write decompressed data over compressed pages
+ * which haven't been consumed yet, so keep their compressed pages apart.
+ */
+static inline bool z_erofs_inplace_io_allowed(unsigned int alg)
+{
+	return alg == Z_EROFS_COMPRESSION_LZ4 ||
+		alg == Z_EROFS_COMPRESSION_SHIFTED;
+}
+
 int z_erofs_decompress(struct z_erofs_decompress_req *rq,
 		       struct list_head *pagepool);
 
+/* decompressor.c, helpers for streaming decompressors */
+int z_erofs_stream_prepare_destpages(struct z_erofs_decompress_req *rq,
+				     struct list_head *pagepool);
+int z_erofs_fixup_insize(struct z_erofs_decompress_req *rq, const u8 *inpage);
+
+/* decompressor_zstd.c */
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+int z_erofs_zstd_decompress(struct z_erofs_decompress_req *rq, u8 *dst);
+void z_erofs_zstd_init(void);
+void z_erofs_zstd_exit(void);
+#else
+static inline void z_erofs_zstd_init(void) {}
+static inline void z_erofs_zstd_exit(void) {}
+#endif
+
 #endif
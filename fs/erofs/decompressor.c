@@ -123,6 +123,55 @@ static int z_erofs_lz4_prepare_destpages(struct z_erofs_decompress_req *rq,
 	return kaddr ? 1 : 0;
 }
 
+/* fill the holes of destpages for streaming decompressors with bounce pages */
+int z_erofs_stream_prepare_destpages(struct z_erofs_decompress_req *rq,
+				     struct list_head *pagepool)
+{
+	const unsigned int nr =
+		PAGE_ALIGN(rq->pageofs_out + rq->outputsize) >> PAGE_SHIFT;
+	void *kaddr = NULL;
+	unsigned int i;
+
+	for (i = 0; i < nr; ++i) {
+		struct page *page = rq->out[i];
+
+		if (!page) {
+			page = erofs_allocpage(pagepool,
+					       GFP_KERNEL | __GFP_NOFAIL);
+			set_page_private(page, Z_EROFS_SHORTLIVED_PAGE);
+			rq->out[i] = page;
+		}
+
+		if (!PageHighMem(page)) {
+			if (!i) {
+				kaddr = page_address(page);
+				continue;
+			}
+			if (kaddr && kaddr + PAGE_SIZE == page_address(page)) {
+				kaddr += PAGE_SIZE;
+				continue;
+			}
+		}
+		kaddr = NULL;
+	}
+	return kaddr ? 1 : 0;
+}
+
+/*
+ * compressed data is tail-aligned in a pcluster, skip the zeroed padding
+ * in the head page and return where the compressed data starts.
+ */
+int z_erofs_fixup_insize(struct z_erofs_decompress_req *rq, const u8 *inpage)
+{
+	const u8 *padend = memchr_inv(inpage, 0,
+				min_t(unsigned int, rq->inputsize, PAGE_SIZE));
+
+	if (!padend)
+		return -EFSCORRUPTED;
+	rq->inputsize -= padend - inpage;
+	return padend - inpage;
+}
+
 static void *z_erofs_handle_inplace_io(struct z_erofs_decompress_req *rq,
 			void *inpage, void *out, unsigned int *inputmargin,
 			int *maptype, bool support_0padding)
@@ -270,6 +319,13 @@ static struct z_erofs_decompressor decompressors[] = {
 		.decompress = z_erofs_lz4_decompress,
 		.name = "lz4"
 	},
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+	[Z_EROFS_COMPRESSION_ZSTD] = {
+		.prepare_destpages = z_erofs_stream_prepare_destpages,
+		.decompress = z_erofs_zstd_decompress,
+		.name = "zstd"
+	},
+#endif
 };
 
 static void copy_from_pcpubuf(struct page **out, const char *dst,
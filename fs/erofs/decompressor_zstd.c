@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * zstd decompression backend, which decodes zstd frames with per-CPU
+ * streaming contexts (workspaces) managed like pcpubuf.c.
+ */
+#include <linux/zstd.h>
+#include <linux/vmalloc.h>
+#include "compress.h"
+
+struct z_erofs_zstd {
+	raw_spinlock_t lock;
+	ZSTD_DStream *stream;
+	void *wksp;
+};
+
+static DEFINE_PER_CPU(struct z_erofs_zstd, z_erofs_zstd_pcpu);
+
+static ZSTD_DStream *z_erofs_get_zstd(void) __acquires(zstd->lock)
+{
+	struct z_erofs_zstd *zstd = &get_cpu_var(z_erofs_zstd_pcpu);
+
+	raw_spin_lock(&zstd->lock);
+	if (!zstd->stream) {
+		raw_spin_unlock(&zstd->lock);
+		put_cpu_var(z_erofs_zstd_pcpu);
+		/* (for sparse checker) pretend zstd->lock is still taken */
+		__acquire(zstd->lock);
+		return NULL;
+	}
+	return zstd->stream;
+}
+
+static void z_erofs_put_zstd(ZSTD_DStream *stream) __releases(zstd->lock)
+{
+	struct z_erofs_zstd *zstd = this_cpu_ptr(&z_erofs_zstd_pcpu);
+
+	DBG_BUGON(zstd->stream != stream);
+	raw_spin_unlock(&zstd->lock);
+	put_cpu_var(z_erofs_zstd_pcpu);
+}
+
+/* the same as pcpubuf, never shrink since no idea how many fses rely on */
+static int z_erofs_zstd_growsize(unsigned int window_size)
+{
+	static DEFINE_MUTEX(zstd_resize_mutex);
+	static unsigned int zstd_window_size;
+	const size_t wkspsz = ZSTD_DStreamWorkspaceBound(window_size);
+	int cpu, ret = 0;
+
+	mutex_lock(&zstd_resize_mutex);
+	if (window_size <= zstd_window_size)
+		goto out;
+
+	for_each_possible_cpu(cpu) {
+		struct z_erofs_zstd *zstd = &per_cpu(z_erofs_zstd_pcpu, cpu);
+		ZSTD_DStream *stream;
+		void *wksp, *old_wksp;
+
+		wksp = vmalloc(wkspsz);
+		if (!wksp) {
+			ret = -ENOMEM;
+			break;
+		}
+		stream = ZSTD_initDStream(window_size, wksp, wkspsz);
+		if (!stream) {
+			vfree(wksp);
+			ret = -EINVAL;
+			break;
+		}
+
+		raw_spin_lock(&zstd->lock);
+		old_wksp = zstd->wksp;
+		zstd->wksp = wksp;
+		zstd->stream = stream;
+		raw_spin_unlock(&zstd->lock);
+
+		vfree(old_wksp);
+	}
+	if (!ret)
+		zstd_window_size = window_size;
+out:
+	mutex_unlock(&zstd_resize_mutex);
+	return ret;
+}
+
+int z_erofs_load_zstd_config(struct super_block *sb,
+			     struct erofs_super_block *dsb,
+			     struct z_erofs_zstd_cfgs *zstd, int size)
+{
+	unsigned int windowlog;
+
+	if (!zstd || size < sizeof(struct z_erofs_zstd_cfgs)) {
+		erofs_err(sb, "invalid zstd cfgs, size=%u", size);
+		return -EINVAL;
+	}
+	if (zstd->format) {
+		erofs_err(sb, "unidentified zstd format %u, please check kernel version",
+			  zstd->format);
+		return -EINVAL;
+	}
+	windowlog = zstd->windowlog + ZSTD_WINDOWLOG_MIN;
+	if (windowlog > ilog2(Z_EROFS_ZSTD_MAX_DICT_SIZE)) {
+		erofs_err(sb, "unsupported zstd window log %u", windowlog);
+		return -EINVAL;
+	}
+	return z_erofs_zstd_growsize(1U << windowlog);
+}
+
+int z_erofs_zstd_decompress(struct z_erofs_decompress_req *rq, u8 *dst)
+{
+	const unsigned int nrpages_in =
+		PAGE_ALIGN(rq->inputsize) >> PAGE_SHIFT;
+	unsigned int inputmargin, inlen, i;
+	ZSTD_outBuffer out_buf = {
+		.dst = dst + rq->pageofs_out,
+		.size = rq->outputsize,
+	};
+	ZSTD_inBuffer in_buf;
+	ZSTD_DStream *stream;
+	size_t zerr = 0;
+	u8 *kin;
+	int ret;
+
+	kin = kmap_atomic(*rq->in);
+	ret = z_erofs_fixup_insize(rq, kin);
+	if (ret < 0) {
+		kunmap_atomic(kin);
+		return ret;
+	}
+	inputmargin = ret;
+
+	stream = z_erofs_get_zstd();
+	if (!stream) {
+		DBG_BUGON(1);
+		kunmap_atomic(kin);
+		return -EFAULT;
+	}
+	zerr = ZSTD_resetDStream(stream);
+
+	inlen = rq->inputsize;
+	for (i = 0; i < nrpages_in && !ZSTD_isError(zerr); ++i) {
+		if (!kin)
+			kin = kmap_atomic(rq->in[i]);
+		in_buf.src = kin + inputmargin;
+		in_buf.pos = 0;
+		in_buf.size = min_t(unsigned int, inlen,
+				    PAGE_SIZE - inputmargin);
+		inlen -= in_buf.size;
+		inputmargin = 0;
+
+		do {
+			zerr = ZSTD_decompressStream(stream, &out_buf, &in_buf);
+			/* 0 means that the whole frame has been decoded */
+			if (ZSTD_isError(zerr) || !zerr)
+				break;
+		} while (in_buf.pos < in_buf.size &&
+			 out_buf.pos < out_buf.size);
+		kunmap_atomic(kin);
+		kin = NULL;
+
+		/* partial decoding stops once the output buffer is full */
+		if (out_buf.pos == out_buf.size || !zerr || !inlen)
+			break;
+	}
+	z_erofs_put_zstd(stream);
+
+	if (ZSTD_isError(zerr) || out_buf.pos != out_buf.size) {
+		erofs_err(rq->sb, "failed to decompress %d in[%u] out[%u]",
+			  ZSTD_isError(zerr) ? -ZSTD_getErrorCode(zerr) : 0,
+			  rq->inputsize, rq->outputsize);
+		memset(out_buf.dst + out_buf.pos, 0,
+		       out_buf.size - out_buf.pos);
+		return -EIO;
+	}
+	return 0;
+}
+
+void z_erofs_zstd_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		raw_spin_lock_init(&per_cpu(z_erofs_zstd_pcpu, cpu).lock);
+}
+
+void z_erofs_zstd_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct z_erofs_zstd *zstd = &per_cpu(z_erofs_zstd_pcpu, cpu);
+
+		vfree(zstd->wksp);
+		zstd->wksp = NULL;
+		zstd->stream = NULL;
+	}
+}
@@ -15,6 +15,7 @@
 #include <linux/magic.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/kobject.h>
 #include "erofs_fs.h"
 
 /* redefine pr_fmt "erofs: " */
@@ -53,6 +54,15 @@ struct erofs_sb_lz4_info {
 	u16 max_pclusterblks;
 };
 
+/* per-mount statistics of async decompression, exported in sysfs */
+struct erofs_decompress_stat {
+	atomic64_t nr_async;	/* # of queues decompressed by workers */
+	atomic64_t nr_sync;	/* # of readahead decompressed in context */
+	atomic64_t total_ns;	/* total queueing latency of async queues */
+	u64 max_ns;		/* maximum queueing latency */
+	u64 avg_ns;		/* moving average of queueing latency */
+};
+
 struct erofs_sb_info {
 #ifdef CONFIG_EROFS_FS_ZIP
 	/* list for all registered superblocks, mainly for shrinker */
@@ -62,18 +72,29 @@ struct erofs_sb_info {
 	/* the dedicated workstation for compression */
 	struct radix_tree_root workstn_tree;
 
-	/* strategy of sync decompression (false - auto, true - force on) */
-	bool readahead_sync_decompress;
+	/* strategy of sync decompression (EROFS_SYNC_DECOMPRESS_*) */
+	unsigned int sync_decompress;
 
 	/* threshold for decompression synchronously */
 	unsigned int max_sync_decompress_pages;
 
+	/* queueing latency above which auto mode decompresses in context */
+	unsigned int sync_decompress_lat_us;
+
+	struct erofs_decompress_stat dstat;
+
 	unsigned int shrinker_run_no;
 	u16 available_compr_algs;
 
 	/* current strategy of how to use managed cache */
 	unsigned char cache_strategy;
 
+	/* upper bound of managed cache pages (0 - unlimited) */
+	unsigned int max_cache_pages;
+
+	/* # of pclusters to prefetch for sequential readahead */
+	unsigned int max_prefetch_pclusters;
+
 	/* pseudo inode to manage cached pages */
 	struct inode *managed_cache;
 
@@ -103,6 +124,10 @@ struct erofs_sb_info {
 	u32 feature_incompat;
 
 	unsigned int mount_opt;
+
+	/* sysfs support */
+	struct kobject s_kobj;		/* /sys/fs/erofs/<devname> */
+	struct completion s_kobj_unregister;
 };
 
 #define EROFS_SB(sb) ((struct erofs_sb_info *)(sb)->s_fs_info)
@@ -123,6 +148,12 @@ enum {
 	EROFS_ZIP_CACHE_READAROUND
 };
 
+enum {
+	EROFS_SYNC_DECOMPRESS_AUTO,
+	EROFS_SYNC_DECOMPRESS_FORCE_ON,
+	EROFS_SYNC_DECOMPRESS_FORCE_OFF
+};
+
 #define EROFS_LOCKED_MAGIC     (INT_MIN | 0xE0F510CCL)
 
 /* basic unit of the workstation of a super_block */
@@ -343,6 +374,7 @@ struct erofs_map_blocks {
 	u64 m_plen, m_llen;
 
 	unsigned int m_flags;
+	unsigned char m_algorithmformat;
 
 	struct page *mpage;
 };
@@ -418,6 +450,12 @@ int erofs_pcpubuf_growsize(unsigned int nrpages);
 void erofs_pcpubuf_init(void);
 void erofs_pcpubuf_exit(void);
 
+/* sysfs.c */
+int erofs_register_sysfs(struct super_block *sb);
+void erofs_unregister_sysfs(struct super_block *sb);
+int __init erofs_init_sysfs(void);
+void erofs_exit_sysfs(void);
+
 /* utils.c / zdata.c */
 struct page *erofs_allocpage(struct list_head *pool, gfp_t gfp);
 
@@ -441,6 +479,19 @@ int erofs_try_to_free_cached_page(struct address_space *mapping,
 int z_erofs_load_lz4_config(struct super_block *sb,
 			    struct erofs_super_block *dsb,
 			    struct z_erofs_lz4_cfgs *lz4, int len);
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+int z_erofs_load_zstd_config(struct super_block *sb,
+			     struct erofs_super_block *dsb,
+			     struct z_erofs_zstd_cfgs *zstd, int len);
+#else
+static inline int z_erofs_load_zstd_config(struct super_block *sb,
+				struct erofs_super_block *dsb,
+				struct z_erofs_zstd_cfgs *zstd, int len)
+{
+	erofs_err(sb, "zstd algorithm isn't enabled");
+	return -EOPNOTSUPP;
+}
+#endif	/* !CONFIG_EROFS_FS_ZIP_ZSTD */
 #else
 static inline void erofs_shrinker_register(struct super_block *sb) {}
 static inline void erofs_shrinker_unregister(struct super_block *sb) {}
@@ -228,6 +228,16 @@ static int erofs_load_compr_cfgs(struct super_block *sb,
 		case Z_EROFS_COMPRESSION_LZ4:
 			ret = z_erofs_load_lz4_config(sb, dsb, data, size);
 			break;
+		case Z_EROFS_COMPRESSION_LZMA:
+		case Z_EROFS_COMPRESSION_DEFLATE:
+			/* lib/xz has no MicroLZMA decoder, no DEFLATE either */
+			erofs_err(sb, "compression algorithm %u isn't supported",
+				  alg);
+			ret = -EOPNOTSUPP;
+			break;
+		case Z_EROFS_COMPRESSION_ZSTD:
+			ret = z_erofs_load_zstd_config(sb, dsb, data, size);
+			break;
 		default:
 			DBG_BUGON(1);
 			ret = -EFAULT;
@@ -379,8 +389,11 @@ static void erofs_default_options(struct erofs_sb_info *sbi)
 {
 #ifdef CONFIG_EROFS_FS_ZIP
 	sbi->cache_strategy = EROFS_ZIP_CACHE_READAROUND;
+	sbi->max_cache_pages = 4096;
+	sbi->max_prefetch_pclusters = 2;
 	sbi->max_sync_decompress_pages = 3;
-	sbi->readahead_sync_decompress = false;
+	sbi->sync_decompress = EROFS_SYNC_DECOMPRESS_AUTO;
+	sbi->sync_decompress_lat_us = 0;
 #endif
 #ifdef CONFIG_EROFS_FS_XATTR
 	set_opt(sbi, XATTR_USER);
@@ -596,6 +609,10 @@ static int erofs_fill_super(struct super_block *sb, void *data, int silent)
 	if (err)
 		return err;
 
+	err = erofs_register_sysfs(sb);
+	if (err)
+		return err;
+
 	erofs_info(sb, "mounted with opts: %s, root inode @ nid %llu.",
 		   (char *)data, ROOT_NID(sbi));
 	return 0;
@@ -633,6 +650,7 @@ static void erofs_put_super(struct super_block *sb)
 
 	DBG_BUGON(!sbi);
 
+	erofs_unregister_sysfs(sb);
 	erofs_shrinker_unregister(sb);
 #ifdef CONFIG_EROFS_FS_ZIP
 	iput(sbi->managed_cache);
@@ -673,6 +691,10 @@ static int __init erofs_module_init(void)
 	if (err)
 		goto zip_err;
 
+	err = erofs_init_sysfs();
+	if (err)
+		goto sysfs_err;
+
 	err = register_filesystem(&erofs_fs_type);
 	if (err)
 		goto fs_err;
@@ -680,6 +702,8 @@ static int __init erofs_module_init(void)
 	return 0;
 
 fs_err:
+	erofs_exit_sysfs();
+sysfs_err:
 	z_erofs_exit_zip_subsystem();
 zip_err:
 	erofs_exit_shrinker();
@@ -692,6 +716,7 @@ static int __init erofs_module_init(void)
 static void __exit erofs_module_exit(void)
 {
 	unregister_filesystem(&erofs_fs_type);
+	erofs_exit_sysfs();
 	z_erofs_exit_zip_subsystem();
 	erofs_exit_shrinker();
 
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Per-mount tunables and statistics under /sys/fs/erofs/<devname>/
+ */
+#include <linux/sysfs.h>
+#include <linux/kobject.h>
+
+#include "internal.h"
+
+enum {
+	attr_pointer_ui,
+	attr_decompress_stat,
+	attr_cached_pages,
+};
+
+enum {
+	struct_erofs_sb_info,
+};
+
+struct erofs_attr {
+	struct attribute attr;
+	short attr_id;
+	int struct_type, offset;
+};
+
+#define EROFS_ATTR(_name, _mode, _id)					\
+static struct erofs_attr erofs_attr_##_name = {				\
+	.attr = {.name = __stringify(_name), .mode = _mode },		\
+	.attr_id = attr_##_id,						\
+}
+#define EROFS_ATTR_FUNC(_name, _mode)	EROFS_ATTR(_name, _mode, _name)
+
+#define EROFS_ATTR_OFFSET(_name, _mode, _id, _struct)			\
+static struct erofs_attr erofs_attr_##_name = {				\
+	.attr = {.name = __stringify(_name), .mode = _mode },		\
+	.attr_id = attr_##_id,						\
+	.struct_type = struct_##_struct,				\
+	.offset = offsetof(struct _struct, _name),			\
+}
+
+#define EROFS_ATTR_RW(_name, _id, _struct)				\
+	EROFS_ATTR_OFFSET(_name, 0644, _id, _struct)
+#define EROFS_ATTR_RW_UI(_name, _struct)				\
+	EROFS_ATTR_RW(_name, pointer_ui, _struct)
+
+#define ATTR_LIST(name) (&erofs_attr_##name.attr)
+
+#ifdef CONFIG_EROFS_FS_ZIP
+EROFS_ATTR_RW_UI(sync_decompress, erofs_sb_info);
+EROFS_ATTR_RW_UI(max_sync_decompress_pages, erofs_sb_info);
+EROFS_ATTR_RW_UI(sync_decompress_lat_us, erofs_sb_info);
+EROFS_ATTR_FUNC(decompress_stat, 0444);
+EROFS_ATTR_RW_UI(max_cache_pages, erofs_sb_info);
+EROFS_ATTR_RW_UI(max_prefetch_pclusters, erofs_sb_info);
+EROFS_ATTR_FUNC(cached_pages, 0444);
+#endif
+
+static struct attribute *erofs_attrs[] = {
+#ifdef CONFIG_EROFS_FS_ZIP
+	ATTR_LIST(sync_decompress),
+	ATTR_LIST(max_sync_decompress_pages),
+	ATTR_LIST(sync_decompress_lat_us),
+	ATTR_LIST(decompress_stat),
+	ATTR_LIST(max_cache_pages),
+	ATTR_LIST(max_prefetch_pclusters),
+	ATTR_LIST(cached_pages),
+#endif
+	NULL,
+};
+
+static unsigned char *__struct_ptr(struct erofs_sb_info *sbi,
+				   int struct_type, int offset)
+{
+	if (struct_type == struct_erofs_sb_info)
+		return (unsigned char *)sbi + offset;
+	return NULL;
+}
+
+static ssize_t erofs_attr_show(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	struct erofs_attr *a = container_of(attr, struct erofs_attr, attr);
+	unsigned char *ptr = __struct_ptr(sbi, a->struct_type, a->offset);
+
+	switch (a->attr_id) {
+	case attr_pointer_ui:
+		if (!ptr)
+			return 0;
+		return snprintf(buf, PAGE_SIZE, "%u\n",
+				*(unsigned int *)ptr);
+#ifdef CONFIG_EROFS_FS_ZIP
+	case attr_decompress_stat: {
+		struct erofs_decompress_stat *st = &sbi->dstat;
+		u64 nr_async = atomic64_read(&st->nr_async);
+		u64 total_us = div_u64(atomic64_read(&st->total_ns),
+				       NSEC_PER_USEC);
+
+		/* async sync total_us avg_us max_us ewma_us */
+		return scnprintf(buf, PAGE_SIZE,
+				 "%8llu %8llu %8llu %8llu %8llu %8llu\n",
+				 nr_async,
+				 (u64)atomic64_read(&st->nr_sync),
+				 total_us,
+				 nr_async ? div64_u64(total_us, nr_async) : 0,
+				 div_u64(READ_ONCE(st->max_ns), NSEC_PER_USEC),
+				 div_u64(READ_ONCE(st->avg_ns), NSEC_PER_USEC));
+	}
+	case attr_cached_pages:
+		if (!sbi->managed_cache)
+			return 0;
+		return snprintf(buf, PAGE_SIZE, "%lu\n",
+			READ_ONCE(sbi->managed_cache->i_mapping->nrpages));
+#endif
+	}
+	return 0;
+}
+
+static ssize_t erofs_attr_store(struct kobject *kobj, struct attribute *attr,
+				const char *buf, size_t len)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	struct erofs_attr *a = container_of(attr, struct erofs_attr, attr);
+	unsigned char *ptr = __struct_ptr(sbi, a->struct_type, a->offset);
+	unsigned long t;
+	int ret;
+
+	switch (a->attr_id) {
+	case attr_pointer_ui:
+		if (!ptr)
+			return 0;
+		ret = kstrtoul(skip_spaces(buf), 0, &t);
+		if (ret)
+			return ret;
+		if (t != (unsigned int)t)
+			return -ERANGE;
+#ifdef CONFIG_EROFS_FS_ZIP
+		if (!strcmp(a->attr.name, "sync_decompress") &&
+		    t > EROFS_SYNC_DECOMPRESS_FORCE_OFF)
+			return -EINVAL;
+#endif
+		*(unsigned int *)ptr = t;
+		return len;
+	}
+	return 0;
+}
+
+static void erofs_sb_release(struct kobject *kobj)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	complete(&sbi->s_kobj_unregister);
+}
+
+static const struct sysfs_ops erofs_attr_ops = {
+	.show	= erofs_attr_show,
+	.store	= erofs_attr_store,
+};
+
+static struct kobj_type erofs_sb_ktype = {
+	.default_attrs	= erofs_attrs,
+	.sysfs_ops	= &erofs_attr_ops,
+	.release	= erofs_sb_release,
+};
+
+static struct kobj_type erofs_ktype = {
+	.sysfs_ops	= &erofs_attr_ops,
+};
+
+static struct kset erofs_root = {
+	.kobj	= {.ktype = &erofs_ktype},
+};
+
+int erofs_register_sysfs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	int err;
+
+	sbi->s_kobj.kset = &erofs_root;
+	init_completion(&sbi->s_kobj_unregister);
+	err = kobject_init_and_add(&sbi->s_kobj, &erofs_sb_ktype, NULL,
+				   "%s", sb->s_id);
+	if (err) {
+		kobject_put(&sbi->s_kobj);
+		wait_for_completion(&sbi->s_kobj_unregister);
+	}
+	return err;
+}
+
+void erofs_unregister_sysfs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+
+	if (sbi->s_kobj.state_in_sysfs) {
+		kobject_del(&sbi->s_kobj);
+		kobject_put(&sbi->s_kobj);
+		wait_for_completion(&sbi->s_kobj_unregister);
+	}
+}
+
+int __init erofs_init_sysfs(void)
+{
+	kobject_set_name(&erofs_root.kobj, "erofs");
+	erofs_root.kobj.parent = fs_kobj;
+	return kset_register(&erofs_root);
+}
+
+void erofs_exit_sysfs(void)
+{
+	kset_unregister(&erofs_root);
+}
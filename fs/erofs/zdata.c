@@ -243,6 +243,7 @@ static inline void erofs_cpu_hotplug_destroy(void) {}
 
 void z_erofs_exit_zip_subsystem(void)
 {
+	z_erofs_zstd_exit();
 	erofs_cpu_hotplug_destroy();
 	erofs_destroy_percpu_workers();
 	destroy_workqueue(z_erofs_workqueue);
@@ -251,8 +252,10 @@ void z_erofs_exit_zip_subsystem(void)
 
 int __init z_erofs_init_zip_subsystem(void)
 {
-	int err = z_erofs_create_pcluster_pool();
+	int err;
 
+	z_erofs_zstd_init();
+	err = z_erofs_create_pcluster_pool();
 	if (err)
 		goto out_error_pcluster_pool;
 
@@ -508,6 +511,7 @@ static int z_erofs_attach_page(struct z_erofs_collector *clt,
 	/* give priority for inplaceio */
 	if (clt->mode >= COLLECT_PRIMARY &&
 	    type == Z_EROFS_PAGE_TYPE_EXCLUSIVE &&
+	    z_erofs_inplace_io_allowed(clt->pcl->algorithmformat) &&
 	    z_erofs_try_inplace_io(clt, page))
 		return 0;
 
@@ -623,10 +627,7 @@ static int z_erofs_register_collection(struct z_erofs_collector *clt,
 		(map->m_flags & EROFS_MAP_FULL_MAPPED ?
 			Z_EROFS_PCLUSTER_FULL_LENGTH : 0);
 
-	if (map->m_flags & EROFS_MAP_ZIPPED)
-		pcl->algorithmformat = Z_EROFS_COMPRESSION_LZ4;
-	else
-		pcl->algorithmformat = Z_EROFS_COMPRESSION_SHIFTED;
+	pcl->algorithmformat = map->m_algorithmformat;
 
 	/* new pclusters should be claimed as type 1, primary and followed */
 	pcl->next = clt->owned_head;
@@ -748,6 +749,13 @@ static bool z_erofs_collector_end(struct z_erofs_collector *clt)
 	return true;
 }
 
+/* the managed cache is bounded by max_cache_pages (0 - unlimited) */
+static bool z_erofs_cache_is_full(struct erofs_sb_info *sbi)
+{
+	return sbi->max_cache_pages &&
+		READ_ONCE(MNGD_MAPPING(sbi)->nrpages) >= sbi->max_cache_pages;
+}
+
 static bool should_alloc_managed_pages(struct z_erofs_decompress_frontend *fe,
 				       unsigned int cachestrategy,
 				       erofs_off_t la)
@@ -755,6 +763,9 @@ static bool should_alloc_managed_pages(struct z_erofs_decompress_frontend *fe,
 	if (cachestrategy <= EROFS_ZIP_CACHE_DISABLED)
 		return false;
 
+	if (z_erofs_cache_is_full(EROFS_I_SB(fe->inode)))
+		return false;
+
 	if (fe->backmost)
 		return true;
 
@@ -907,8 +918,6 @@ static void z_erofs_decompressqueue_kthread_work(struct kthread_work *work)
 static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 				       bool sync, int bios)
 {
-	struct erofs_sb_info *const sbi = EROFS_SB(io->sb);
-
 	/* wake up the caller thread for sync decompression */
 	if (sync) {
 		if (!atomic_add_return(bios, &io->pending_bios))
@@ -924,6 +933,7 @@ static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 #ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
 		struct kthread_worker *worker;
 
+		io->queued = ktime_get();
 		rcu_read_lock();
 		worker = rcu_dereference(
 				z_erofs_pcpu_workers[raw_smp_processor_id()]);
@@ -935,9 +945,9 @@ static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 		}
 		rcu_read_unlock();
 #else
+		io->queued = ktime_get();
 		queue_work(z_erofs_workqueue, &io->u.work);
 #endif
-		sbi->readahead_sync_decompress = true;
 		return;
 	}
 	z_erofs_decompressqueue_work(&io->u.work);
@@ -1197,6 +1207,22 @@ static void z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 	}
 }
 
+/* account how long an async queue waited before a worker picked it up */
+static void z_erofs_account_queue_latency(struct erofs_sb_info *sbi,
+					  ktime_t queued)
+{
+	struct erofs_decompress_stat *const st = &sbi->dstat;
+	const u64 lat = ktime_to_ns(ktime_sub(ktime_get(), queued));
+	u64 avg = READ_ONCE(st->avg_ns);
+
+	atomic64_inc(&st->nr_async);
+	atomic64_add(lat, &st->total_ns);
+	/* racy updates are fine, these are only statistics and hints */
+	if (lat > READ_ONCE(st->max_ns))
+		WRITE_ONCE(st->max_ns, lat);
+	WRITE_ONCE(st->avg_ns, avg - (avg >> 3) + (lat >> 3));
+}
+
 static void z_erofs_decompressqueue_work(struct work_struct *work)
 {
 	struct z_erofs_decompressqueue *bgq =
@@ -1204,6 +1230,8 @@ static void z_erofs_decompressqueue_work(struct work_struct *work)
 	LIST_HEAD(pagepool);
 
 	DBG_BUGON(bgq->head == Z_EROFS_PCLUSTER_TAIL_CLOSED);
+	if (bgq->queued)
+		z_erofs_account_queue_latency(EROFS_SB(bgq->sb), bgq->queued);
 	z_erofs_decompress_queue(bgq, &pagepool);
 
 	put_pages_list(&pagepool);
@@ -1547,17 +1575,152 @@ static int z_erofs_readpage(struct file *file, struct page *page)
 	return err;
 }
 
+static void z_erofs_prefetch_endio(struct bio *bio)
+{
+	blk_status_t err = bio->bi_status;
+	struct bio_vec *bvec;
+	unsigned int i;
+
+	bio_for_each_segment_all(bvec, bio, i) {
+		struct page *page = bvec->bv_page;
+
+		if (err)
+			SetPageError(page);
+		else
+			SetPageUptodate(page);
+		unlock_page(page);
+		put_page(page);
+	}
+	bio_put(bio);
+}
+
+/*
+ * Read compressed data of the pclusters following @pos into the managed
+ * cache in advance.  These pages aren't bound to any pcluster until they
+ * are looked up by preload_compressed_pages(), and can be reclaimed as
+ * other managed pages anytime.
+ */
+static void z_erofs_prefetch_pclusters(struct inode *inode, erofs_off_t pos)
+{
+	struct erofs_sb_info *const sbi = EROFS_I_SB(inode);
+	struct address_space *const mc = MNGD_MAPPING(sbi);
+	gfp_t gfp = (mapping_gfp_mask(mc) & ~__GFP_DIRECT_RECLAIM) |
+			__GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN;
+	struct erofs_map_blocks map = { .mpage = NULL };
+	/* since bio will be NULL, no need to initialize last_index */
+	pgoff_t last_index;
+	struct bio *bio = NULL;
+	unsigned int nr;
+
+	for (nr = sbi->max_prefetch_pclusters; nr; --nr) {
+		pgoff_t cur, end;
+
+		if (pos >= inode->i_size || z_erofs_cache_is_full(sbi))
+			break;
+
+		map.m_la = pos;
+		map.m_llen = 0;
+		/* only compressed pclusters live in the managed cache */
+		if (z_erofs_map_blocks_iter(inode, &map, 0) ||
+		    !(map.m_flags & EROFS_MAP_MAPPED) ||
+		    !(map.m_flags & EROFS_MAP_ZIPPED))
+			break;
+		pos = map.m_la + map.m_llen;
+
+		cur = map.m_pa >> PAGE_SHIFT;
+		end = cur + (map.m_plen >> PAGE_SHIFT);
+		for (; cur < end; ++cur) {
+			struct page *page = find_get_page(mc, cur);
+
+			if (page) {
+				put_page(page);
+				continue;
+			}
+
+			page = __page_cache_alloc(gfp);
+			if (!page)
+				goto out;
+			/* the page is locked until the prefetch I/O ends */
+			if (add_to_page_cache_lru(page, mc, cur, gfp)) {
+				put_page(page);
+				continue;
+			}
+
+			if (bio && cur != last_index + 1) {
+submit_bio_retry:
+				submit_bio(bio);
+				bio = NULL;
+			}
+
+			if (!bio) {
+				bio = bio_alloc(GFP_NOIO, BIO_MAX_PAGES);
+
+				bio->bi_end_io = z_erofs_prefetch_endio;
+				bio_set_dev(bio, inode->i_sb->s_bdev);
+				bio->bi_iter.bi_sector = (sector_t)cur <<
+					LOG_SECTORS_PER_BLOCK;
+				bio->bi_opf = REQ_OP_READ | REQ_RAHEAD;
+			}
+
+			if (bio_add_page(bio, page, PAGE_SIZE, 0) < PAGE_SIZE)
+				goto submit_bio_retry;
+
+			last_index = cur;
+		}
+	}
+out:
+	if (bio)
+		submit_bio(bio);
+	if (map.mpage)
+		put_page(map.mpage);
+}
+
+/*
+ * Prefetch the following pclusters only if the readahead window was pushed
+ * forward by a sequential hit, i.e. the whole window is async readahead.
+ */
+static bool z_erofs_should_prefetch(struct erofs_sb_info *sbi,
+				    struct file *filp)
+{
+	if (sbi->cache_strategy < EROFS_ZIP_CACHE_READAHEAD ||
+	    !sbi->max_prefetch_pclusters || !filp)
+		return false;
+
+	return filp->f_ra.size && filp->f_ra.async_size == filp->f_ra.size;
+}
+
+/*
+ * Decompress small readahead requests in the caller context if workers are
+ * observed to be slow to pick up queues (e.g. busy or on a little core.)
+ */
+static bool z_erofs_is_sync_decompress(struct erofs_sb_info *sbi,
+				       unsigned int nr_pages)
+{
+	if (nr_pages > sbi->max_sync_decompress_pages)
+		return false;
+
+	switch (sbi->sync_decompress) {
+	case EROFS_SYNC_DECOMPRESS_FORCE_ON:
+		return true;
+	case EROFS_SYNC_DECOMPRESS_FORCE_OFF:
+		return false;
+	default:
+		return READ_ONCE(sbi->dstat.avg_ns) >
+			(u64)sbi->sync_decompress_lat_us * NSEC_PER_USEC;
+	}
+}
+
 static int z_erofs_readpages(struct file *filp, struct address_space *mapping,
 			     struct list_head *pages, unsigned int nr_pages)
 {
 	struct inode *const inode = mapping->host;
 	struct erofs_sb_info *const sbi = EROFS_I_SB(inode);
 
-	bool sync = (sbi->readahead_sync_decompress &&
-			nr_pages <= sbi->max_sync_decompress_pages);
+	bool sync = z_erofs_is_sync_decompress(sbi, nr_pages);
 	struct z_erofs_decompress_frontend f = DECOMPRESS_FRONTEND_INIT(inode);
 	gfp_t gfp = mapping_gfp_constraint(mapping, GFP_KERNEL);
 	struct page *head = NULL;
+	erofs_off_t prefetch_pos = 0;
 	LIST_HEAD(pagepool);
 
 	trace_erofs_readpages(mapping->host, lru_to_page(pages),
@@ -1587,6 +1750,10 @@ static int z_erofs_readpages(struct file *filp, struct address_space *mapping,
 		head = page;
 	}
 
+	/* the last page of this request is at the head of the chain */
+	if (head && z_erofs_should_prefetch(sbi, filp))
+		prefetch_pos = page_offset(head) + PAGE_SIZE;
+
 	while (head) {
 		struct page *page = head;
 		int err;
@@ -1604,11 +1771,16 @@ static int z_erofs_readpages(struct file *filp, struct address_space *mapping,
 
 	(void)z_erofs_collector_end(&f.clt);
 
+	if (sync)
+		atomic64_inc(&sbi->dstat.nr_sync);
 	z_erofs_runqueue(inode->i_sb, &f.clt, &pagepool, sync);
 
 	if (f.map.mpage)
 		put_page(f.map.mpage);
 
+	if (prefetch_pos)
+		z_erofs_prefetch_pclusters(inode, prefetch_pos);
+
 	/* clean up the remaining free pages */
 	put_pages_list(&pagepool);
 	return 0;
@@ -88,6 +88,8 @@ struct z_erofs_decompressqueue {
 	struct super_block *sb;
 	atomic_t pending_bios;
 	z_erofs_next_pcluster_t head;
+	/* when the queue was handed over to workers, for latency stats */
+	ktime_t queued;
 
 	union {
 		struct completion done;
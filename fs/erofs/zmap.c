@@ -3,7 +3,7 @@
  * Copyright (C) 2018-2019 HUAWEI, Inc.
  *             https://www.huawei.com/
  */
-#include "internal.h"
+#include "compress.h"
 #include <asm/unaligned.h>
 #include <trace/events/erofs.h>
 
@@ -75,6 +75,16 @@ static int z_erofs_fill_inode_lazy(struct inode *inode)
 		goto unmap_done;
 	}
 
+	/* non-lz4 algorithms must have been set up by on-disk cfgs at mount */
+	if (vi->z_algorithmtype[0] != Z_EROFS_COMPRESSION_LZ4 &&
+	    !(EROFS_SB(sb)->available_compr_algs &
+	      BIT(vi->z_algorithmtype[0]))) {
+		erofs_err(sb, "compression format %u isn't available for nid %llu",
+			  vi->z_algorithmtype[0], vi->nid);
+		err = -EFSCORRUPTED;
+		goto unmap_done;
+	}
+
 	vi->z_logical_clusterbits = LOG_BLOCK_SIZE + (h->h_clusterbits & 7);
 	if (!erofs_sb_has_big_pcluster(EROFS_SB(sb)) &&
 	    vi->z_advise & (Z_EROFS_ADVISE_BIG_PCLUSTER_1 |
@@ -577,6 +587,10 @@ int z_erofs_map_blocks_iter(struct inode *inode,
 	map->m_llen = end - map->m_la;
 	map->m_pa = blknr_to_addr(m.pblk);
 	map->m_flags |= EROFS_MAP_MAPPED;
+	if (map->m_flags & EROFS_MAP_ZIPPED)
+		map->m_algorithmformat = vi->z_algorithmtype[0];
+	else
+		map->m_algorithmformat = Z_EROFS_COMPRESSION_SHIFTED;
 
 	err = z_erofs_get_extent_compressedlen(&m, initial_lcn);
 	if (err)
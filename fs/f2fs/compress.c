@@ -0,0 +1,1301 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs/f2fs/compress.c: per-file transparent compression for f2fs
+ */
+
+/*
+ * A compressed file is split into clusters of 2^i_log_cluster_size pages,
+ * and every cluster is stored in one of two layouts within a single dnode:
+ *
+ *   raw:        [blk 0][blk 1] ... [blk n - 1]
+ *   compressed: [COMPRESS_ADDR][cblk 1] ... [cblk m][NULL_ADDR] ...
+ *
+ * The blocks of a compressed cluster hold a compress_data header followed by
+ * the compressed stream of the whole cluster.  Every non-NULL address of a
+ * cluster, COMPRESS_ADDR included, is charged to the inode like NEW_ADDR is,
+ * so only the blocks saved by compression go back to the free space.
+ *
+ * Compressed clusters are always rewritten as a whole: writeback gathers the
+ * cluster pages, compresses them into a linear buffer and writes the result
+ * through bounce pages, in the same way GC moves encrypted blocks.  If the
+ * data no longer saves a block, the cluster falls back to the raw layout.
+ * Raw clusters are only compressed once all of their pages are dirty, which
+ * keeps partial overwrites of incompressible data cheap.
+ *
+ * Reads of a compressed cluster are synchronous: the compressed blocks are
+ * read, verified and decompressed, then every page of the cluster which is
+ * not cached yet is filled from the result.
+ */
+
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
+#include <linux/pagemap.h>
+#include <linux/bio.h>
+#include <linux/sched/mm.h>
+#include <linux/lz4.h>
+#include <linux/zstd.h>
+
+#include "f2fs.h"
+#include "node.h"
+#include "segment.h"
+
+#define F2FS_COMPRESSED_PAGE_MAGIC	0xF5F2C000
+#define COMPRESS_DATA_RESERVED_SIZE	4
+#define COMPRESS_HEADER_SIZE		(sizeof(struct compress_data))
+#define F2FS_ZSTD_DEFAULT_CLEVEL	1
+#define NULL_CLUSTER			((pgoff_t)-1)
+
+struct compress_data {
+	__le32 clen;			/* compressed data size */
+	__le32 chksum;			/* checksum of compressed data */
+	__le32 reserved[COMPRESS_DATA_RESERVED_SIZE];	/* reserved */
+	u8 cdata[];			/* compressed data */
+};
+
+struct compress_ctx {
+	struct inode *inode;		/* inode the context belongs to */
+	const struct f2fs_compress_ops *cops;	/* compression backend */
+	pgoff_t cluster_idx;		/* cluster decompressed in rbuf */
+	pgoff_t skip_cluster;		/* raw cluster not worth compressing */
+	unsigned int log_cluster_size;	/* log of cluster size */
+	unsigned int cluster_size;	/* # of pages in a cluster */
+	struct page **rpages;		/* locked pages of the cluster */
+	struct page **cpages;		/* pages carrying compressed data */
+	block_t *cblkaddr;		/* addresses of compressed blocks */
+	void *rbuf;			/* linear buffer of raw data */
+	struct compress_data *cbuf;	/* linear buffer of compressed data */
+	size_t rlen;			/* valid length of rbuf */
+	size_t clen;			/* valid length of cbuf->cdata */
+	void *private;			/* compressor workspace */
+	void *private2;			/* compressor context */
+	void *dprivate;			/* decompressor workspace */
+	void *dprivate2;		/* decompressor context */
+};
+
+/* in-flight write of a compressed cluster, hung off each bounce page */
+struct compress_io_ctx {
+	u32 magic;			/* F2FS_COMPRESSED_PAGE_MAGIC */
+	struct inode *inode;		/* inode the cluster belongs to */
+	unsigned int nr_rpages;		/* # of raw pages under writeback */
+	atomic_t pending_pages;		/* # of bounce pages in flight */
+	struct page *rpages[];		/* raw pages of the cluster */
+};
+
+struct f2fs_compress_ops {
+	int (*init_compress_ctx)(struct compress_ctx *cc);
+	void (*destroy_compress_ctx)(struct compress_ctx *cc);
+	int (*compress_pages)(struct compress_ctx *cc);
+	int (*init_decompress_ctx)(struct compress_ctx *cc);
+	void (*destroy_decompress_ctx)(struct compress_ctx *cc);
+	int (*decompress_pages)(struct compress_ctx *cc);
+};
+
+/*
+ * Cluster buffers and zstd workspaces may be too large for kmalloc, and
+ * kvmalloc() only falls back to vmalloc for GFP_KERNEL, so use a NOFS scope
+ * rather than GFP_NOFS to stay out of filesystem reclaim.
+ */
+static void *f2fs_compress_alloc(struct f2fs_sb_info *sbi, size_t size)
+{
+	unsigned int nofs_flag;
+	void *ptr;
+
+	nofs_flag = memalloc_nofs_save();
+	ptr = f2fs_kvmalloc(sbi, size, GFP_KERNEL);
+	memalloc_nofs_restore(nofs_flag);
+	return ptr;
+}
+
+#ifdef CONFIG_F2FS_FS_LZ4
+static int lz4_init_compress_ctx(struct compress_ctx *cc)
+{
+	cc->private = f2fs_compress_alloc(F2FS_I_SB(cc->inode),
+						LZ4_MEM_COMPRESS);
+	if (!cc->private)
+		return -ENOMEM;
+	return 0;
+}
+
+static void lz4_destroy_compress_ctx(struct compress_ctx *cc)
+{
+	kvfree(cc->private);
+	cc->private = NULL;
+}
+
+static int lz4_compress_pages(struct compress_ctx *cc)
+{
+	int len;
+
+	len = LZ4_compress_default(cc->rbuf, (char *)cc->cbuf->cdata,
+					cc->rlen, cc->clen, cc->private);
+	if (!len)
+		return -EAGAIN;
+
+	cc->clen = len;
+	return 0;
+}
+
+static int lz4_decompress_pages(struct compress_ctx *cc)
+{
+	int ret;
+
+	ret = LZ4_decompress_safe((char *)cc->cbuf->cdata, cc->rbuf,
+						cc->clen, cc->rlen);
+	if (ret < 0) {
+		f2fs_msg(cc->inode->i_sb, KERN_ERR,
+			"%s: lz4 decompress failed, ino:%lu, ret:%d",
+			__func__, cc->inode->i_ino, ret);
+		return -EIO;
+	}
+
+	cc->rlen = ret;
+	return 0;
+}
+
+static const struct f2fs_compress_ops f2fs_lz4_ops = {
+	.init_compress_ctx	= lz4_init_compress_ctx,
+	.destroy_compress_ctx	= lz4_destroy_compress_ctx,
+	.compress_pages		= lz4_compress_pages,
+	.decompress_pages	= lz4_decompress_pages,
+};
+#endif
+
+#ifdef CONFIG_F2FS_FS_ZSTD
+static int zstd_init_compress_ctx(struct compress_ctx *cc)
+{
+	ZSTD_parameters params;
+	ZSTD_CCtx *cctx;
+	size_t workspace_size;
+	void *workspace;
+
+	params = ZSTD_getParams(F2FS_ZSTD_DEFAULT_CLEVEL,
+				cc->cluster_size << PAGE_SHIFT, 0);
+	workspace_size = ZSTD_CCtxWorkspaceBound(params.cParams);
+
+	workspace = f2fs_compress_alloc(F2FS_I_SB(cc->inode), workspace_size);
+	if (!workspace)
+		return -ENOMEM;
+
+	cctx = ZSTD_initCCtx(workspace, workspace_size);
+	if (!cctx) {
+		f2fs_msg(cc->inode->i_sb, KERN_ERR,
+			"%s: ZSTD_initCCtx failed", __func__);
+		kvfree(workspace);
+		return -EIO;
+	}
+
+	cc->private = workspace;
+	cc->private2 = cctx;
+	return 0;
+}
+
+static void zstd_destroy_compress_ctx(struct compress_ctx *cc)
+{
+	kvfree(cc->private);
+	cc->private = NULL;
+	cc->private2 = NULL;
+}
+
+static int zstd_compress_pages(struct compress_ctx *cc)
+{
+	ZSTD_parameters params;
+	size_t ret;
+
+	/* never needs a larger workspace than the one sized for a cluster */
+	params = ZSTD_getParams(F2FS_ZSTD_DEFAULT_CLEVEL, cc->rlen, 0);
+	ret = ZSTD_compressCCtx(cc->private2, cc->cbuf->cdata, cc->clen,
+					cc->rbuf, cc->rlen, params);
+	if (ZSTD_isError(ret)) {
+		if (ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall)
+			return -EAGAIN;
+		f2fs_msg(cc->inode->i_sb, KERN_ERR,
+			"%s: ZSTD_compressCCtx failed, ret:%u",
+			__func__, ZSTD_getErrorCode(ret));
+		return -EIO;
+	}
+
+	cc->clen = ret;
+	return 0;
+}
+
+static int zstd_init_decompress_ctx(struct compress_ctx *cc)
+{
+	ZSTD_DCtx *dctx;
+	size_t workspace_size;
+	void *workspace;
+
+	workspace_size = ZSTD_DCtxWorkspaceBound();
+	workspace = f2fs_compress_alloc(F2FS_I_SB(cc->inode), workspace_size);
+	if (!workspace)
+		return -ENOMEM;
+
+	dctx = ZSTD_initDCtx(workspace, workspace_size);
+	if (!dctx) {
+		f2fs_msg(cc->inode->i_sb, KERN_ERR,
+			"%s: ZSTD_initDCtx failed", __func__);
+		kvfree(workspace);
+		return -EIO;
+	}
+
+	cc->dprivate = workspace;
+	cc->dprivate2 = dctx;
+	return 0;
+}
+
+static void zstd_destroy_decompress_ctx(struct compress_ctx *cc)
+{
+	kvfree(cc->dprivate);
+	cc->dprivate = NULL;
+	cc->dprivate2 = NULL;
+}
+
+static int zstd_decompress_pages(struct compress_ctx *cc)
+{
+	size_t ret;
+
+	ret = ZSTD_decompressDCtx(cc->dprivate2, cc->rbuf, cc->rlen,
+					cc->cbuf->cdata, cc->clen);
+	if (ZSTD_isError(ret)) {
+		f2fs_msg(cc->inode->i_sb, KERN_ERR,
+			"%s: zstd decompress failed, ino:%lu, ret:%u",
+			__func__, cc->inode->i_ino, ZSTD_getErrorCode(ret));
+		return -EIO;
+	}
+
+	cc->rlen = ret;
+	return 0;
+}
+
+static const struct f2fs_compress_ops f2fs_zstd_ops = {
+	.init_compress_ctx	= zstd_init_compress_ctx,
+	.destroy_compress_ctx	= zstd_destroy_compress_ctx,
+	.compress_pages		= zstd_compress_pages,
+	.init_decompress_ctx	= zstd_init_decompress_ctx,
+	.destroy_decompress_ctx	= zstd_destroy_decompress_ctx,
+	.decompress_pages	= zstd_decompress_pages,
+};
+#endif
+
+/* COMPRESS_LZO is reserved for the on-disk format only */
+static const struct f2fs_compress_ops *f2fs_cops[COMPRESS_MAX] = {
+#ifdef CONFIG_F2FS_FS_LZ4
+	[COMPRESS_LZ4]	= &f2fs_lz4_ops,
+#endif
+#ifdef CONFIG_F2FS_FS_ZSTD
+	[COMPRESS_ZSTD]	= &f2fs_zstd_ops,
+#endif
+};
+
+bool f2fs_compress_algorithm_supported(unsigned char algorithm)
+{
+	return algorithm < COMPRESS_MAX && f2fs_cops[algorithm];
+}
+
+static inline pgoff_t cluster_start(struct compress_ctx *cc, pgoff_t index)
+{
+	return round_down(index, cc->cluster_size);
+}
+
+/* # of pages of the cluster starting at @start which are within i_size */
+static unsigned int cluster_nr_pages(struct compress_ctx *cc, pgoff_t start)
+{
+	pgoff_t end_index = (i_size_read(cc->inode) + PAGE_SIZE - 1) >>
+								PAGE_SHIFT;
+
+	if (end_index <= start)
+		return 0;
+	return min_t(pgoff_t, end_index - start, cc->cluster_size);
+}
+
+struct compress_ctx *f2fs_alloc_compress_ctx(struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct compress_ctx *cc;
+
+	cc = f2fs_kzalloc(F2FS_I_SB(inode), sizeof(struct compress_ctx),
+								GFP_NOFS);
+	if (!cc)
+		return NULL;
+
+	cc->inode = inode;
+	if (fi->i_compress_algorithm < COMPRESS_MAX)
+		cc->cops = f2fs_cops[fi->i_compress_algorithm];
+	cc->log_cluster_size = fi->i_log_cluster_size;
+	cc->cluster_size = fi->i_cluster_size;
+	cc->cluster_idx = NULL_CLUSTER;
+	cc->skip_cluster = NULL_CLUSTER;
+	return cc;
+}
+
+static void f2fs_free_cluster_buffers(struct compress_ctx *cc)
+{
+	kfree(cc->rpages);
+	kfree(cc->cpages);
+	kfree(cc->cblkaddr);
+	kvfree(cc->rbuf);
+	kvfree(cc->cbuf);
+	cc->rpages = NULL;
+	cc->cpages = NULL;
+	cc->cblkaddr = NULL;
+	cc->rbuf = NULL;
+	cc->cbuf = NULL;
+}
+
+static int f2fs_prepare_cluster_buffers(struct compress_ctx *cc)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
+	size_t size = cc->cluster_size << PAGE_SHIFT;
+
+	if (!cc->cops)
+		return -EOPNOTSUPP;
+	if (cc->rbuf)
+		return 0;
+
+	cc->rpages = f2fs_kzalloc(sbi, sizeof(struct page *) *
+					cc->cluster_size, GFP_NOFS);
+	cc->cpages = f2fs_kzalloc(sbi, sizeof(struct page *) *
+					cc->cluster_size, GFP_NOFS);
+	cc->cblkaddr = f2fs_kzalloc(sbi, sizeof(block_t) *
+					cc->cluster_size, GFP_NOFS);
+	cc->cbuf = f2fs_compress_alloc(sbi, size);
+	cc->rbuf = f2fs_compress_alloc(sbi, size);
+
+	if (!cc->rpages || !cc->cpages || !cc->cblkaddr ||
+					!cc->cbuf || !cc->rbuf) {
+		f2fs_free_cluster_buffers(cc);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void f2fs_free_compress_ctx(struct compress_ctx *cc)
+{
+	if (!cc)
+		return;
+
+	if (cc->private)
+		cc->cops->destroy_compress_ctx(cc);
+	if (cc->dprivate)
+		cc->cops->destroy_decompress_ctx(cc);
+	f2fs_free_cluster_buffers(cc);
+	kfree(cc);
+}
+
+int f2fs_is_compressed_cluster(struct inode *inode, pgoff_t index)
+{
+	struct dnode_of_data dn;
+	int ret;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	ret = get_dnode_of_data(&dn, round_down(index,
+				F2FS_I(inode)->i_cluster_size), LOOKUP_NODE);
+	if (ret)
+		return ret == -ENOENT ? 0 : ret;
+
+	ret = dn.data_blkaddr == COMPRESS_ADDR;
+	f2fs_put_dnode(&dn);
+	return ret;
+}
+
+static int f2fs_submit_cluster_read(struct bio *bio)
+{
+	int err;
+
+	err = submit_bio_wait(bio);
+	bio_put(bio);
+	return err;
+}
+
+/* read @nr compressed blocks at cc->cblkaddr into cc->cbuf */
+static int f2fs_read_compressed_blocks(struct compress_ctx *cc,
+							unsigned int nr)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
+	struct bio *bio = NULL;
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < nr; i++) {
+		cc->cpages[i] = alloc_page(GFP_NOFS);
+		if (!cc->cpages[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < nr; i++) {
+		block_t blkaddr = cc->cblkaddr[i];
+
+		/* GC may still be writing this block out via META_MAPPING */
+		f2fs_wait_on_block_writeback(cc->inode, blkaddr);
+
+		if (bio && (blkaddr != cc->cblkaddr[i - 1] + 1 ||
+				f2fs_target_device_index(sbi, blkaddr) !=
+				f2fs_target_device_index(sbi,
+						cc->cblkaddr[i - 1]))) {
+			err = f2fs_submit_cluster_read(bio);
+			bio = NULL;
+			if (err)
+				goto out;
+		}
+
+		if (!bio) {
+			bio = f2fs_bio_alloc(sbi, nr - i, true);
+			f2fs_target_device(sbi, blkaddr, bio);
+			bio_set_op_attrs(bio, REQ_OP_READ, 0);
+		}
+
+		if (bio_add_page(bio, cc->cpages[i], PAGE_SIZE, 0) < PAGE_SIZE)
+			f2fs_bug_on(sbi, 1);
+	}
+
+	if (bio)
+		err = f2fs_submit_cluster_read(bio);
+	if (err)
+		goto out;
+
+	for (i = 0; i < nr; i++)
+		memcpy((u8 *)cc->cbuf + (i << PAGE_SHIFT),
+				page_address(cc->cpages[i]), PAGE_SIZE);
+out:
+	for (i = 0; i < nr && cc->cpages[i]; i++) {
+		__free_page(cc->cpages[i]);
+		cc->cpages[i] = NULL;
+	}
+	return err;
+}
+
+/*
+ * Read and decompress the cluster starting at @start into cc->rbuf.
+ * Returns -EAGAIN if the cluster is not compressed.
+ */
+static int f2fs_load_cluster(struct compress_ctx *cc, pgoff_t start)
+{
+	struct inode *inode = cc->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	size_t size = cc->cluster_size << PAGE_SHIFT;
+	struct dnode_of_data dn;
+	unsigned int nr_cblocks = 0, i;
+	size_t clen;
+	int err;
+
+	err = f2fs_prepare_cluster_buffers(cc);
+	if (err)
+		return err;
+
+	cc->cluster_idx = NULL_CLUSTER;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		return err == -ENOENT ? -EAGAIN : err;
+
+	if (dn.data_blkaddr != COMPRESS_ADDR) {
+		f2fs_put_dnode(&dn);
+		return -EAGAIN;
+	}
+
+	for (i = 1; i < cc->cluster_size; i++) {
+		block_t blkaddr = datablock_addr(inode, dn.node_page,
+							dn.ofs_in_node + i);
+
+		if (!__is_valid_data_blkaddr(blkaddr))
+			break;
+		if (!f2fs_is_valid_blkaddr(sbi, blkaddr, DATA_GENERIC)) {
+			err = -EFSCORRUPTED;
+			break;
+		}
+		cc->cblkaddr[nr_cblocks++] = blkaddr;
+	}
+	f2fs_put_dnode(&dn);
+
+	if (!err && !nr_cblocks)
+		err = -EFSCORRUPTED;
+	if (err)
+		goto corrupted;
+
+	err = f2fs_read_compressed_blocks(cc, nr_cblocks);
+	if (err)
+		return err;
+
+	clen = le32_to_cpu(cc->cbuf->clen);
+	if (clen > (nr_cblocks << PAGE_SHIFT) - COMPRESS_HEADER_SIZE ||
+			le32_to_cpu(cc->cbuf->chksum) !=
+			f2fs_crc32(sbi, cc->cbuf->cdata, clen)) {
+		err = -EFSCORRUPTED;
+		goto corrupted;
+	}
+
+	if (cc->cops->init_decompress_ctx && !cc->dprivate) {
+		err = cc->cops->init_decompress_ctx(cc);
+		if (err)
+			return err;
+	}
+
+	cc->clen = clen;
+	cc->rlen = size;
+	err = cc->cops->decompress_pages(cc);
+	if (err)
+		return err;
+
+	memset(cc->rbuf + cc->rlen, 0, size - cc->rlen);
+	cc->cluster_idx = start >> cc->log_cluster_size;
+	return 0;
+
+corrupted:
+	f2fs_msg(sbi->sb, KERN_WARNING,
+		"%s: corrupted compressed cluster, ino:%lu, index:%lu",
+		__func__, inode->i_ino, start);
+	set_sbi_flag(sbi, SBI_NEED_FSCK);
+	return err;
+}
+
+static void f2fs_copy_cluster_page(struct compress_ctx *cc, struct page *page)
+{
+	unsigned int ofs = (page->index & (cc->cluster_size - 1)) << PAGE_SHIFT;
+	void *kaddr;
+
+	kaddr = kmap_atomic(page);
+	memcpy(kaddr, cc->rbuf + ofs, PAGE_SIZE);
+	kunmap_atomic(kaddr);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+}
+
+/* populate the pages of a freshly decompressed cluster nobody cached yet */
+static void f2fs_fill_cluster_pages(struct compress_ctx *cc, pgoff_t start,
+							struct page *page)
+{
+	struct address_space *mapping = cc->inode->i_mapping;
+	unsigned int nr_pages = cluster_nr_pages(cc, start);
+	unsigned int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *cpage;
+
+		if (start + i == page->index)
+			continue;
+
+		cpage = pagecache_get_page(mapping, start + i,
+				FGP_LOCK | FGP_CREAT | FGP_NOWAIT,
+				readahead_gfp_mask(mapping));
+		if (!cpage)
+			continue;
+
+		if (!PageUptodate(cpage))
+			f2fs_copy_cluster_page(cc, cpage);
+		f2fs_put_page(cpage, 1);
+	}
+}
+
+/*
+ * Fill @page from its compressed cluster.  On success the page is uptodate
+ * and unlocked; otherwise it is left locked and untouched, and -EAGAIN tells
+ * the caller that the cluster is stored raw.
+ */
+int f2fs_read_cluster_page(struct compress_ctx *cc, struct page *page)
+{
+	struct compress_ctx *tmp = NULL;
+	pgoff_t start;
+	int err = 0;
+
+	if (!cc) {
+		cc = tmp = f2fs_alloc_compress_ctx(page->mapping->host);
+		if (!cc)
+			return -ENOMEM;
+	}
+
+	start = cluster_start(cc, page->index);
+	if (cc->cluster_idx != start >> cc->log_cluster_size) {
+		err = f2fs_load_cluster(cc, start);
+		if (err)
+			goto out;
+		f2fs_fill_cluster_pages(cc, start, page);
+	}
+
+	f2fs_copy_cluster_page(cc, page);
+	unlock_page(page);
+out:
+	f2fs_free_compress_ctx(tmp);
+	return err;
+}
+
+/*
+ * Writing into a compressed cluster rewrites it as a whole at writeback time,
+ * possibly in the raw layout, so reserve its holes up front: writeback then
+ * never needs more blocks than the cluster is already charged for.
+ */
+int f2fs_prepare_compress_overwrite(struct inode *inode, pgoff_t index)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	struct dnode_of_data dn;
+	blkcnt_t count = 0;
+	unsigned int i;
+	int err;
+
+	f2fs_lock_op(sbi);
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, round_down(index, cluster_size),
+							LOOKUP_NODE);
+	if (err) {
+		if (err == -ENOENT)
+			err = 0;
+		goto out;
+	}
+
+	if (dn.data_blkaddr == COMPRESS_ADDR) {
+		for (i = 1; i < cluster_size; i++)
+			if (datablock_addr(inode, dn.node_page,
+					dn.ofs_in_node + i) == NULL_ADDR)
+				count++;
+		dn.ofs_in_node++;
+		err = reserve_new_blocks(&dn, count);
+	}
+	f2fs_put_dnode(&dn);
+out:
+	f2fs_unlock_op(sbi);
+	return err;
+}
+
+static void f2fs_unlock_cluster(struct compress_ctx *cc,
+				unsigned int nr_pages, struct page *keep)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = cc->rpages[i];
+
+		if (!page)
+			continue;
+		if (page == keep)
+			put_page(page);
+		else
+			f2fs_put_page(page, 1);
+		cc->rpages[i] = NULL;
+	}
+}
+
+/* lock all pages of the cluster in index order, creating them if asked */
+static int f2fs_lock_cluster(struct compress_ctx *cc, pgoff_t start,
+					unsigned int nr_pages, bool create)
+{
+	struct address_space *mapping = cc->inode->i_mapping;
+	unsigned int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page;
+
+		if (create)
+			page = f2fs_pagecache_get_page(mapping, start + i,
+					FGP_LOCK | FGP_CREAT, GFP_NOFS);
+		else
+			page = find_lock_page(mapping, start + i);
+		if (!page)
+			goto fail;
+
+		cc->rpages[i] = page;
+		f2fs_wait_on_page_writeback(page, DATA, true);
+	}
+
+	/* racing with truncate, have the caller try again */
+	if (cluster_nr_pages(cc, start) == nr_pages)
+		return 0;
+	f2fs_unlock_cluster(cc, nr_pages, NULL);
+	return -EAGAIN;
+fail:
+	f2fs_unlock_cluster(cc, nr_pages, NULL);
+	return create ? -ENOMEM : -EAGAIN;
+}
+
+static int f2fs_compress_cluster(struct compress_ctx *cc)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
+	int err;
+
+	if (!cc->private) {
+		err = cc->cops->init_compress_ctx(cc);
+		if (err)
+			return err;
+	}
+
+	err = cc->cops->compress_pages(cc);
+	if (err)
+		return err;
+
+	cc->cbuf->clen = cpu_to_le32(cc->clen);
+	cc->cbuf->chksum = cpu_to_le32(f2fs_crc32(sbi, cc->cbuf->cdata,
+								cc->clen));
+	memset(cc->cbuf->reserved, 0, sizeof(cc->cbuf->reserved));
+	return 0;
+}
+
+/* count charged addresses of the cluster and validate them */
+static int f2fs_scan_cluster(struct compress_ctx *cc, struct dnode_of_data *dn,
+			unsigned int *charged, unsigned int *nr_cblocks)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
+	bool compressed = false;
+	unsigned int i;
+
+	*charged = 0;
+	*nr_cblocks = 0;
+
+	for (i = 0; i < cc->cluster_size; i++) {
+		block_t blkaddr = datablock_addr(dn->inode, dn->node_page,
+							dn->ofs_in_node + i);
+
+		if (blkaddr == NULL_ADDR)
+			continue;
+		(*charged)++;
+
+		if (!i && blkaddr == COMPRESS_ADDR) {
+			compressed = true;
+			continue;
+		}
+		if (!__is_valid_data_blkaddr(blkaddr))
+			continue;
+		if (!f2fs_is_valid_blkaddr(sbi, blkaddr, DATA_GENERIC))
+			return -EFSCORRUPTED;
+		if (compressed)
+			(*nr_cblocks)++;
+	}
+	return 0;
+}
+
+/* charge the cluster for @nr_blocks addresses, all or nothing */
+static int f2fs_charge_cluster_blocks(struct inode *inode,
+				unsigned int charged, unsigned int nr_blocks)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	blkcnt_t count, want;
+	int err;
+
+	if (nr_blocks <= charged)
+		return 0;
+
+	count = want = nr_blocks - charged;
+	err = inc_valid_block_count(sbi, inode, &count);
+	if (err)
+		return err;
+	if (count < want) {
+		dec_valid_block_count(sbi, inode, count);
+		return -ENOSPC;
+	}
+	return 0;
+}
+
+static void f2fs_update_compressed_blocks(struct inode *inode, pgoff_t start,
+				unsigned int nr_pages, long long diff)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	loff_t psize = (loff_t)(start + nr_pages) << PAGE_SHIFT;
+
+	down_write(&fi->i_sem);
+	if (fi->last_disk_size < psize)
+		fi->last_disk_size = psize;
+	up_write(&fi->i_sem);
+
+	f2fs_i_compr_blocks_update(inode, diff);
+}
+
+static int f2fs_write_compressed_cluster(struct compress_ctx *cc,
+				pgoff_t start, unsigned int nr_pages,
+				bool *submitted, struct writeback_control *wbc,
+				enum iostat_type io_type)
+{
+	struct inode *inode = cc->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int nr_cpages = DIV_ROUND_UP(cc->clen + COMPRESS_HEADER_SIZE,
+								PAGE_SIZE);
+	struct f2fs_io_info fio = {
+		.sbi = sbi,
+		.ino = inode->i_ino,
+		.type = DATA,
+		.op = REQ_OP_WRITE,
+		.op_flags = wbc_to_write_flags(wbc),
+		.page = cc->rpages[0],
+		.submitted = false,
+		.need_lock = LOCK_DONE,
+		.io_type = io_type,
+		.io_wbc = wbc,
+	};
+	struct compress_io_ctx *cic;
+	struct dnode_of_data dn;
+	struct node_info ni;
+	unsigned int charged, nr_cblocks, nr_dirty = 0, ofs, i;
+	int err;
+
+	cic = f2fs_kzalloc(sbi, sizeof(struct compress_io_ctx) +
+				sizeof(struct page *) * nr_pages, GFP_NOFS);
+	if (!cic)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_cpages; i++) {
+		size_t len = min_t(size_t, PAGE_SIZE, cc->clen +
+				COMPRESS_HEADER_SIZE - (i << PAGE_SHIFT));
+		u8 *dst;
+
+		cc->cpages[i] = alloc_page(GFP_NOFS);
+		if (!cc->cpages[i]) {
+			err = -ENOMEM;
+			goto out_free;
+		}
+		dst = page_address(cc->cpages[i]);
+		memcpy(dst, (u8 *)cc->cbuf + (i << PAGE_SHIFT), len);
+		memset(dst + len, 0, PAGE_SIZE - len);
+	}
+
+	/* Deadlock due to between page->lock and f2fs_lock_op */
+	if (!f2fs_trylock_op(sbi)) {
+		err = -EAGAIN;
+		goto out_free;
+	}
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, start, ALLOC_NODE);
+	if (err)
+		goto out_unlock_op;
+
+	err = get_node_info(sbi, dn.nid, &ni);
+	if (err)
+		goto out_put_dnode;
+
+	err = f2fs_scan_cluster(cc, &dn, &charged, &nr_cblocks);
+	if (err)
+		goto out_put_dnode;
+
+	err = f2fs_charge_cluster_blocks(inode, charged, 1 + nr_cpages);
+	if (err)
+		goto out_put_dnode;
+
+	cic->magic = F2FS_COMPRESSED_PAGE_MAGIC;
+	cic->inode = inode;
+	cic->nr_rpages = nr_pages;
+	atomic_set(&cic->pending_pages, nr_cpages);
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = cc->rpages[i];
+
+		if (clear_page_dirty_for_io(page)) {
+			inode_dec_dirty_pages(inode);
+			nr_dirty++;
+		}
+		set_page_writeback(page);
+		ClearPageError(page);
+		cic->rpages[i] = page;
+	}
+
+	ofs = dn.ofs_in_node;
+
+	/* the head address marks the cluster as compressed */
+	if (__is_valid_data_blkaddr(dn.data_blkaddr))
+		invalidate_blocks(sbi, dn.data_blkaddr);
+	if (dn.data_blkaddr != COMPRESS_ADDR)
+		f2fs_update_data_blkaddr(&dn, COMPRESS_ADDR);
+
+	for (i = 0; i < nr_cpages; i++) {
+		block_t blkaddr;
+
+		dn.ofs_in_node = ofs + 1 + i;
+		blkaddr = datablock_addr(inode, dn.node_page, dn.ofs_in_node);
+		if (blkaddr == NULL_ADDR)
+			blkaddr = NEW_ADDR;
+
+		SetPagePrivate(cc->cpages[i]);
+		set_page_private(cc->cpages[i], (unsigned long)cic);
+
+		dn.data_blkaddr = blkaddr;
+		fio.old_blkaddr = blkaddr;
+		fio.encrypted_page = cc->cpages[i];
+		fio.version = ni.version;
+		cc->cpages[i] = NULL;
+
+		/* LFS mode write path */
+		write_data_page(&dn, &fio);
+	}
+
+	for (i = 1 + nr_cpages; i < cc->cluster_size; i++) {
+		block_t blkaddr;
+
+		dn.ofs_in_node = ofs + i;
+		blkaddr = datablock_addr(inode, dn.node_page, dn.ofs_in_node);
+		if (blkaddr == NULL_ADDR)
+			continue;
+
+		invalidate_blocks(sbi, blkaddr);
+		f2fs_update_data_blkaddr(&dn, NULL_ADDR);
+	}
+
+	if (charged > 1 + nr_cpages)
+		dec_valid_block_count(sbi, inode, charged - 1 - nr_cpages);
+
+	f2fs_put_dnode(&dn);
+	f2fs_unlock_op(sbi);
+
+	set_inode_flag(inode, FI_APPEND_WRITE);
+	if (start == 0)
+		set_inode_flag(inode, FI_FIRST_BLOCK_WRITTEN);
+	f2fs_update_compressed_blocks(inode, start, nr_pages,
+				(long long)nr_cpages - nr_cblocks);
+
+	atomic64_add(nr_cpages, &sbi->compr_written_block);
+	atomic64_add(nr_pages - nr_cpages, &sbi->compr_saved_block);
+
+	/* the caller accounts for the page it handed over */
+	if (nr_dirty > 1)
+		wbc->nr_to_write -= nr_dirty - 1;
+	*submitted = fio.submitted;
+
+	f2fs_unlock_cluster(cc, nr_pages, NULL);
+	return 0;
+
+out_put_dnode:
+	f2fs_put_dnode(&dn);
+out_unlock_op:
+	f2fs_unlock_op(sbi);
+out_free:
+	for (i = 0; i < nr_cpages; i++) {
+		if (cc->cpages[i])
+			__free_page(cc->cpages[i]);
+		cc->cpages[i] = NULL;
+	}
+	kfree(cic);
+	return err;
+}
+
+/* rewrite a compressed cluster whose data does not shrink anymore as raw */
+static int f2fs_write_raw_cluster(struct compress_ctx *cc, pgoff_t start,
+				unsigned int nr_pages, bool *submitted,
+				struct writeback_control *wbc,
+				enum iostat_type io_type)
+{
+	struct inode *inode = cc->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct dnode_of_data dn;
+	unsigned int charged, nr_cblocks, nr_dirty = 0, ofs, i;
+	int err;
+
+	if (!f2fs_trylock_op(sbi))
+		return -EAGAIN;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		goto out;
+
+	err = f2fs_scan_cluster(cc, &dn, &charged, &nr_cblocks);
+	if (!err)
+		err = f2fs_charge_cluster_blocks(inode, charged, nr_pages);
+	if (err) {
+		f2fs_put_dnode(&dn);
+		goto out;
+	}
+
+	ofs = dn.ofs_in_node;
+	for (i = 0; i < cc->cluster_size; i++) {
+		block_t blkaddr;
+
+		dn.ofs_in_node = ofs + i;
+		blkaddr = datablock_addr(inode, dn.node_page, dn.ofs_in_node);
+
+		if (i < nr_pages) {
+			if (blkaddr == NULL_ADDR || blkaddr == COMPRESS_ADDR)
+				f2fs_update_data_blkaddr(&dn, NEW_ADDR);
+		} else if (blkaddr != NULL_ADDR) {
+			invalidate_blocks(sbi, blkaddr);
+			f2fs_update_data_blkaddr(&dn, NULL_ADDR);
+		}
+	}
+
+	if (charged > nr_pages)
+		dec_valid_block_count(sbi, inode, charged - nr_pages);
+	f2fs_put_dnode(&dn);
+
+	f2fs_update_compressed_blocks(inode, start, nr_pages,
+					-(long long)nr_cblocks);
+
+	/* the layout is raw now, so leftovers are written back as usual */
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = cc->rpages[i];
+		struct f2fs_io_info fio = {
+			.sbi = sbi,
+			.ino = inode->i_ino,
+			.type = DATA,
+			.op = REQ_OP_WRITE,
+			.op_flags = wbc_to_write_flags(wbc),
+			.old_blkaddr = NULL_ADDR,
+			.page = page,
+			.encrypted_page = NULL,
+			.submitted = false,
+			.need_lock = LOCK_DONE,
+			.io_type = io_type,
+			.io_wbc = wbc,
+		};
+		bool dirty;
+
+		if (err) {
+			set_page_dirty(page);
+			continue;
+		}
+
+		dirty = clear_page_dirty_for_io(page);
+		err = do_write_data_page(&fio);
+		if (err) {
+			if (dirty)
+				redirty_page_for_writepage(wbc, page);
+			else
+				set_page_dirty(page);
+			continue;
+		}
+
+		if (dirty) {
+			inode_dec_dirty_pages(inode);
+			nr_dirty++;
+		}
+		if (fio.submitted)
+			*submitted = true;
+	}
+out:
+	f2fs_unlock_op(sbi);
+
+	if (nr_dirty > 1)
+		wbc->nr_to_write -= nr_dirty - 1;
+	return err;
+}
+
+/*
+ * Write back the cluster of the locked dirty @page.  Returns 1 with @page
+ * still locked when the caller should write it out as a regular page;
+ * otherwise @page has been unlocked, and -EAGAIN asks the caller to retry.
+ */
+int f2fs_write_cluster(struct compress_ctx *cc, struct page *page,
+			bool *submitted, struct writeback_control *wbc,
+			enum iostat_type io_type)
+{
+	struct inode *inode = cc->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct address_space *mapping = inode->i_mapping;
+	pgoff_t start = cluster_start(cc, page->index);
+	pgoff_t cluster = start >> cc->log_cluster_size;
+	unsigned int nr_pages, offset, i;
+	bool compressed, dirty = false;
+	loff_t i_size;
+	int ret;
+
+	if (unlikely(f2fs_cp_error(sbi) ||
+			is_sbi_flag_set(sbi, SBI_POR_DOING)))
+		return 1;
+	if (cluster == cc->skip_cluster)
+		return 1;
+
+	/* pages beyond EOF are dropped by the regular path */
+	nr_pages = cluster_nr_pages(cc, start);
+	if (page->index >= start + nr_pages)
+		return 1;
+
+	ret = f2fs_is_compressed_cluster(inode, start);
+	if (ret < 0)
+		goto out_unlock_page;
+	compressed = ret;
+
+	if (!compressed) {
+		if (nr_pages < 2)
+			return 1;
+
+		/* cheap check first: only compress fully dirty raw clusters */
+		for (i = 0; i < nr_pages; i++) {
+			struct page *rpage = find_get_page(mapping, start + i);
+
+			dirty = rpage && PageDirty(rpage);
+			f2fs_put_page(rpage, 0);
+			if (!dirty)
+				break;
+		}
+		if (!dirty) {
+			cc->skip_cluster = cluster;
+			return 1;
+		}
+	}
+
+	ret = f2fs_prepare_cluster_buffers(cc);
+	if (ret) {
+		if (!compressed)
+			return 1;
+		goto out_unlock_page;
+	}
+
+	unlock_page(page);
+	ret = f2fs_lock_cluster(cc, start, nr_pages, compressed);
+	if (ret)
+		return ret;
+
+	dirty = false;
+	for (i = 0; i < nr_pages; i++) {
+		struct page *rpage = cc->rpages[i];
+
+		if (PageDirty(rpage) && PageUptodate(rpage)) {
+			dirty = true;
+		} else if (!compressed) {
+			dirty = false;
+			break;
+		}
+	}
+
+	if (!compressed) {
+		/* @page was truncated while unlocked */
+		if (cc->rpages[page->index - start] != page) {
+			ret = 0;
+			goto out_unlock;
+		}
+		if (!dirty) {
+			cc->skip_cluster = cluster;
+			f2fs_unlock_cluster(cc, nr_pages, page);
+			return 1;
+		}
+	} else {
+		if (!dirty) {
+			ret = 0;
+			goto out_unlock;
+		}
+
+		for (i = 0; i < nr_pages; i++) {
+			if (PageUptodate(cc->rpages[i]))
+				continue;
+			if (cc->cluster_idx != cluster) {
+				ret = f2fs_load_cluster(cc, start);
+				if (ret)
+					goto out_unlock;
+			}
+			f2fs_copy_cluster_page(cc, cc->rpages[i]);
+		}
+	}
+
+	/* as the regular path does, zero the part of the EOF page past i_size */
+	i_size = i_size_read(inode);
+	offset = i_size & (PAGE_SIZE - 1);
+	if (offset && start + nr_pages - 1 == (pgoff_t)(i_size >> PAGE_SHIFT))
+		zero_user_segment(cc->rpages[nr_pages - 1], offset, PAGE_SIZE);
+
+	for (i = 0; i < nr_pages; i++) {
+		void *kaddr = kmap_atomic(cc->rpages[i]);
+
+		memcpy(cc->rbuf + (i << PAGE_SHIFT), kaddr, PAGE_SIZE);
+		kunmap_atomic(kaddr);
+	}
+	cc->cluster_idx = NULL_CLUSTER;
+	cc->rlen = nr_pages << PAGE_SHIFT;
+
+	/* compression has to save at least one block to be worth it */
+	ret = -EAGAIN;
+	if (nr_pages > 1) {
+		cc->clen = ((nr_pages - 1) << PAGE_SHIFT) -
+						COMPRESS_HEADER_SIZE;
+		ret = f2fs_compress_cluster(cc);
+	}
+
+	if (!ret) {
+		ret = f2fs_write_compressed_cluster(cc, start, nr_pages,
+						submitted, wbc, io_type);
+		if (ret)
+			goto out_unlock;
+	} else if (compressed) {
+		ret = f2fs_write_raw_cluster(cc, start, nr_pages,
+						submitted, wbc, io_type);
+		f2fs_unlock_cluster(cc, nr_pages, NULL);
+	} else {
+		cc->skip_cluster = cluster;
+		f2fs_unlock_cluster(cc, nr_pages, page);
+		return 1;
+	}
+
+	f2fs_balance_fs(sbi, true);
+	return ret;
+
+out_unlock:
+	f2fs_unlock_cluster(cc, nr_pages, NULL);
+	return ret;
+out_unlock_page:
+	unlock_page(page);
+	return ret;
+}
+
+bool f2fs_is_compressed_page(struct page *page)
+{
+	if (!PagePrivate(page) || page->mapping)
+		return false;
+	if (IS_ATOMIC_WRITTEN_PAGE(page) || IS_DUMMY_WRITTEN_PAGE(page))
+		return false;
+	return *((u32 *)page_private(page)) == F2FS_COMPRESSED_PAGE_MAGIC;
+}
+
+struct page *f2fs_compress_control_page(struct page *page)
+{
+	return ((struct compress_io_ctx *)page_private(page))->rpages[0];
+}
+
+void f2fs_compress_write_end_io(struct bio *bio, struct page *page)
+{
+	struct f2fs_sb_info *sbi = bio->bi_private;
+	struct compress_io_ctx *cic =
+			(struct compress_io_ctx *)page_private(page);
+	unsigned int i;
+
+	if (unlikely(bio->bi_status))
+		mapping_set_error(cic->inode->i_mapping, -EIO);
+
+	dec_page_count(sbi, F2FS_WB_DATA);
+
+	set_page_private(page, (unsigned long)NULL);
+	ClearPagePrivate(page);
+	__free_page(page);
+
+	if (atomic_dec_return(&cic->pending_pages))
+		return;
+
+	for (i = 0; i < cic->nr_rpages; i++) {
+		clear_cold_data(cic->rpages[i]);
+		end_page_writeback(cic->rpages[i]);
+	}
+	kfree(cic);
+}
+
+/*
+ * Truncating inside a compressed cluster would free blocks still holding the
+ * compressed data of the pages kept, so rewrite the cluster against the new
+ * i_size first.  Returns 1 once the EOF page has been zeroed and written.
+ */
+int f2fs_truncate_partial_cluster(struct inode *inode, u64 from)
+{
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	pgoff_t index = (pgoff_t)F2FS_BLK_ALIGN(from);
+	pgoff_t start = round_down(index, cluster_size);
+	unsigned int offset = from & (PAGE_SIZE - 1);
+	struct page *page;
+	int err;
+
+	if (index == start)
+		return 0;
+
+	err = f2fs_is_compressed_cluster(inode, start);
+	if (err <= 0)
+		return err;
+
+	page = get_lock_data_page(inode, index - 1, true);
+	if (IS_ERR(page))
+		return PTR_ERR(page) == -ENOENT ? 0 : PTR_ERR(page);
+
+	f2fs_wait_on_page_writeback(page, DATA, true);
+	if (offset)
+		zero_user(page, offset, PAGE_SIZE - offset);
+	set_page_dirty(page);
+	f2fs_put_page(page, 1);
+
+	err = filemap_write_and_wait_range(inode->i_mapping,
+			(loff_t)start << PAGE_SHIFT,
+			((loff_t)(start + cluster_size) << PAGE_SHIFT) - 1);
+	return err ? err : 1;
+}
@@ -188,6 +188,11 @@ static void f2fs_write_end_io(struct bio *bio)
 			continue;
 		}
 
+		if (f2fs_is_compressed_page(page)) {
+			f2fs_compress_write_end_io(bio, page);
+			continue;
+		}
+
 		fscrypt_pullback_bio_page(&page, true);
 
 		if (unlikely(bio->bi_status)) {
@@ -361,13 +366,20 @@ static bool __has_merged_page(struct f2fs_bio_info *io,
 		return true;
 
 	bio_for_each_segment_all(bvec, io->bio, i) {
+		pgoff_t index = idx;
 
-		if (bvec->bv_page->mapping)
+		if (bvec->bv_page->mapping) {
 			target = bvec->bv_page;
-		else
+		} else if (f2fs_is_compressed_page(bvec->bv_page)) {
+			/* a cluster's bounce pages all carry its first page */
+			target = f2fs_compress_control_page(bvec->bv_page);
+			index = round_down(idx,
+				F2FS_I(target->mapping->host)->i_cluster_size);
+		} else {
 			target = fscrypt_control_page(bvec->bv_page);
+		}
 
-		if (idx != target->index)
+		if (index != target->index)
 			continue;
 
 		if (inode && inode == target->mapping->host)
@@ -791,6 +803,14 @@ struct page *get_read_data_page(struct inode *inode, pgoff_t index,
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
+	if (f2fs_compressed_file(inode) && !PageUptodate(page)) {
+		err = f2fs_read_cluster_page(NULL, page);
+		if (!err)
+			return page;
+		if (err != -EAGAIN)
+			goto put_err;
+	}
+
 	if (f2fs_lookup_extent_cache(inode, index, &ei)) {
 		dn.data_blkaddr = ei.blk + index - ei.fofs;
 		goto got_it;
@@ -1437,6 +1457,10 @@ int f2fs_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 	u32 flags = 0;
 	int ret = 0;
 
+	/* there is no physical extent for the pages of a compressed cluster */
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	if (fieinfo->fi_flags & FIEMAP_FLAG_CACHE) {
 		ret = f2fs_precache_extents(inode);
 		if (ret)
@@ -1538,9 +1562,13 @@ int f2fs_mpage_readpages(struct address_space *mapping,
 	sector_t last_block_in_file;
 	sector_t block_nr;
 	struct f2fs_map_blocks map;
+	struct compress_ctx *cc = NULL;
 	bool bio_encrypted;
 	u64 dun;
 
+	if (f2fs_compressed_file(inode))
+		cc = f2fs_alloc_compress_ctx(inode);
+
 	map.m_pblk = 0;
 	map.m_lblk = 0;
 	map.m_len = 0;
@@ -1561,6 +1589,16 @@ int f2fs_mpage_readpages(struct address_space *mapping,
 				goto next_page;
 		}
 
+		/* compressed clusters are decoded synchronously, cluster by cluster */
+		if (f2fs_compressed_file(inode)) {
+			int err = f2fs_read_cluster_page(cc, page);
+
+			if (!err)
+				goto next_page;
+			if (err != -EAGAIN)
+				goto set_error_page;
+		}
+
 		block_in_file = (sector_t)page->index;
 		last_block = block_in_file + nr_pages;
 		last_block_in_file = (f2fs_readpage_limit(inode) + blocksize - 1) >>
@@ -1671,6 +1709,7 @@ int f2fs_mpage_readpages(struct address_space *mapping,
 	BUG_ON(pages && !list_empty(pages));
 	if (bio)
 		__submit_bio(F2FS_I_SB(inode), bio, DATA);
+	f2fs_free_compress_ctx(cc);
 	return 0;
 }
 
@@ -2060,6 +2099,15 @@ static int __write_data_page(struct page *page, bool *submitted,
 static int f2fs_write_data_page(struct page *page,
 					struct writeback_control *wbc)
 {
+	struct inode *inode = page->mapping->host;
+
+	/* compressed clusters are only rewritten as a whole by ->writepages */
+	if (f2fs_compressed_file(inode) &&
+			f2fs_is_compressed_cluster(inode, page->index)) {
+		redirty_page_for_writepage(wbc, page);
+		return AOP_WRITEPAGE_ACTIVATE;
+	}
+
 	return __write_data_page(page, NULL, wbc, FS_DATA_IO);
 }
 
@@ -2084,6 +2132,13 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 	int cycled;
 	int range_whole = 0;
 	int tag;
+	struct compress_ctx *cc = NULL;
+
+	if (f2fs_compressed_file(mapping->host)) {
+		cc = f2fs_alloc_compress_ctx(mapping->host);
+		if (!cc)
+			return -ENOMEM;
+	}
 
 	pagevec_init(&pvec, 0);
 
@@ -2157,10 +2212,18 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 			}
 
 			BUG_ON(PageWriteback(page));
-			if (!clear_page_dirty_for_io(page))
-				goto continue_unlock;
 
-			ret = __write_data_page(page, &submitted, wbc, io_type);
+			ret = 1;
+			if (cc)
+				ret = f2fs_write_cluster(cc, page, &submitted,
+							wbc, io_type);
+			if (ret == 1) {
+				if (!clear_page_dirty_for_io(page))
+					goto continue_unlock;
+
+				ret = __write_data_page(page, &submitted, wbc,
+								io_type);
+			}
 			if (unlikely(ret)) {
 				/*
 				 * keep nr_to_write, since vfs uses this to
@@ -2212,6 +2275,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 		f2fs_submit_merged_write_cond(F2FS_M_SB(mapping), mapping->host,
 						0, last_idx, DATA);
 
+	f2fs_free_compress_ctx(cc);
 	return ret;
 }
 
@@ -2444,6 +2508,12 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 		if (err)
 			goto fail;
 	}
+
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_prepare_compress_overwrite(inode, index);
+		if (err)
+			goto fail;
+	}
 repeat:
 	/*
 	 * Do not use grab_cache_page_write_begin() to avoid deadlock due to
@@ -2485,6 +2555,24 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 		return 0;
 	}
 
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_read_cluster_page(NULL, page);
+		if (!err) {
+			lock_page(page);
+			if (unlikely(page->mapping != mapping)) {
+				f2fs_put_page(page, 1);
+				goto repeat;
+			}
+			if (unlikely(!PageUptodate(page))) {
+				err = -EIO;
+				goto fail;
+			}
+			return 0;
+		}
+		if (err != -EAGAIN)
+			goto fail;
+	}
+
 	if (blkaddr == NEW_ADDR) {
 		zero_user_segment(page, 0, PAGE_SIZE);
 		SetPageUptodate(page);
@@ -2725,7 +2813,7 @@ static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 {
 	struct inode *inode = mapping->host;
 
-	if (f2fs_has_inline_data(inode))
+	if (f2fs_has_inline_data(inode) || f2fs_compressed_file(inode))
 		return 0;
 
 	/* make sure allocating whole blocks */
@@ -98,6 +98,7 @@ extern char *fault_name[FAULT_MAX];
 #define F2FS_MOUNT_QUOTA		0x00400000
 #define F2FS_MOUNT_INLINE_XATTR_SIZE	0x00800000
 #define F2FS_MOUNT_RESERVE_ROOT		0x01000000
+#define F2FS_MOUNT_ATGC			0x02000000
 
 #define F2FS_OPTION(sbi)	((sbi)->mount_opt)
 #define clear_opt(sbi, option)	(F2FS_OPTION(sbi).opt &= ~F2FS_MOUNT_##option)
@@ -114,6 +115,18 @@ typedef u32 block_t;	/*
 			 */
 typedef u32 nid_t;
 
+/* For compression */
+enum compress_algorithm_type {
+	COMPRESS_LZO,		/* reserved */
+	COMPRESS_LZ4,
+	COMPRESS_ZSTD,
+	COMPRESS_MAX,
+};
+
+#define COMPRESS_EXT_NUM		16
+#define MIN_COMPRESS_LOG_SIZE		2
+#define MAX_COMPRESS_LOG_SIZE		8
+
 struct f2fs_mount_info {
 	unsigned int opt;
 	int write_io_size_bits;		/* Write IO size bits */
@@ -135,6 +148,12 @@ struct f2fs_mount_info {
 	int alloc_mode;			/* segment allocation policy */
 	int fsync_mode;			/* fsync policy */
 	bool test_dummy_encryption;	/* test dummy encryption */
+
+	/* For compression */
+	unsigned char compress_algorithm;	/* algorithm type */
+	unsigned compress_log_size;		/* cluster log size */
+	unsigned char compress_ext_cnt;		/* compress_extension count */
+	unsigned char extensions[COMPRESS_EXT_NUM][F2FS_EXTENSION_LEN];
 };
 
 #define F2FS_FEATURE_ENCRYPT		0x0001
@@ -148,6 +167,7 @@ struct f2fs_mount_info {
 #define F2FS_FEATURE_INODE_CRTIME	0x0100
 #define F2FS_FEATURE_LOST_FOUND		0x0200
 #define F2FS_FEATURE_VERITY		0x0400
+#define F2FS_FEATURE_COMPRESSION	0x2000
 
 #define F2FS_HAS_FEATURE(sb, mask)					\
 	((F2FS_SB(sb)->raw_super->feature & cpu_to_le32(mask)) != 0)
@@ -676,6 +696,12 @@ struct f2fs_inode_info {
 	int i_inline_xattr_size;	/* inline xattr size */
 	struct timespec i_crtime;	/* inode creation time */
 	struct timespec i_disk_time[4];	/* inode disk times */
+
+	/* for file compress */
+	atomic64_t i_compr_blocks;		/* # of compressed blocks */
+	unsigned char i_compress_algorithm;	/* algorithm type */
+	unsigned char i_log_cluster_size;	/* log of cluster size */
+	unsigned int i_cluster_size;		/* cluster size */
 };
 
 static inline void get_extent_info(struct extent_info *ext,
@@ -1098,6 +1124,18 @@ enum fsync_mode {
 	FSYNC_MODE_NOBARRIER,	/* fsync behaves nobarrier based on posix */
 };
 
+/* for age-threshold based GC (ATGC) victim selection */
+struct atgc_management {
+	struct rb_root root;			/* candidates sorted by age */
+	unsigned int victim_count;		/* # of candidates in root */
+	unsigned long long min_mtime;		/* oldest candidate mtime */
+	unsigned long long max_mtime;		/* youngest candidate mtime */
+	unsigned int candidate_ratio;		/* % of candidates to rank */
+	unsigned int max_candidate_count;	/* min. # of candidates to rank */
+	unsigned int age_weight;		/* % of age in the cost */
+	unsigned int age_threshold;		/* min. age (sec) of a victim */
+};
+
 #ifdef CONFIG_F2FS_FS_ENCRYPTION
 #define DUMMY_ENCRYPTION_ENABLED(sbi) \
 			(unlikely(F2FS_OPTION(sbi).test_dummy_encryption))
@@ -1222,9 +1260,18 @@ struct f2fs_sb_info {
 	u64 gc_pin_file_threshold;
 	struct rw_semaphore pin_sem;
 
+	/* for age-threshold based victim selection */
+	struct atgc_management am;
+
 	/* maximum # of trials to find a victim segment for SSR and GC */
 	unsigned int max_victim_search;
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	/* for compression statistics */
+	atomic64_t compr_written_block;		/* # of blocks written compressed */
+	atomic64_t compr_saved_block;		/* # of blocks saved by compression */
+#endif
+
 	/*
 	 * for stat information.
 	 * one is for the LFS mode, and the other is for the SSR mode.
@@ -2289,6 +2336,7 @@ enum {
 	FI_PIN_FILE,		/* indicate file should not be gced */
 	FI_ATOMIC_REVOKE_REQUEST, /* request to drop atomic data */
 	FI_VERITY_IN_PROGRESS,	/* building fs-verity Merkle tree */
+	FI_COMPRESSED_FILE,	/* indicate file's data can be compressed */
 };
 
 static inline void __mark_inode_dirty_flag(struct inode *inode,
@@ -2459,9 +2507,38 @@ static inline int f2fs_has_inline_xattr(struct inode *inode)
 	return is_inode_flag_set(inode, FI_INLINE_XATTR);
 }
 
+static inline int f2fs_compressed_file(struct inode *inode)
+{
+	return IS_ENABLED(CONFIG_F2FS_FS_COMPRESSION) &&
+		S_ISREG(inode->i_mode) &&
+		is_inode_flag_set(inode, FI_COMPRESSED_FILE);
+}
+
+static inline void f2fs_i_compr_blocks_update(struct inode *inode,
+						long long diff)
+{
+	if (!diff)
+		return;
+
+	atomic64_add(diff, &F2FS_I(inode)->i_compr_blocks);
+	f2fs_mark_inode_dirty_sync(inode, true);
+}
+
 static inline unsigned int addrs_per_inode(struct inode *inode)
 {
-	return CUR_ADDRS_PER_INODE(inode) - get_inline_xattr_addrs(inode);
+	unsigned int addrs = CUR_ADDRS_PER_INODE(inode) -
+				get_inline_xattr_addrs(inode);
+
+	if (!f2fs_compressed_file(inode))
+		return addrs;
+	return ALIGN_DOWN(addrs, F2FS_I(inode)->i_cluster_size);
+}
+
+static inline unsigned int addrs_per_block(struct inode *inode)
+{
+	if (!f2fs_compressed_file(inode))
+		return DEF_ADDRS_PER_BLOCK;
+	return ALIGN_DOWN(DEF_ADDRS_PER_BLOCK, F2FS_I(inode)->i_cluster_size);
 }
 
 static inline void *inline_xattr_addr(struct inode *inode, struct page *page)
@@ -2622,6 +2699,10 @@ static inline bool f2fs_may_extent_tree(struct inode *inode)
 	if (list_empty(&sbi->s_list))
 		return false;
 
+	/* block addresses of a compressed cluster are not contiguous */
+	if (f2fs_compressed_file(inode))
+		return false;
+
 	return S_ISREG(inode->i_mode);
 }
 
@@ -2728,7 +2809,8 @@ static inline void verify_blkaddr(struct f2fs_sb_info *sbi,
 
 static inline bool __is_valid_data_blkaddr(block_t blkaddr)
 {
-	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR)
+	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR ||
+			blkaddr == COMPRESS_ADDR)
 		return false;
 	return true;
 }
@@ -3051,6 +3133,8 @@ block_t start_bidx_of_node(unsigned int node_ofs, struct inode *inode);
 int f2fs_gc(struct f2fs_sb_info *sbi, bool sync, bool background,
 			unsigned int segno);
 void build_gc_manager(struct f2fs_sb_info *sbi);
+int __init create_garbage_collection_cache(void);
+void destroy_garbage_collection_cache(void);
 
 /*
  * recovery.c
@@ -3342,6 +3426,76 @@ void f2fs_unregister_sysfs(struct f2fs_sb_info *sbi);
 /* verity.c */
 extern const struct fsverity_operations f2fs_verityops;
 
+/*
+ * compress.c
+ */
+struct compress_ctx;
+
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+bool f2fs_is_compressed_page(struct page *page);
+struct page *f2fs_compress_control_page(struct page *page);
+void f2fs_compress_write_end_io(struct bio *bio, struct page *page);
+struct compress_ctx *f2fs_alloc_compress_ctx(struct inode *inode);
+void f2fs_free_compress_ctx(struct compress_ctx *cc);
+int f2fs_is_compressed_cluster(struct inode *inode, pgoff_t index);
+int f2fs_read_cluster_page(struct compress_ctx *cc, struct page *page);
+int f2fs_prepare_compress_overwrite(struct inode *inode, pgoff_t index);
+int f2fs_write_cluster(struct compress_ctx *cc, struct page *page,
+			bool *submitted, struct writeback_control *wbc,
+			enum iostat_type io_type);
+int f2fs_truncate_partial_cluster(struct inode *inode, u64 from);
+bool f2fs_compress_algorithm_supported(unsigned char algorithm);
+#else
+static inline bool f2fs_is_compressed_page(struct page *page)
+{
+	return false;
+}
+static inline struct page *f2fs_compress_control_page(struct page *page)
+{
+	WARN_ON_ONCE(1);
+	return ERR_PTR(-EINVAL);
+}
+static inline void f2fs_compress_write_end_io(struct bio *bio,
+							struct page *page)
+{
+	WARN_ON_ONCE(1);
+}
+static inline struct compress_ctx *f2fs_alloc_compress_ctx(struct inode *inode)
+{
+	return NULL;
+}
+static inline void f2fs_free_compress_ctx(struct compress_ctx *cc) { }
+static inline int f2fs_is_compressed_cluster(struct inode *inode,
+							pgoff_t index)
+{
+	return 0;
+}
+static inline int f2fs_read_cluster_page(struct compress_ctx *cc,
+							struct page *page)
+{
+	return -EAGAIN;
+}
+static inline int f2fs_prepare_compress_overwrite(struct inode *inode,
+							pgoff_t index)
+{
+	return 0;
+}
+static inline int f2fs_write_cluster(struct compress_ctx *cc,
+			struct page *page, bool *submitted,
+			struct writeback_control *wbc, enum iostat_type io_type)
+{
+	return 1;
+}
+static inline int f2fs_truncate_partial_cluster(struct inode *inode, u64 from)
+{
+	return 0;
+}
+static inline bool f2fs_compress_algorithm_supported(unsigned char algorithm)
+{
+	return false;
+}
+#endif
+
 /*
  * crypto support
  */
@@ -3365,11 +3519,13 @@ static inline void f2fs_set_encrypted_inode(struct inode *inode)
 
 /*
  * Returns true if the reads of the inode's data need to undergo some
- * postprocessing step, like decryption or authenticity verification.
+ * postprocessing step, like decryption, decompression or authenticity
+ * verification.
  */
 static inline bool f2fs_post_read_required(struct inode *inode)
 {
-	return f2fs_encrypted_file(inode) || fsverity_active(inode);
+	return f2fs_encrypted_file(inode) || fsverity_active(inode) ||
+		f2fs_compressed_file(inode);
 }
 
 #define F2FS_FEATURE_FUNCS(name, flagname) \
@@ -3388,6 +3544,7 @@ F2FS_FEATURE_FUNCS(quota_ino, QUOTA_INO);
 F2FS_FEATURE_FUNCS(inode_crtime, INODE_CRTIME);
 F2FS_FEATURE_FUNCS(lost_found, LOST_FOUND);
 F2FS_FEATURE_FUNCS(verity, VERITY);
+F2FS_FEATURE_FUNCS(compression, COMPRESSION);
 
 #ifdef CONFIG_BLK_DEV_ZONED
 static inline int get_blkz_type(struct f2fs_sb_info *sbi,
@@ -3441,7 +3598,37 @@ static inline bool f2fs_force_buffered_io(struct inode *inode, int rw)
 	return ((f2fs_encrypted_file(inode) &&
 		!fscrypt_using_hardware_encryption(inode)) ||
 			(rw == WRITE && test_opt(F2FS_I_SB(inode), LFS)) ||
-			f2fs_is_multi_device(F2FS_I_SB(inode)));
+			f2fs_is_multi_device(F2FS_I_SB(inode)) ||
+			f2fs_compressed_file(inode));
+}
+
+static inline bool f2fs_may_compress(struct inode *inode)
+{
+	if (IS_SWAPFILE(inode) || f2fs_is_pinned_file(inode) ||
+			f2fs_is_atomic_file(inode) ||
+			f2fs_is_volatile_file(inode))
+		return false;
+	return S_ISREG(inode->i_mode) && !f2fs_encrypted_inode(inode) &&
+			!IS_VERITY(inode) && !f2fs_verity_in_progress(inode);
+}
+
+static inline void set_compress_context(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+
+	F2FS_I(inode)->i_compress_algorithm =
+			F2FS_OPTION(sbi).compress_algorithm;
+	F2FS_I(inode)->i_log_cluster_size =
+			F2FS_OPTION(sbi).compress_log_size;
+	F2FS_I(inode)->i_cluster_size =
+			1 << F2FS_I(inode)->i_log_cluster_size;
+	F2FS_I(inode)->i_flags |= F2FS_COMPR_FL;
+	set_inode_flag(inode, FI_COMPRESSED_FILE);
+	if (f2fs_has_inline_data(inode)) {
+		stat_dec_inline_inode(inode);
+		clear_inode_flag(inode, FI_INLINE_DATA);
+	}
+	f2fs_mark_inode_dirty_sync(inode, true);
 }
 
 static inline bool f2fs_may_encrypt_bio(struct inode *inode,
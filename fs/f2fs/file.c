@@ -62,6 +62,12 @@ static int f2fs_vm_page_mkwrite(struct vm_fault *vmf)
 
 	f2fs_bug_on(sbi, f2fs_has_inline_data(inode));
 
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_prepare_compress_overwrite(inode, page->index);
+		if (err)
+			goto out;
+	}
+
 	/* block allocation */
 	f2fs_lock_op(sbi);
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
@@ -459,6 +465,10 @@ static loff_t f2fs_llseek(struct file *file, loff_t offset, int whence)
 	case SEEK_HOLE:
 		if (offset < 0)
 			return -ENXIO;
+		/* holes of compressed clusters don't map to file holes */
+		if (f2fs_compressed_file(inode))
+			return generic_file_llseek_size(file, offset, whence,
+						maxbytes, i_size_read(inode));
 		return f2fs_seek_block(file, offset, whence);
 	}
 
@@ -505,6 +515,8 @@ void truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 	struct f2fs_sb_info *sbi = F2FS_I_SB(dn->inode);
 	struct f2fs_node *raw_node;
 	int nr_free = 0, ofs = dn->ofs_in_node, len = count;
+	int nr_compr = 0;
+	bool compressed_cluster = false;
 	__le32 *addr;
 	int base = 0;
 
@@ -516,6 +528,12 @@ void truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 
 	for (; count > 0; count--, addr++, dn->ofs_in_node++) {
 		block_t blkaddr = le32_to_cpu(*addr);
+
+		/* clusters never straddle node pages, see addrs_per_block() */
+		if (f2fs_compressed_file(dn->inode) &&
+			!(dn->ofs_in_node % F2FS_I(dn->inode)->i_cluster_size))
+			compressed_cluster = (blkaddr == COMPRESS_ADDR);
+
 		if (blkaddr == NULL_ADDR)
 			continue;
 
@@ -527,6 +545,8 @@ void truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 			continue;
 
 		invalidate_blocks(sbi, blkaddr);
+		if (compressed_cluster && __is_valid_data_blkaddr(blkaddr))
+			nr_compr++;
 		if (dn->ofs_in_node == 0 && IS_INODE(dn->node_page))
 			clear_inode_flag(dn->inode, FI_FIRST_BLOCK_WRITTEN);
 		nr_free++;
@@ -541,6 +561,7 @@ void truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 		fofs = start_bidx_of_node(ofs_of_node(dn->node_page),
 							dn->inode) + ofs;
 		f2fs_update_extent_cache_range(dn, fofs, 0, len);
+		f2fs_i_compr_blocks_update(dn->inode, -nr_compr);
 		dec_valid_block_count(sbi, dn->inode, nr_free);
 	}
 	dn->ofs_in_node = ofs;
@@ -552,7 +573,7 @@ void truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 
 void truncate_data_blocks(struct dnode_of_data *dn)
 {
-	truncate_data_blocks_range(dn, ADDRS_PER_BLOCK);
+	truncate_data_blocks_range(dn, ADDRS_PER_BLOCK(dn->inode));
 }
 
 static int truncate_partial_data_page(struct inode *inode, u64 from,
@@ -605,6 +626,16 @@ int truncate_blocks(struct inode *inode, u64 from, bool lock)
 	if (free_from >= sbi->max_file_blocks)
 		goto free_partial;
 
+	if (lock && f2fs_compressed_file(inode)) {
+		err = f2fs_truncate_partial_cluster(inode, from);
+		if (err < 0)
+			goto out_err;
+		/* the EOF page has been zeroed along with its cluster */
+		if (err)
+			truncate_page = true;
+		err = 0;
+	}
+
 	if (lock)
 		f2fs_lock_op(sbi);
 
@@ -649,7 +680,7 @@ int truncate_blocks(struct inode *inode, u64 from, bool lock)
 	/* lastly zero out the first data page */
 	if (!err)
 		err = truncate_partial_data_page(inode, from, truncate_page);
-
+out_err:
 	trace_f2fs_truncate_blocks_exit(inode, err);
 	return err;
 }
@@ -990,7 +1021,8 @@ static int __read_out_blkaddrs(struct inode *inode, block_t *blkaddr,
 	} else if (ret == -ENOENT) {
 		if (dn.max_level == 0)
 			return -ENOENT;
-		done = min((pgoff_t)ADDRS_PER_BLOCK - dn.ofs_in_node, len);
+		done = min((pgoff_t)ADDRS_PER_BLOCK(inode) - dn.ofs_in_node,
+									len);
 		blkaddr += done;
 		do_replace += done;
 		goto next;
@@ -1139,7 +1171,7 @@ static int __exchange_data_block(struct inode *src_inode,
 	int ret;
 
 	while (len) {
-		olen = min((pgoff_t)4 * ADDRS_PER_BLOCK, len);
+		olen = min((pgoff_t)4 * ADDRS_PER_BLOCK(src_inode), len);
 
 		src_blkaddr = f2fs_kvzalloc(F2FS_I_SB(src_inode),
 					sizeof(block_t) * olen, GFP_KERNEL);
@@ -1571,6 +1603,10 @@ static long f2fs_fallocate(struct file *file, int mode,
 		(mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE)))
 		return -EOPNOTSUPP;
 
+	/* block addresses of compressed clusters can't be shifted or reserved */
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
 			FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_ZERO_RANGE |
 			FALLOC_FL_INSERT_RANGE))
@@ -1663,10 +1699,48 @@ static int f2fs_ioc_getflags(struct file *filp, unsigned long arg)
 	return put_user(flags, (int __user *)arg);
 }
 
+/*
+ * Compression can only be switched on an empty file: the block addresses of
+ * a compressed file can't be interpreted without it, and vice versa.
+ */
+static int f2fs_setflags_compress(struct inode *inode, bool set)
+{
+	struct f2fs_inode *ri;
+
+	if (!S_ISREG(inode->i_mode)) {
+		if (set && !f2fs_sb_has_compression(inode->i_sb))
+			return -EOPNOTSUPP;
+		return 0;
+	}
+
+	if (!set && !f2fs_compressed_file(inode))
+		return 0;
+	if (set && !f2fs_sb_has_compression(inode->i_sb))
+		return -EOPNOTSUPP;
+
+	if (i_size_read(inode) || F2FS_HAS_BLOCKS(inode) ||
+			get_dirty_pages(inode))
+		return -EINVAL;
+
+	if (!set) {
+		clear_inode_flag(inode, FI_COMPRESSED_FILE);
+		return 0;
+	}
+
+	if (!f2fs_may_compress(inode) || !f2fs_has_extra_attr(inode) ||
+			!F2FS_FITS_IN_INODE(ri, F2FS_I(inode)->i_extra_isize,
+							i_log_cluster_size))
+		return -EINVAL;
+
+	set_compress_context(inode);
+	return 0;
+}
+
 static int __f2fs_ioc_setflags(struct inode *inode, unsigned int flags)
 {
 	struct f2fs_inode_info *fi = F2FS_I(inode);
 	unsigned int oldflags;
+	int err;
 
 	/* Is it quota file? Do not allow user to mess with it */
 	if (IS_NOQUOTA(inode))
@@ -1682,6 +1756,12 @@ static int __f2fs_ioc_setflags(struct inode *inode, unsigned int flags)
 
 	flags = flags & (F2FS_FL_USER_MODIFIABLE | F2FS_PROJINHERIT_FL);
 	flags |= oldflags & ~(F2FS_FL_USER_MODIFIABLE | F2FS_PROJINHERIT_FL);
+
+	if ((flags ^ oldflags) & F2FS_COMPR_FL) {
+		err = f2fs_setflags_compress(inode, flags & F2FS_COMPR_FL);
+		if (err)
+			return err;
+	}
 	fi->i_flags = flags;
 
 	if (fi->i_flags & F2FS_PROJINHERIT_FL)
@@ -1735,7 +1815,7 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
-	if (!S_ISREG(inode->i_mode))
+	if (!S_ISREG(inode->i_mode) || f2fs_compressed_file(inode))
 		return -EINVAL;
 
 	ret = mnt_want_write_file(filp);
@@ -1835,7 +1915,7 @@ static int f2fs_ioc_start_volatile_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
-	if (!S_ISREG(inode->i_mode))
+	if (!S_ISREG(inode->i_mode) || f2fs_compressed_file(inode))
 		return -EINVAL;
 
 	ret = mnt_want_write_file(filp);
@@ -2344,7 +2424,8 @@ static int f2fs_ioc_defragment(struct file *filp, unsigned long arg)
 	if (!capable(CAP_SYS_ADMIN))
 		return -EPERM;
 
-	if (!S_ISREG(inode->i_mode) || f2fs_is_atomic_file(inode))
+	if (!S_ISREG(inode->i_mode) || f2fs_is_atomic_file(inode) ||
+			f2fs_compressed_file(inode))
 		return -EINVAL;
 
 	if (f2fs_readonly(sbi->sb))
@@ -2403,6 +2484,9 @@ static int f2fs_move_file_range(struct file *file_in, loff_t pos_in,
 	if (f2fs_encrypted_inode(src) || f2fs_encrypted_inode(dst))
 		return -EOPNOTSUPP;
 
+	if (f2fs_compressed_file(src) || f2fs_compressed_file(dst))
+		return -EOPNOTSUPP;
+
 	if (src == dst) {
 		if (pos_in == pos_out)
 			return 0;
@@ -2833,7 +2917,8 @@ static int f2fs_ioc_set_pin_file(struct file *filp, unsigned long arg)
 
 	inode_lock(inode);
 
-	if (should_update_outplace(inode, NULL)) {
+	if (should_update_outplace(inode, NULL) ||
+			(pin && f2fs_compressed_file(inode))) {
 		ret = -EINVAL;
 		goto out;
 	}
@@ -23,6 +23,8 @@
 #include "gc.h"
 #include <trace/events/f2fs.h>
 
+static struct kmem_cache *victim_entry_slab;
+
 static int gc_thread_func(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
@@ -158,9 +160,15 @@ void stop_gc_thread(struct f2fs_sb_info *sbi)
 	sbi->gc_thread = NULL;
 }
 
-static int select_gc_type(struct f2fs_gc_kthread *gc_th, int gc_type)
+static int select_gc_type(struct f2fs_sb_info *sbi, int gc_type)
 {
-	int gc_mode = (gc_type == BG_GC) ? GC_CB : GC_GREEDY;
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	int gc_mode;
+
+	if (gc_type == BG_GC)
+		gc_mode = test_opt(sbi, ATGC) ? GC_AT : GC_CB;
+	else
+		gc_mode = GC_GREEDY;
 
 	if (!gc_th)
 		return gc_mode;
@@ -170,6 +178,8 @@ static int select_gc_type(struct f2fs_gc_kthread *gc_th, int gc_type)
 			gc_mode = GC_CB;
 		else if (gc_th->gc_idle == 2)
 			gc_mode = GC_GREEDY;
+		else if (gc_th->gc_idle == 3 && gc_type == BG_GC)
+			gc_mode = GC_AT;
 	}
 	if (gc_th->gc_urgent)
 		gc_mode = GC_GREEDY;
@@ -187,7 +197,7 @@ static void select_policy(struct f2fs_sb_info *sbi, int gc_type,
 		p->max_search = dirty_i->nr_dirty[type];
 		p->ofs_unit = 1;
 	} else {
-		p->gc_mode = select_gc_type(sbi->gc_thread, gc_type);
+		p->gc_mode = select_gc_type(sbi, gc_type);
 		p->dirty_segmap = dirty_i->dirty_segmap[DIRTY];
 		p->max_search = dirty_i->nr_dirty[DIRTY];
 		p->ofs_unit = sbi->segs_per_sec;
@@ -215,7 +225,7 @@ static unsigned int get_max_cost(struct f2fs_sb_info *sbi,
 		return sbi->blocks_per_seg;
 	if (p->gc_mode == GC_GREEDY)
 		return 2 * sbi->blocks_per_seg * p->ofs_unit;
-	else if (p->gc_mode == GC_CB)
+	else if (p->gc_mode == GC_CB || p->gc_mode == GC_AT)
 		return UINT_MAX;
 	else /* No other gc_mode */
 		return 0;
@@ -244,22 +254,29 @@ static unsigned int check_bg_victims(struct f2fs_sb_info *sbi)
 	return NULL_SEGNO;
 }
 
-static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
+static unsigned long long get_section_mtime(struct f2fs_sb_info *sbi,
+						unsigned int segno)
 {
-	struct sit_info *sit_i = SIT_I(sbi);
 	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
 	unsigned int start = GET_SEG_FROM_SEC(sbi, secno);
 	unsigned long long mtime = 0;
-	unsigned int vblocks;
-	unsigned char age = 0;
-	unsigned char u;
 	unsigned int i;
 
 	for (i = 0; i < sbi->segs_per_sec; i++)
 		mtime += get_seg_entry(sbi, start + i)->mtime;
-	vblocks = get_valid_blocks(sbi, segno, true);
+	return div_u64(mtime, sbi->segs_per_sec);
+}
 
-	mtime = div_u64(mtime, sbi->segs_per_sec);
+static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned long long mtime;
+	unsigned int vblocks;
+	unsigned char age = 0;
+	unsigned char u;
+
+	mtime = get_section_mtime(sbi, segno);
+	vblocks = get_valid_blocks(sbi, segno, true);
 	vblocks = div_u64(vblocks, sbi->segs_per_sec);
 
 	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
@@ -289,6 +306,112 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 		return get_cb_cost(sbi, segno);
 }
 
+/*
+ * ATGC collects the scanned sections in an rb-tree ordered by age, oldest
+ * first, and only ranks the oldest ones once the scan is done: young
+ * sections are likely to be invalidated soon, so moving them is wasted
+ * work, however few valid blocks they have.
+ */
+static void atgc_add_victim(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct atgc_management *am = &sbi->am;
+	struct rb_node **p = &am->root.rb_node, *parent = NULL;
+	unsigned long long mtime = get_section_mtime(sbi, segno);
+	struct victim_entry *ve;
+
+	if (mtime < am->min_mtime)
+		am->min_mtime = mtime;
+	if (mtime > am->max_mtime)
+		am->max_mtime = mtime;
+
+	/* losing a candidate only makes the choice less accurate */
+	ve = kmem_cache_alloc(victim_entry_slab, GFP_NOFS);
+	if (!ve)
+		return;
+	ve->mtime = mtime;
+	ve->segno = segno;
+
+	while (*p) {
+		parent = *p;
+		if (mtime < rb_entry(parent, struct victim_entry,
+							rb_node)->mtime)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&ve->rb_node, parent, p);
+	rb_insert_color(&ve->rb_node, &am->root);
+	am->victim_count++;
+}
+
+static void atgc_lookup_victim(struct f2fs_sb_info *sbi,
+					struct victim_sel_policy *p)
+{
+	struct atgc_management *am = &sbi->am;
+	unsigned int sec_blocks = BLKS_PER_SEC(sbi);
+	unsigned int dirty_threshold = max(am->max_candidate_count,
+				am->candidate_ratio * am->victim_count / 100);
+	unsigned long long max_mtime = am->max_mtime;
+	unsigned long long total_time, accu;
+	unsigned int iter = 0;
+	struct rb_node *node;
+
+	if (!am->victim_count || max_mtime < am->min_mtime)
+		return;
+
+	/* normalize age and utilization to the same accuracy class */
+	total_time = max_mtime + 1 - am->min_mtime;
+	accu = div64_u64(ULLONG_MAX, total_time);
+	accu = min_t(unsigned long long, div_u64(accu, 100),
+					DEFAULT_ACCURACY_CLASS);
+
+	for (node = rb_first(&am->root); node; node = rb_next(node)) {
+		struct victim_entry *ve = rb_entry(node, struct victim_entry,
+								rb_node);
+		unsigned long long age, u;
+		unsigned int vblocks, cost;
+
+		/* the rest is younger still */
+		if (max_mtime - ve->mtime < am->age_threshold)
+			break;
+
+		age = div64_u64(accu * (max_mtime + 1 - ve->mtime),
+					total_time) * am->age_weight;
+		vblocks = get_valid_blocks(sbi, ve->segno, true);
+		u = div64_u64(accu * (sec_blocks - vblocks), sec_blocks) *
+					(100 - am->age_weight);
+		cost = UINT_MAX - (unsigned int)(age + u);
+
+		if (cost < p->min_cost ||
+				(cost == p->min_cost && age > p->oldest_age)) {
+			p->min_cost = cost;
+			p->oldest_age = age;
+			p->min_segno = ve->segno;
+		}
+
+		if (++iter >= dirty_threshold)
+			break;
+	}
+}
+
+static void atgc_release_victims(struct f2fs_sb_info *sbi)
+{
+	struct atgc_management *am = &sbi->am;
+	struct rb_node *node = rb_first(&am->root);
+
+	while (node) {
+		struct victim_entry *ve = rb_entry(node, struct victim_entry,
+								rb_node);
+
+		node = rb_next(node);
+		rb_erase(&ve->rb_node, &am->root);
+		kmem_cache_free(victim_entry_slab, ve);
+	}
+	am->victim_count = 0;
+	am->min_mtime = ULLONG_MAX;
+	am->max_mtime = 0;
+}
+
 static unsigned int count_bits(const unsigned long *addr,
 				unsigned int offset, unsigned int len)
 {
@@ -325,6 +448,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 	select_policy(sbi, gc_type, type, &p);
 
 	p.min_segno = NULL_SEGNO;
+	p.oldest_age = 0;
 	p.min_cost = get_max_cost(sbi, &p);
 
 	if (*result != NULL_SEGNO) {
@@ -380,6 +504,11 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 					no_fggc_candidate(sbi, secno))
 			goto next;
 
+		if (p.gc_mode == GC_AT) {
+			atgc_add_victim(sbi, segno);
+			goto next;
+		}
+
 		cost = get_gc_cost(sbi, segno, &p);
 
 		if (p.min_cost > cost) {
@@ -396,6 +525,12 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			break;
 		}
 	}
+
+	if (p.gc_mode == GC_AT) {
+		atgc_lookup_victim(sbi, &p);
+		atgc_release_victims(sbi);
+	}
+
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
@@ -570,7 +705,7 @@ block_t start_bidx_of_node(unsigned int node_ofs, struct inode *inode)
 		int dec = (node_ofs - indirect_blks - 3) / (NIDS_PER_BLOCK + 1);
 		bidx = node_ofs - 5 - dec;
 	}
-	return bidx * ADDRS_PER_BLOCK + ADDRS_PER_INODE(inode);
+	return bidx * ADDRS_PER_BLOCK(inode) + ADDRS_PER_INODE(inode);
 }
 
 static bool is_alive(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
@@ -1200,8 +1335,31 @@ void build_gc_manager(struct f2fs_sb_info *sbi)
 				BLKS_PER_SEC(sbi), (main_count - resv_count));
 	sbi->gc_pin_file_threshold = DEF_GC_FAILED_PINNED_FILES;
 
+	sbi->am.root = RB_ROOT;
+	sbi->am.victim_count = 0;
+	sbi->am.min_mtime = ULLONG_MAX;
+	sbi->am.max_mtime = 0;
+	sbi->am.candidate_ratio = DEF_GC_THREAD_CANDIDATE_RATIO;
+	sbi->am.max_candidate_count = DEF_GC_THREAD_MAX_CANDIDATE_COUNT;
+	sbi->am.age_weight = DEF_GC_THREAD_AGE_WEIGHT;
+	sbi->am.age_threshold = DEF_GC_THREAD_AGE_THRESHOLD;
+
 	/* give warm/cold data area from slower device */
 	if (f2fs_is_multi_device(sbi) && sbi->segs_per_sec == 1)
 		SIT_I(sbi)->last_victim[ALLOC_NEXT] =
 				GET_SEGNO(sbi, FDEV(0).end_blk) + 1;
 }
+
+int __init create_garbage_collection_cache(void)
+{
+	victim_entry_slab = f2fs_kmem_cache_create("f2fs_victim_entry",
+					sizeof(struct victim_entry));
+	if (!victim_entry_slab)
+		return -ENOMEM;
+	return 0;
+}
+
+void destroy_garbage_collection_cache(void)
+{
+	kmem_cache_destroy(victim_entry_slab);
+}
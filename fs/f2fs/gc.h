@@ -25,6 +25,13 @@
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
+/* age-threshold GC (ATGC) victim selection */
+#define DEF_GC_THREAD_CANDIDATE_RATIO		20	/* select 20% oldest sections as candidates */
+#define DEF_GC_THREAD_MAX_CANDIDATE_COUNT	10	/* select at least 10 sections as candidates */
+#define DEF_GC_THREAD_AGE_WEIGHT		60	/* age weight */
+#define DEF_GC_THREAD_AGE_THRESHOLD		(60 * 60 * 24 * 7)	/* 7 days */
+#define DEFAULT_ACCURACY_CLASS			10000	/* accuracy class */
+
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
@@ -46,6 +53,12 @@ struct gc_inode_list {
 	struct radix_tree_root iroot;
 };
 
+struct victim_entry {
+	struct rb_node rb_node;		/* rb node located in rb-tree */
+	unsigned long long mtime;	/* mtime of section */
+	unsigned int segno;		/* segment No. */
+};
+
 /*
  * inline functions
  */
@@ -240,6 +240,20 @@ static bool sanity_check_inode(struct inode *inode, struct page *node_page)
 		return false;
 	}
 
+	if (f2fs_compressed_file(inode) &&
+		(fi->i_compress_algorithm >= COMPRESS_MAX ||
+		fi->i_compress_algorithm == COMPRESS_LZO ||
+		fi->i_log_cluster_size < MIN_COMPRESS_LOG_SIZE ||
+		fi->i_log_cluster_size > MAX_COMPRESS_LOG_SIZE)) {
+		set_sbi_flag(sbi, SBI_NEED_FSCK);
+		f2fs_msg(sbi->sb, KERN_WARNING,
+			"%s: inode (ino=%lx) has unsupported compress "
+			"algorithm: %u or log cluster size: %u, run fsck to fix",
+			__func__, inode->i_ino, fi->i_compress_algorithm,
+			fi->i_log_cluster_size);
+		return false;
+	}
+
 	if (F2FS_I(inode)->extent_tree) {
 		struct extent_info *ei = &F2FS_I(inode)->extent_tree->largest;
 
@@ -301,9 +315,6 @@ static int do_read_inode(struct inode *inode)
 	fi->i_pino = le32_to_cpu(ri->i_pino);
 	fi->i_dir_level = ri->i_dir_level;
 
-	if (f2fs_init_extent_tree(inode, &ri->i_ext))
-		set_page_dirty(node_page);
-
 	get_inline_info(inode, ri);
 
 	fi->i_extra_isize = f2fs_has_extra_attr(inode) ?
@@ -326,6 +337,22 @@ static int do_read_inode(struct inode *inode)
 		fi->i_inline_xattr_size = 0;
 	}
 
+	if (f2fs_has_extra_attr(inode) && f2fs_sb_has_compression(sbi->sb) &&
+			F2FS_FITS_IN_INODE(ri, fi->i_extra_isize,
+						i_log_cluster_size) &&
+			(fi->i_flags & F2FS_COMPR_FL) && S_ISREG(inode->i_mode)) {
+		atomic64_set(&fi->i_compr_blocks,
+			     le64_to_cpu(ri->i_compr_blocks));
+		fi->i_compress_algorithm = ri->i_compress_algorithm;
+		fi->i_log_cluster_size = ri->i_log_cluster_size;
+		fi->i_cluster_size = 1 << fi->i_log_cluster_size;
+		set_inode_flag(inode, FI_COMPRESSED_FILE);
+	}
+
+	/* compressed inodes never use the extent cache */
+	if (f2fs_init_extent_tree(inode, &ri->i_ext))
+		set_page_dirty(node_page);
+
 	if (!sanity_check_inode(inode, node_page)) {
 		f2fs_put_page(node_page, 1);
 		return -EFSCORRUPTED;
@@ -522,6 +549,17 @@ void update_inode(struct inode *inode, struct page *node_page)
 			ri->i_crtime_nsec =
 				cpu_to_le32(F2FS_I(inode)->i_crtime.tv_nsec);
 		}
+
+		if (f2fs_sb_has_compression(F2FS_I_SB(inode)->sb) &&
+			F2FS_FITS_IN_INODE(ri, F2FS_I(inode)->i_extra_isize,
+							i_log_cluster_size)) {
+			ri->i_compr_blocks = cpu_to_le64(
+				atomic64_read(&F2FS_I(inode)->i_compr_blocks));
+			ri->i_compress_algorithm =
+				F2FS_I(inode)->i_compress_algorithm;
+			ri->i_log_cluster_size =
+				F2FS_I(inode)->i_log_cluster_size;
+		}
 	}
 
 	__set_inode_rdev(inode, ri);
@@ -23,6 +23,12 @@
 #include "acl.h"
 #include <trace/events/f2fs.h>
 
+static bool f2fs_may_compress_new_inode(struct inode *inode)
+{
+	return f2fs_sb_has_compression(inode->i_sb) &&
+		f2fs_has_extra_attr(inode) && f2fs_may_compress(inode);
+}
+
 static struct inode *f2fs_new_inode(struct inode *dir, umode_t mode)
 {
 	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
@@ -121,6 +127,15 @@ static struct inode *f2fs_new_inode(struct inode *dir, umode_t mode)
 	if (F2FS_I(inode)->i_flags & F2FS_PROJINHERIT_FL)
 		set_inode_flag(inode, FI_PROJ_INHERIT);
 
+	/* Inherit compression from the parent directory if we can. */
+	if ((F2FS_I(inode)->i_flags & F2FS_COMPR_FL) &&
+					S_ISREG(inode->i_mode)) {
+		if (f2fs_may_compress_new_inode(inode))
+			set_compress_context(inode);
+		else
+			F2FS_I(inode)->i_flags &= ~F2FS_COMPR_FL;
+	}
+
 	trace_f2fs_new_inode(inode, 0);
 	return inode;
 
@@ -193,6 +208,27 @@ static inline void set_file_temperature(struct f2fs_sb_info *sbi, struct inode *
 	up_read(&sbi->sb_lock);
 }
 
+/*
+ * Set files matching compress_extension= as compressed files
+ */
+static void set_compress_inode(struct f2fs_sb_info *sbi, struct inode *inode,
+						const unsigned char *name)
+{
+	unsigned char (*extlist)[F2FS_EXTENSION_LEN] =
+					F2FS_OPTION(sbi).extensions;
+	int i;
+
+	if (f2fs_compressed_file(inode) || !f2fs_may_compress_new_inode(inode))
+		return;
+
+	for (i = 0; i < F2FS_OPTION(sbi).compress_ext_cnt; i++) {
+		if (!is_extension_exist(name, extlist[i]))
+			continue;
+		set_compress_context(inode);
+		return;
+	}
+}
+
 int update_extension_list(struct f2fs_sb_info *sbi, const char *name,
 							bool hot, bool set)
 {
@@ -281,6 +317,8 @@ static int f2fs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
 	if (!test_opt(sbi, DISABLE_EXT_IDENTIFY))
 		set_file_temperature(sbi, inode, dentry->d_name.name);
 
+	set_compress_inode(sbi, inode, dentry->d_name.name);
+
 	inode->i_op = &f2fs_file_inode_operations;
 	inode->i_fop = &f2fs_file_operations;
 	inode->i_mapping->a_ops = &f2fs_dblock_aops;
@@ -212,6 +212,27 @@ static void recover_inline_flags(struct inode *inode, struct f2fs_inode *ri)
 		clear_inode_flag(inode, FI_INLINE_DOTS);
 }
 
+static void recover_compress_flags(struct inode *inode, struct f2fs_inode *ri)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	if (!f2fs_sb_has_compression(F2FS_I_SB(inode)->sb) ||
+			!S_ISREG(inode->i_mode) ||
+			!(fi->i_flags & F2FS_COMPR_FL) ||
+			!(ri->i_inline & F2FS_EXTRA_ATTR) ||
+			!F2FS_FITS_IN_INODE(ri, le16_to_cpu(ri->i_extra_isize),
+							i_log_cluster_size)) {
+		clear_inode_flag(inode, FI_COMPRESSED_FILE);
+		return;
+	}
+
+	atomic64_set(&fi->i_compr_blocks, le64_to_cpu(ri->i_compr_blocks));
+	fi->i_compress_algorithm = ri->i_compress_algorithm;
+	fi->i_log_cluster_size = ri->i_log_cluster_size;
+	fi->i_cluster_size = 1 << fi->i_log_cluster_size;
+	set_inode_flag(inode, FI_COMPRESSED_FILE);
+}
+
 static void recover_inode(struct inode *inode, struct page *page)
 {
 	struct f2fs_inode *raw = F2FS_INODE(page);
@@ -245,6 +266,7 @@ static void recover_inode(struct inode *inode, struct page *page)
 	F2FS_I(inode)->i_flags = le32_to_cpu(raw->i_flags);
 
 	recover_inline_flags(inode, raw);
+	recover_compress_flags(inode, raw);
 
 	f2fs_mark_inode_dirty_sync(inode, true);
 
@@ -546,6 +568,14 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 			continue;
 		}
 
+		/* the head of a compressed cluster is charged like a block */
+		if (dest == COMPRESS_ADDR) {
+			truncate_data_blocks_range(&dn, 1);
+			reserve_new_block(&dn);
+			f2fs_update_data_blkaddr(&dn, COMPRESS_ADDR);
+			continue;
+		}
+
 		/* dest is valid block, try to recover from src to dest */
 		if (f2fs_is_valid_blkaddr(sbi, dest, META_POR)) {
 
@@ -133,6 +133,10 @@ enum {
 	Opt_alloc,
 	Opt_fsync,
 	Opt_test_dummy_encryption,
+	Opt_compress_algorithm,
+	Opt_compress_log_size,
+	Opt_compress_extension,
+	Opt_atgc,
 	Opt_err,
 };
 
@@ -190,6 +194,10 @@ static match_table_t f2fs_tokens = {
 	{Opt_alloc, "alloc_mode=%s"},
 	{Opt_fsync, "fsync_mode=%s"},
 	{Opt_test_dummy_encryption, "test_dummy_encryption"},
+	{Opt_compress_algorithm, "compress_algorithm=%s"},
+	{Opt_compress_log_size, "compress_log_size=%u"},
+	{Opt_compress_extension, "compress_extension=%s"},
+	{Opt_atgc, "atgc"},
 	{Opt_err, NULL},
 };
 
@@ -357,6 +365,33 @@ static int f2fs_check_quota_options(struct f2fs_sb_info *sbi)
 }
 #endif
 
+static int f2fs_check_compression(struct f2fs_sb_info *sbi)
+{
+	struct super_block *sb = sbi->sb;
+
+	if (!f2fs_sb_has_compression(sb))
+		return 0;
+
+#ifndef CONFIG_F2FS_FS_COMPRESSION
+	f2fs_msg(sb, KERN_ERR,
+		"Filesystem with compression feature cannot be mounted "
+		"without CONFIG_F2FS_FS_COMPRESSION");
+	return -EINVAL;
+#endif
+	if (!f2fs_sb_has_extra_attr(sb)) {
+		f2fs_msg(sb, KERN_ERR,
+			"Compression feature requires extra_attr feature");
+		return -EINVAL;
+	}
+	if (f2fs_sb_has_blkzoned(sb) || F2FS_IO_SIZE_BITS(sbi)) {
+		f2fs_msg(sb, KERN_ERR,
+			"Compression is not supported with zoned block device "
+			"or io_bits");
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int parse_options(struct super_block *sb, char *options)
 {
 	struct f2fs_sb_info *sbi = F2FS_SB(sb);
@@ -533,6 +568,9 @@ static int parse_options(struct super_block *sb, char *options)
 		case Opt_data_flush:
 			set_opt(sbi, DATA_FLUSH);
 			break;
+		case Opt_atgc:
+			set_opt(sbi, ATGC);
+			break;
 		case Opt_reserve_root:
 			if (args->from && match_int(args, &arg))
 				return -EINVAL;
@@ -765,6 +803,73 @@ static int parse_options(struct super_block *sb, char *options)
 					"Test dummy encryption mount option ignored");
 #endif
 			break;
+		case Opt_compress_algorithm:
+			if (!f2fs_sb_has_compression(sb)) {
+				f2fs_msg(sb, KERN_ERR,
+					"Compression feature is off");
+				return -EINVAL;
+			}
+			name = match_strdup(&args[0]);
+			if (!name)
+				return -ENOMEM;
+			if (strlen(name) == 3 && !strncmp(name, "lz4", 3)) {
+				F2FS_OPTION(sbi).compress_algorithm =
+								COMPRESS_LZ4;
+			} else if (strlen(name) == 4 &&
+					!strncmp(name, "zstd", 4)) {
+				F2FS_OPTION(sbi).compress_algorithm =
+								COMPRESS_ZSTD;
+			} else {
+				kfree(name);
+				return -EINVAL;
+			}
+			kfree(name);
+			if (!f2fs_compress_algorithm_supported(
+					F2FS_OPTION(sbi).compress_algorithm)) {
+				f2fs_msg(sb, KERN_ERR,
+					"Compression algorithm is not built in");
+				return -EINVAL;
+			}
+			break;
+		case Opt_compress_log_size:
+			if (!f2fs_sb_has_compression(sb)) {
+				f2fs_msg(sb, KERN_ERR,
+					"Compression feature is off");
+				return -EINVAL;
+			}
+			if (args->from && match_int(args, &arg))
+				return -EINVAL;
+			if (arg < MIN_COMPRESS_LOG_SIZE ||
+					arg > MAX_COMPRESS_LOG_SIZE) {
+				f2fs_msg(sb, KERN_ERR,
+					"Compress cluster log size is out of "
+					"range");
+				return -EINVAL;
+			}
+			F2FS_OPTION(sbi).compress_log_size = arg;
+			break;
+		case Opt_compress_extension:
+			if (!f2fs_sb_has_compression(sb)) {
+				f2fs_msg(sb, KERN_ERR,
+					"Compression feature is off");
+				return -EINVAL;
+			}
+			name = match_strdup(&args[0]);
+			if (!name)
+				return -ENOMEM;
+			if (strlen(name) >= F2FS_EXTENSION_LEN ||
+				F2FS_OPTION(sbi).compress_ext_cnt >=
+							COMPRESS_EXT_NUM) {
+				f2fs_msg(sb, KERN_ERR,
+					"Invalid compress extension \"%s\"",
+					name);
+				kfree(name);
+				return -EINVAL;
+			}
+			strcpy(F2FS_OPTION(sbi).extensions[
+				F2FS_OPTION(sbi).compress_ext_cnt++], name);
+			kfree(name);
+			break;
 		default:
 			f2fs_msg(sb, KERN_ERR,
 				"Unrecognized mount option \"%s\" or missing value",
@@ -830,6 +935,7 @@ static struct inode *f2fs_alloc_inode(struct super_block *sb)
 
 	/* Initialize f2fs-specific inode info */
 	atomic_set(&fi->dirty_pages, 0);
+	atomic64_set(&fi->i_compr_blocks, 0);
 	fi->i_current_depth = 1;
 	init_rwsem(&fi->i_sem);
 	INIT_LIST_HEAD(&fi->dirty_list);
@@ -1265,6 +1371,25 @@ static inline void f2fs_show_quota_options(struct seq_file *seq,
 #endif
 }
 
+static inline void f2fs_show_compress_options(struct seq_file *seq,
+							struct super_block *sb)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(sb);
+	int i;
+
+	if (F2FS_OPTION(sbi).compress_algorithm == COMPRESS_LZ4)
+		seq_printf(seq, ",compress_algorithm=%s", "lz4");
+	else if (F2FS_OPTION(sbi).compress_algorithm == COMPRESS_ZSTD)
+		seq_printf(seq, ",compress_algorithm=%s", "zstd");
+
+	seq_printf(seq, ",compress_log_size=%u",
+			F2FS_OPTION(sbi).compress_log_size);
+
+	for (i = 0; i < F2FS_OPTION(sbi).compress_ext_cnt; i++)
+		seq_printf(seq, ",compress_extension=%s",
+				F2FS_OPTION(sbi).extensions[i]);
+}
+
 static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 {
 	struct f2fs_sb_info *sbi = F2FS_SB(root->d_sb);
@@ -1326,6 +1451,8 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_puts(seq, ",noextent_cache");
 	if (test_opt(sbi, DATA_FLUSH))
 		seq_puts(seq, ",data_flush");
+	if (test_opt(sbi, ATGC))
+		seq_puts(seq, ",atgc");
 
 	seq_puts(seq, ",mode=");
 	if (test_opt(sbi, ADAPTIVE))
@@ -1378,6 +1505,9 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_printf(seq, ",fsync_mode=%s", "strict");
 	else if (F2FS_OPTION(sbi).fsync_mode == FSYNC_MODE_NOBARRIER)
 		seq_printf(seq, ",fsync_mode=%s", "nobarrier");
+
+	if (f2fs_sb_has_compression(sbi->sb))
+		f2fs_show_compress_options(seq, sbi->sb);
 	return 0;
 }
 
@@ -1390,6 +1520,9 @@ static void default_options(struct f2fs_sb_info *sbi)
 	F2FS_OPTION(sbi).alloc_mode = ALLOC_MODE_DEFAULT;
 	F2FS_OPTION(sbi).fsync_mode = FSYNC_MODE_POSIX;
 	F2FS_OPTION(sbi).test_dummy_encryption = false;
+	F2FS_OPTION(sbi).compress_algorithm = COMPRESS_LZ4;
+	F2FS_OPTION(sbi).compress_log_size = MIN_COMPRESS_LOG_SIZE;
+	F2FS_OPTION(sbi).compress_ext_cnt = 0;
 	sbi->readdir_ra = 1;
 
 	set_opt(sbi, BG_GC);
@@ -1476,6 +1609,10 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	if (err)
 		goto restore_opts;
 
+	err = f2fs_check_compression(sbi);
+	if (err)
+		goto restore_opts;
+
 	/*
 	 * Previous and new state of filesystem is RO,
 	 * so skip checking GC and FLUSH_MERGE conditions.
@@ -2071,7 +2208,7 @@ static const struct export_operations f2fs_export_ops = {
 static loff_t max_file_blocks(void)
 {
 	loff_t result = 0;
-	loff_t leaf_count = ADDRS_PER_BLOCK;
+	loff_t leaf_count = DEF_ADDRS_PER_BLOCK;
 
 	/*
 	 * note: previously, result is equal to (DEF_ADDRS_PER_INODE -
@@ -2505,6 +2642,10 @@ static void init_sb_info(struct f2fs_sb_info *sbi)
 		atomic_set(&sbi->nr_pages[i], 0);
 
 	atomic_set(&sbi->wb_sync_req, 0);
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	atomic64_set(&sbi->compr_written_block, 0);
+	atomic64_set(&sbi->compr_saved_block, 0);
+#endif
 
 	INIT_LIST_HEAD(&sbi->s_list);
 	mutex_init(&sbi->umount_mutex);
@@ -2890,6 +3031,10 @@ static int f2fs_fill_super(struct super_block *sb, void *data, int silent)
 	if (err)
 		goto free_options;
 
+	err = f2fs_check_compression(sbi);
+	if (err)
+		goto free_options;
+
 	sbi->max_file_blocks = max_file_blocks();
 	sb->s_maxbytes = sbi->max_file_blocks <<
 				le32_to_cpu(raw_super->log_blocksize);
@@ -3312,9 +3457,12 @@ static int __init init_f2fs_fs(void)
 	err = create_extent_cache();
 	if (err)
 		goto free_checkpoint_caches;
-	err = f2fs_init_sysfs();
+	err = create_garbage_collection_cache();
 	if (err)
 		goto free_extent_cache;
+	err = f2fs_init_sysfs();
+	if (err)
+		goto free_garbage_collection_cache;
 	err = register_shrinker(&f2fs_shrinker_info);
 	if (err)
 		goto free_sysfs;
@@ -3337,6 +3485,8 @@ static int __init init_f2fs_fs(void)
 	unregister_shrinker(&f2fs_shrinker_info);
 free_sysfs:
 	f2fs_exit_sysfs();
+free_garbage_collection_cache:
+	destroy_garbage_collection_cache();
 free_extent_cache:
 	destroy_extent_cache();
 free_checkpoint_caches:
@@ -3358,6 +3508,7 @@ static void __exit exit_f2fs_fs(void)
 	unregister_filesystem(&f2fs_fs_type);
 	unregister_shrinker(&f2fs_shrinker_info);
 	f2fs_exit_sysfs();
+	destroy_garbage_collection_cache();
 	destroy_extent_cache();
 	destroy_checkpoint_caches();
 	destroy_segment_manager_caches();
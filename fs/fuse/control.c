@@ -10,6 +10,7 @@
 
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/seq_file.h>
 
 #define FUSE_CTL_SUPER_MAGIC 0x65735543
 
@@ -19,7 +20,7 @@
  */
 static struct super_block *fuse_control_sb;
 
-static struct fuse_conn *fuse_ctl_file_conn_get(struct file *file)
+static struct fuse_conn *fuse_ctl_file_conn_get(const struct file *file)
 {
 	struct fuse_conn *fc;
 	mutex_lock(&fuse_mutex);
@@ -170,6 +171,51 @@ static ssize_t fuse_conn_congestion_threshold_write(struct file *file,
 	return ret;
 }
 
+/*
+ * One line per opcode that has been seen: the opcode followed by the
+ * number of requests that took less than 1, 2, 4, ... usec from being
+ * queued to completion.  The last bucket also counts everything slower.
+ */
+static int fuse_conn_latency_show(struct seq_file *m, void *v)
+{
+	struct fuse_conn *fc = fuse_ctl_file_conn_get(m->file);
+	u32 hist[FUSE_LAT_BUCKETS];
+	unsigned opcode, i;
+	int cpu;
+
+	if (!fc)
+		return 0;
+
+	for (opcode = 0; opcode < FUSE_LAT_OPCODES; opcode++) {
+		u64 total = 0;
+
+		memset(hist, 0, sizeof(hist));
+		for_each_possible_cpu(cpu) {
+			struct fuse_latency *lat = per_cpu_ptr(fc->latency, cpu);
+
+			for (i = 0; i < FUSE_LAT_BUCKETS; i++)
+				hist[i] += READ_ONCE(lat->hist[opcode][i]);
+		}
+		for (i = 0; i < FUSE_LAT_BUCKETS; i++)
+			total += hist[i];
+		if (!total)
+			continue;
+
+		seq_printf(m, "%u:", opcode);
+		for (i = 0; i < FUSE_LAT_BUCKETS; i++)
+			seq_printf(m, " %u", hist[i]);
+		seq_putc(m, '\n');
+	}
+	fuse_conn_put(fc);
+
+	return 0;
+}
+
+static int fuse_conn_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fuse_conn_latency_show, NULL);
+}
+
 static const struct file_operations fuse_ctl_abort_ops = {
 	.open = nonseekable_open,
 	.write = fuse_conn_abort_write,
@@ -182,6 +228,13 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_ctl_latency_ops = {
+	.open = fuse_conn_latency_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -264,7 +317,9 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
 				 S_IFREG | 0600, 1, NULL,
-				 &fuse_conn_congestion_threshold_ops))
+				 &fuse_conn_congestion_threshold_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "latency", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_latency_ops))
 		goto err;
 
 	return 0;
@@ -318,16 +318,76 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	return atomic64_inc_return(&fiq->reqctr);
 }
 
-static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
+static bool fuse_wake_reader(struct fuse_iqueue_cpu *iqc)
 {
+	if (!waitqueue_active(&iqc->waitq))
+		return false;
+	wake_up(&iqc->waitq);
+	return true;
+}
+
+/*
+ * Wake up one reader, preferring one sleeping on @cpu, and all pollers.
+ * Must not be called with fiq->waitq.lock held.
+ */
+static void fuse_iqueue_wake(struct fuse_iqueue *fiq, int cpu)
+{
+	int i;
+
+	/* matches set_current_state() in fuse_wait_request() */
+	smp_mb();
+	if (!fuse_wake_reader(per_cpu_ptr(fiq->cpu_queues, cpu))) {
+		for_each_possible_cpu(i) {
+			if (i != cpu &&
+			    fuse_wake_reader(per_cpu_ptr(fiq->cpu_queues, i)))
+				break;
+		}
+	}
+	if (waitqueue_active(&fiq->waitq))
+		wake_up(&fiq->waitq);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
+/*
+ * Put the request on this CPU's input queue.  Returns false if the
+ * connection has been aborted.
+ */
+static bool queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	int cpu = raw_smp_processor_id();
+	struct fuse_iqueue_cpu *iqc = per_cpu_ptr(fiq->cpu_queues, cpu);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fiq->pending);
-	wake_up_locked(&fiq->waitq);
-	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+	req->queue_time = ktime_get_ns();
+
+	spin_lock(&iqc->waitq.lock);
+	if (!fiq->connected) {
+		spin_unlock(&iqc->waitq.lock);
+		return false;
+	}
+	req->iq_cpu = cpu;
+	list_add_tail(&req->list, &iqc->pending);
+	spin_unlock(&iqc->waitq.lock);
+
+	fuse_iqueue_wake(fiq, cpu);
+	return true;
+}
+
+static void fuse_account_latency(struct fuse_conn *fc, struct fuse_req *req)
+{
+	u32 opcode = req->in.h.opcode;
+	u64 usec;
+
+	if (!req->queue_time || opcode >= FUSE_LAT_OPCODES)
+		return;
+
+	usec = div_u64(ktime_get_ns() - req->queue_time, NSEC_PER_USEC);
+	this_cpu_inc(fc->latency->hist[opcode]
+		     [min_t(unsigned, fls64(usec), FUSE_LAT_BUCKETS - 1)]);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -342,12 +402,12 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fiq->connected) {
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
-		wake_up_locked(&fiq->waitq);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		spin_unlock(&fiq->waitq.lock);
+		fuse_iqueue_wake(fiq, raw_smp_processor_id());
 	} else {
+		spin_unlock(&fiq->waitq.lock);
 		kfree(forget);
 	}
-	spin_unlock(&fiq->waitq.lock);
 }
 
 static void flush_bg_queue(struct fuse_conn *fc)
@@ -360,10 +420,13 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
 		req->in.h.unique = fuse_get_unique(fiq);
-		queue_request(fiq, req);
-		spin_unlock(&fiq->waitq.lock);
+		if (!queue_request(fiq, req)) {
+			/* Aborted, fuse_abort_conn() ends what is left */
+			list_add(&req->list, &fc->bg_queue);
+			fc->active_background--;
+			break;
+		}
 	}
 }
 
@@ -382,9 +445,18 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		goto put_request;
 
-	spin_lock(&fiq->waitq.lock);
-	list_del_init(&req->intr_entry);
-	spin_unlock(&fiq->waitq.lock);
+	/*
+	 * Only interrupted requests can be on fiq->interrupts.  Setting
+	 * FR_FINISHED above pairs with the barrier after FR_INTERRUPTED is
+	 * set, so queue_interrupt() either sees FR_FINISHED or we see
+	 * FR_INTERRUPTED.
+	 */
+	if (test_bit(FR_INTERRUPTED, &req->flags)) {
+		spin_lock(&fiq->waitq.lock);
+		list_del_init(&req->intr_entry);
+		spin_unlock(&fiq->waitq.lock);
+	}
+	fuse_account_latency(fc, req);
 	WARN_ON(test_bit(FR_PENDING, &req->flags));
 	WARN_ON(test_bit(FR_SENT, &req->flags));
 	if (test_bit(FR_BACKGROUND, &req->flags)) {
@@ -429,15 +501,17 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 	}
 	if (list_empty(&req->intr_entry)) {
 		list_add_tail(&req->intr_entry, &fiq->interrupts);
-		wake_up_locked(&fiq->waitq);
+		spin_unlock(&fiq->waitq.lock);
+		fuse_iqueue_wake(fiq, raw_smp_processor_id());
+		return;
 	}
 	spin_unlock(&fiq->waitq.lock);
-	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
 	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue_cpu *iqc;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -461,16 +535,17 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		iqc = per_cpu_ptr(fiq->cpu_queues, req->iq_cpu);
+		spin_lock(&iqc->waitq.lock);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
-			spin_unlock(&fiq->waitq.lock);
+			spin_unlock(&iqc->waitq.lock);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->waitq.lock);
+		spin_unlock(&iqc->waitq.lock);
 	}
 
 	/*
@@ -487,18 +562,14 @@ static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->waitq.lock);
+	req->in.h.unique = fuse_get_unique(fiq);
+	/* acquire extra reference, since request is still needed
+	   after request_end() */
+	__fuse_get_request(req);
+	if (!queue_request(fiq, req)) {
+		__fuse_put_request(req);
 		req->out.h.error = -ENOTCONN;
 	} else {
-		req->in.h.unique = fuse_get_unique(fiq);
-		queue_request(fiq, req);
-		/* acquire extra reference, since request is still needed
-		   after request_end() */
-		__fuse_get_request(req);
-		spin_unlock(&fiq->waitq.lock);
-
 		request_wait_answer(fc, req);
 		/* Pairs with smp_wmb() in request_end() */
 		smp_rmb();
@@ -630,12 +701,8 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 
 	__clear_bit(FR_ISREPLY, &req->flags);
 	req->in.h.unique = unique;
-	spin_lock(&fiq->waitq.lock);
-	if (fiq->connected) {
-		queue_request(fiq, req);
+	if (queue_request(fiq, req))
 		err = 0;
-	}
-	spin_unlock(&fiq->waitq.lock);
 
 	return err;
 }
@@ -1090,10 +1157,134 @@ static int forget_pending(struct fuse_iqueue *fiq)
 	return fiq->forget_list_head.next != NULL;
 }
 
+static bool fuse_iqueue_has_pending(struct fuse_iqueue *fiq)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (!list_empty(&per_cpu_ptr(fiq->cpu_queues, cpu)->pending))
+			return true;
+	}
+	return false;
+}
+
 static int request_pending(struct fuse_iqueue *fiq)
 {
-	return !list_empty(&fiq->pending) || !list_empty(&fiq->interrupts) ||
-		forget_pending(fiq);
+	return !list_empty(&fiq->interrupts) || forget_pending(fiq) ||
+		fuse_iqueue_has_pending(fiq);
+}
+
+/*
+ * Wait for a request on the queue of the CPU we are running on.  Any
+ * queued request ends the wait, so an idle reader also picks up work
+ * queued on CPUs that have no reader of their own.
+ */
+static int fuse_wait_request(struct fuse_iqueue *fiq, bool nonblock)
+{
+	struct fuse_iqueue_cpu *iqc;
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	while (fiq->connected && !request_pending(fiq)) {
+		if (nonblock)
+			return -EAGAIN;
+
+		iqc = per_cpu_ptr(fiq->cpu_queues, raw_smp_processor_id());
+		prepare_to_wait_exclusive(&iqc->waitq, &wait,
+					  TASK_INTERRUPTIBLE);
+		if (fiq->connected && !request_pending(fiq)) {
+			if (signal_pending(current))
+				err = -ERESTARTSYS;
+			else
+				schedule();
+		}
+		finish_wait(&iqc->waitq, &wait);
+		if (err)
+			return err;
+	}
+	return fiq->connected ? 0 : -ENODEV;
+}
+
+static struct fuse_req *fuse_dequeue_cpu(struct fuse_iqueue_cpu *iqc)
+{
+	struct fuse_req *req;
+
+	if (list_empty(&iqc->pending))
+		return NULL;
+
+	spin_lock(&iqc->waitq.lock);
+	req = list_first_entry_or_null(&iqc->pending, struct fuse_req, list);
+	if (req) {
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+	}
+	spin_unlock(&iqc->waitq.lock);
+	return req;
+}
+
+/*
+ * Find the CPU whose queue has the oldest request at its head, or -1 if
+ * all queues are empty.
+ */
+static int fuse_oldest_cpu(struct fuse_iqueue *fiq)
+{
+	int cpu, oldest_cpu = -1;
+	u64 oldest = U64_MAX;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue_cpu *iqc = per_cpu_ptr(fiq->cpu_queues, cpu);
+		struct fuse_req *req;
+
+		if (list_empty(&iqc->pending))
+			continue;
+
+		spin_lock(&iqc->waitq.lock);
+		req = list_first_entry_or_null(&iqc->pending,
+					       struct fuse_req, list);
+		if (req && req->queue_time < oldest) {
+			oldest = req->queue_time;
+			oldest_cpu = cpu;
+		}
+		spin_unlock(&iqc->waitq.lock);
+	}
+	return oldest_cpu;
+}
+
+/*
+ * Take the oldest request of this CPU's queue, or steal one from
+ * another CPU if that is empty.  Every FUSE_IQ_FAIR_INTERVAL dequeues
+ * the oldest request across all CPUs is taken instead, so requests
+ * queued on a CPU without a reader of its own are not starved by busy
+ * local queues.
+ */
+static struct fuse_req *fuse_dequeue_request(struct fuse_iqueue *fiq)
+{
+	int this_cpu = raw_smp_processor_id();
+	int cpu = this_cpu;
+	struct fuse_req *req;
+
+	if (!(atomic_inc_return(&fiq->dequeued) % FUSE_IQ_FAIR_INTERVAL)) {
+		int oldest_cpu = fuse_oldest_cpu(fiq);
+
+		if (oldest_cpu >= 0) {
+			req = fuse_dequeue_cpu(per_cpu_ptr(fiq->cpu_queues,
+							   oldest_cpu));
+			if (req)
+				return req;
+		}
+	}
+
+	do {
+		req = fuse_dequeue_cpu(per_cpu_ptr(fiq->cpu_queues, cpu));
+		if (req)
+			return req;
+
+		cpu = cpumask_next(cpu, cpu_possible_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_possible_mask);
+	} while (cpu != this_cpu);
+
+	return NULL;
 }
 
 /*
@@ -1271,39 +1462,37 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fiq->waitq.lock);
-	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fiq->connected &&
-	    !request_pending(fiq))
-		goto err_unlock;
-
-	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+	err = fuse_wait_request(fiq, file->f_flags & O_NONBLOCK);
 	if (err)
-		goto err_unlock;
+		return err;
 
-	err = -ENODEV;
-	if (!fiq->connected)
-		goto err_unlock;
+	/* fiq->waitq.lock is only needed for interrupts and forgets */
+	if (!list_empty(&fiq->interrupts) || forget_pending(fiq)) {
+		spin_lock(&fiq->waitq.lock);
+		err = -ENODEV;
+		if (!fiq->connected)
+			goto err_unlock;
 
-	if (!list_empty(&fiq->interrupts)) {
-		req = list_entry(fiq->interrupts.next, struct fuse_req,
-				 intr_entry);
-		return fuse_read_interrupt(fiq, cs, nbytes, req);
-	}
+		if (!list_empty(&fiq->interrupts)) {
+			req = list_entry(fiq->interrupts.next, struct fuse_req,
+					 intr_entry);
+			return fuse_read_interrupt(fiq, cs, nbytes, req);
+		}
 
-	if (forget_pending(fiq)) {
-		if (list_empty(&fiq->pending) || fiq->forget_batch-- > 0)
-			return fuse_read_forget(fc, fiq, cs, nbytes);
+		if (forget_pending(fiq)) {
+			if (!fuse_iqueue_has_pending(fiq) ||
+			    fiq->forget_batch-- > 0)
+				return fuse_read_forget(fc, fiq, cs, nbytes);
 
-		if (fiq->forget_batch <= -8)
-			fiq->forget_batch = 16;
+			if (fiq->forget_batch <= -8)
+				fiq->forget_batch = 16;
+		}
+		spin_unlock(&fiq->waitq.lock);
 	}
 
-	req = list_entry(fiq->pending.next, struct fuse_req, list);
-	clear_bit(FR_PENDING, &req->flags);
-	list_del_init(&req->list);
-	spin_unlock(&fiq->waitq.lock);
+	req = fuse_dequeue_request(fiq);
+	if (!req)
+		goto restart;
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -2096,12 +2285,10 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	fiq = &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
 
-	spin_lock(&fiq->waitq.lock);
 	if (!fiq->connected)
 		mask = POLLERR;
 	else if (request_pending(fiq))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fiq->waitq.lock);
 
 	return mask;
 }
@@ -2166,6 +2353,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		struct fuse_req *req, *next;
 		LIST_HEAD(to_end1);
 		LIST_HEAD(to_end2);
+		int cpu;
 
 		fc->connected = 0;
 		fc->blocked = 0;
@@ -2194,13 +2382,29 @@ void fuse_abort_conn(struct fuse_conn *fc)
 
 		spin_lock(&fiq->waitq.lock);
 		fiq->connected = 0;
-		list_splice_init(&fiq->pending, &to_end2);
-		list_for_each_entry(req, &to_end2, list)
-			clear_bit(FR_PENDING, &req->flags);
 		while (forget_pending(fiq))
 			kfree(dequeue_forget(fiq, 1, NULL));
 		wake_up_all_locked(&fiq->waitq);
 		spin_unlock(&fiq->waitq.lock);
+		for_each_possible_cpu(cpu) {
+			struct fuse_iqueue_cpu *iqc;
+			LIST_HEAD(pending);
+
+			iqc = per_cpu_ptr(fiq->cpu_queues, cpu);
+			spin_lock(&iqc->waitq.lock);
+			list_splice_init(&iqc->pending, &pending);
+			list_for_each_entry(req, &pending, list)
+				clear_bit(FR_PENDING, &req->flags);
+			wake_up_all_locked(&iqc->waitq);
+			spin_unlock(&iqc->waitq.lock);
+			list_splice_tail(&pending, &to_end2);
+		}
+		/* Left behind by flush_bg_queue() failing to queue them */
+		list_for_each_entry(req, &fc->bg_queue, list) {
+			fc->active_background++;
+			clear_bit(FR_PENDING, &req->flags);
+		}
+		list_splice_tail_init(&fc->bg_queue, &to_end2);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
@@ -2312,6 +2516,17 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_passthrough_out pto;
+		struct fuse_dev *fud;
+
+		err = -EFAULT;
+		if (!copy_from_user(&pto, (void __user *) arg, sizeof(pto))) {
+			err = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				err = fuse_passthrough_open(fud, pto.fd);
+		}
 	}
 	return err;
 }
@@ -26,6 +26,8 @@
 #include <linux/xattr.h>
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
+#include <linux/idr.h>
+#include <linux/cred.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -37,7 +39,16 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
+
+/** Opcodes below this get a latency histogram */
+#define FUSE_LAT_OPCODES 64
+
+/** Number of log2(usec) buckets in a latency histogram */
+#define FUSE_LAT_BUCKETS 20
+
+/** Every this many dequeues a reader takes the oldest request of any CPU */
+#define FUSE_IQ_FAIR_INTERVAL 8
 
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
@@ -123,6 +134,12 @@ enum {
 
 struct fuse_conn;
 
+/** Lower file that reads, writes and mmaps of a fuse_file go to */
+struct fuse_passthrough {
+	struct file *filp;
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -157,6 +174,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Lower file for FUSE_PASSTHROUGH, filp is NULL if none */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -388,20 +408,44 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** CPU whose input queue the request was put on */
+	int iq_cpu;
+
+	/** Time the request was queued for userspace, in ns */
+	u64 queue_time;
 };
 
+/**
+ * Per-CPU part of the input queue
+ *
+ * Requests are queued on the submitting CPU and readers sleep on the
+ * CPU they run on, so daemon threads bound to a CPU mostly serve that
+ * CPU's requests.  A reader with nothing local steals from other CPUs.
+ */
+struct fuse_iqueue_cpu {
+	/** Protects pending, readers of this CPU wait on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+} ____cacheline_aligned_in_smp;
+
 struct fuse_iqueue {
 	/** Connection established */
 	unsigned connected;
 
-	/** Readers of the connection are waiting on this */
+	/** Protects interrupts and forgets, pollers wait on this */
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Number of dequeues, see FUSE_IQ_FAIR_INTERVAL */
+	atomic_t dequeued;
+
+	/** Per-CPU pending requests */
+	struct fuse_iqueue_cpu __percpu *cpu_queues;
 
 	/** Pending interrupts */
 	struct list_head interrupts;
@@ -417,6 +461,11 @@ struct fuse_iqueue {
 	struct fasync_struct *fasync;
 };
 
+/** Round trip time of requests, bucket i counts [2^(i-1), 2^i) usec */
+struct fuse_latency {
+	u32 hist[FUSE_LAT_OPCODES][FUSE_LAT_BUCKETS];
+};
+
 struct fuse_pqueue {
 	/** Connection established */
 	unsigned connected;
@@ -634,6 +683,9 @@ struct fuse_conn {
 	/** Allow other than the mounter user to access the filesystem ? */
 	unsigned allow_other:1;
 
+	/** Can read/write/mmap be passed through to a lower file? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -672,6 +724,15 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Lower files registered for passthrough, not yet claimed by OPEN */
+	struct idr passthrough_req;
+
+	/** Protects passthrough_req */
+	spinlock_t passthrough_req_lock;
+
+	/** Request latency histograms, per opcode */
+	struct fuse_latency __percpu *latency;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -888,7 +949,7 @@ struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -1000,4 +1061,14 @@ struct posix_acl;
 struct posix_acl *fuse_get_acl(struct inode *inode, int type);
 int fuse_set_acl(struct inode *inode, struct posix_acl *acl, int type);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_dev *fud, u32 lower_fd);
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_release_reqs(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -11,7 +11,9 @@
 #include <linux/pagemap.h>
 #include <linux/slab.h>
 #include <linux/types.h>
+#include <linux/vmalloc.h>
 #include <linux/workqueue.h>
+#include <linux/zstd.h>
 
 #include "data_mgmt.h"
 #include "format.h"
@@ -24,6 +26,20 @@ static void log_wake_up_all(struct work_struct *work)
 	wake_up_all(&rl->ml_notif_wq);
 }
 
+static void *readahead_buf_alloc(gfp_t gfp_mask, void *pool_data)
+{
+	/* Only fill the reserve, ->readpages() never allocates */
+	if (!gfpflags_allow_blocking(gfp_mask))
+		return NULL;
+
+	return kvmalloc(INCFS_READAHEAD_BUF_SIZE, gfp_mask);
+}
+
+static void readahead_buf_free(void *element, void *pool_data)
+{
+	kvfree(element);
+}
+
 struct mount_info *incfs_alloc_mount_info(struct super_block *sb,
 					  struct mount_options *options,
 					  struct path *backing_dir_path)
@@ -47,6 +63,20 @@ struct mount_info *incfs_alloc_mount_info(struct super_block *sb,
 	spin_lock_init(&mi->mi_log.rl_lock);
 	INIT_LIST_HEAD(&mi->mi_reads_list_head);
 
+	mi->mi_read_buf_pool = mempool_create_page_pool(INCFS_MIN_READ_BUFS,
+				get_order(2 * INCFS_DATA_FILE_BLOCK_SIZE));
+	if (!mi->mi_read_buf_pool) {
+		error = -ENOMEM;
+		goto err;
+	}
+
+	mi->mi_readahead_buf_pool = mempool_create(INCFS_MIN_READAHEAD_BUFS,
+				readahead_buf_alloc, readahead_buf_free, NULL);
+	if (!mi->mi_readahead_buf_pool) {
+		error = -ENOMEM;
+		goto err;
+	}
+
 	error = incfs_realloc_mount_info(mi, options);
 	if (error)
 		goto err;
@@ -114,6 +144,8 @@ void incfs_free_mount_info(struct mount_info *mi)
 	kfree(mi->mi_log.rl_ring_buf);
 	kfree(mi->log_xattr);
 	kfree(mi->pending_read_xattr);
+	mempool_destroy(mi->mi_read_buf_pool);
+	mempool_destroy(mi->mi_readahead_buf_pool);
 	kfree(mi);
 }
 
@@ -250,16 +282,95 @@ void incfs_free_dir_file(struct dir_file *dir)
 	kfree(dir);
 }
 
-static ssize_t decompress(struct mem_range src, struct mem_range dst)
+/*
+ * zstd decompression contexts, one per CPU.  They are allocated when the
+ * module is loaded and kept until it is unloaded, so the read path never
+ * allocates.
+ */
+struct zstd_workspace {
+	ZSTD_DCtx *dctx;
+	void *wksp;
+};
+
+static DEFINE_PER_CPU(struct zstd_workspace, zstd_workspaces);
+
+int incfs_alloc_decompression_workspaces(void)
 {
-	int result = LZ4_decompress_safe(src.data, dst.data, src.len, dst.len);
+	const size_t wksp_size = ZSTD_DCtxWorkspaceBound();
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct zstd_workspace *zw = per_cpu_ptr(&zstd_workspaces, cpu);
+
+		zw->wksp = vmalloc(wksp_size);
+		if (!zw->wksp)
+			goto err;
+		zw->dctx = ZSTD_initDCtx(zw->wksp, wksp_size);
+		if (!zw->dctx)
+			goto err;
+	}
+	return 0;
 
-	if (result < 0)
+err:
+	incfs_free_decompression_workspaces();
+	return -ENOMEM;
+}
+
+void incfs_free_decompression_workspaces(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct zstd_workspace *zw = per_cpu_ptr(&zstd_workspaces, cpu);
+
+		vfree(zw->wksp);
+		zw->wksp = NULL;
+		zw->dctx = NULL;
+	}
+}
+
+static ssize_t decompress_zstd(struct mem_range src, struct mem_range dst)
+{
+	struct zstd_workspace *zw;
+	size_t result;
+
+	zw = get_cpu_ptr(&zstd_workspaces);
+	result = ZSTD_decompressDCtx(zw->dctx, dst.data, dst.len,
+				     src.data, src.len);
+	put_cpu_ptr(&zstd_workspaces);
+
+	if (ZSTD_isError(result))
 		return -EBADMSG;
 
 	return result;
 }
 
+static ssize_t decompress(struct mount_info *mi,
+			  enum incfs_compression_alg alg,
+			  struct mem_range src, struct mem_range dst)
+{
+	u64 start = ktime_get_ns();
+	ssize_t result;
+
+	switch (alg) {
+	case COMPRESSION_LZ4:
+		result = LZ4_decompress_safe(src.data, dst.data, src.len,
+					     dst.len);
+		if (result < 0)
+			result = -EBADMSG;
+		break;
+	case COMPRESSION_ZSTD:
+		result = decompress_zstd(src, dst);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	atomic64_inc(&mi->mi_decompress_blocks[alg]);
+	atomic64_add(ktime_get_ns() - start, &mi->mi_decompress_ns[alg]);
+	return result;
+}
+
 static void log_read_one_record(struct read_log *rl, struct read_log_state *rs)
 {
 	union log_record *record =
@@ -386,8 +497,21 @@ static void log_block_read(struct mount_info *mi, incfs_uuid_t *id,
 	schedule_delayed_work(&log->ml_wakeup_work, msecs_to_jiffies(16));
 }
 
+/*
+ * The level 0 hash block validate_hash_tree() verified last.  Neighbouring
+ * data blocks share it, so a batch of blocks walks up the tree once per
+ * hash block instead of once per data block.
+ */
+struct hash_block_cache {
+	/* Offset of the cached hash block in the tree, -1 if none */
+	loff_t offset;
+
+	u8 *block;
+};
+
 static int validate_hash_tree(struct file *bf, struct file *f, int block_index,
-			      struct mem_range data, u8 *buf)
+			      struct mem_range data, u8 *buf,
+			      struct hash_block_cache *hc)
 {
 	struct data_file *df = get_incfs_data_file(f);
 	u8 stored_digest[INCFS_MAX_HASH_SIZE] = {};
@@ -423,6 +547,12 @@ static int validate_hash_tree(struct file *bf, struct file *f, int block_index,
 
 	memcpy(stored_digest, tree->root_hash, digest_size);
 
+	if (hc && tree->depth > 0 && hc->offset == hash_block_offset[0]) {
+		memcpy(stored_digest, hc->block + hash_offset_in_block[0],
+		       digest_size);
+		goto check_data;
+	}
+
 	file_pages = DIV_ROUND_UP(df->df_size, INCFS_DATA_FILE_BLOCK_SIZE);
 	for (lvl = tree->depth - 1; lvl >= 0; lvl--) {
 		pgoff_t hash_page =
@@ -436,6 +566,11 @@ static int validate_hash_tree(struct file *bf, struct file *f, int block_index,
 
 			memcpy(stored_digest, addr + hash_offset_in_block[lvl],
 			       digest_size);
+			if (hc && lvl == 0) {
+				memcpy(hc->block, addr,
+				       INCFS_DATA_FILE_BLOCK_SIZE);
+				hc->offset = hash_block_offset[0];
+			}
 			kunmap_atomic(addr);
 			put_page(page);
 			continue;
@@ -475,6 +610,10 @@ static int validate_hash_tree(struct file *bf, struct file *f, int block_index,
 
 		memcpy(stored_digest, buf + hash_offset_in_block[lvl],
 		       digest_size);
+		if (hc && lvl == 0) {
+			memcpy(hc->block, buf, INCFS_DATA_FILE_BLOCK_SIZE);
+			hc->offset = hash_block_offset[0];
+		}
 
 		page = grab_cache_page(f->f_inode->i_mapping, hash_page);
 		if (page) {
@@ -488,6 +627,7 @@ static int validate_hash_tree(struct file *bf, struct file *f, int block_index,
 		}
 	}
 
+check_data:
 	res = incfs_calc_digest(tree->alg, data,
 				range(calculated_digest, digest_size));
 	if (res)
@@ -526,9 +666,12 @@ static void convert_data_file_block(struct incfs_blockmap_entry *bme,
 	res_block->db_backing_file_data_offset |=
 		le32_to_cpu(bme->me_data_offset_lo);
 	res_block->db_stored_size = le16_to_cpu(bme->me_data_size);
-	res_block->db_comp_alg = (flags & INCFS_BLOCK_COMPRESSED_LZ4) ?
-					 COMPRESSION_LZ4 :
-					 COMPRESSION_NONE;
+	if (flags & INCFS_BLOCK_COMPRESSED_LZ4)
+		res_block->db_comp_alg = COMPRESSION_LZ4;
+	else if (flags & INCFS_BLOCK_COMPRESSED_ZSTD)
+		res_block->db_comp_alg = COMPRESSION_ZSTD;
+	else
+		res_block->db_comp_alg = COMPRESSION_NONE;
 }
 
 static int get_data_file_block(struct data_file *df, int index,
@@ -946,8 +1089,8 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 		bytes_to_read = min(tmp.len, block.db_stored_size);
 		result = incfs_kread(bf, tmp.data, bytes_to_read, pos);
 		if (result == bytes_to_read) {
-			result =
-				decompress(range(tmp.data, bytes_to_read), dst);
+			result = decompress(mi, block.db_comp_alg,
+					    range(tmp.data, bytes_to_read), dst);
 			if (result < 0) {
 				const char *name =
 					bf->f_path.dentry->d_name.name;
@@ -962,7 +1105,8 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 	}
 
 	if (result > 0) {
-		int err = validate_hash_tree(bf, f, index, dst, tmp.data);
+		int err = validate_hash_tree(bf, f, index, dst, tmp.data,
+					     NULL);
 
 		if (err < 0)
 			result = err;
@@ -975,6 +1119,160 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 	return result;
 }
 
+static int lock_all_segments(struct data_file *df)
+{
+	int i, error;
+
+	for (i = 0; i < ARRAY_SIZE(df->df_segments); i++) {
+		error = mutex_lock_interruptible(
+				&df->df_segments[i].blockmap_mutex);
+		if (error) {
+			while (--i >= 0)
+				mutex_unlock(&df->df_segments[i].blockmap_mutex);
+			return error;
+		}
+	}
+	return 0;
+}
+
+static void unlock_all_segments(struct data_file *df)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(df->df_segments) - 1; i >= 0; i--)
+		mutex_unlock(&df->df_segments[i].blockmap_mutex);
+}
+
+/*
+ * Read blocks [index, index + count) into dst[0..count), for readahead.
+ *
+ * The blockmap entries of the whole range are read at once, and blocks
+ * stored back to back in the backing file are fetched with a single read
+ * into tmp.  Hash blocks are shared between the blocks of a batch.
+ *
+ * Unlike incfs_read_data_file_block() this never waits for missing data:
+ * it stops at the first block that isn't there yet and leaves it to
+ * ->readpage(), which also reports it as a pending read.
+ *
+ * tmp must hold at least count + 2 blocks.  On success returns the number
+ * of leading blocks read, with dst[i].len set to the bytes read into each.
+ */
+int incfs_read_data_file_blocks(struct mem_range *dst, struct file *f,
+				int index, int count, struct mem_range tmp)
+{
+	struct incfs_blockmap_entry bme[INCFS_MAX_READAHEAD_BLOCKS];
+	struct data_file *df = get_incfs_data_file(f);
+	struct hash_block_cache hc = { .offset = -1 };
+	struct mount_info *mi;
+	struct file *bf;
+	u8 *hash_buf;
+	size_t raw_len;
+	int i, done = 0;
+	int error;
+
+	if (!dst || !df)
+		return -EFAULT;
+
+	if (count <= 0 || count > INCFS_MAX_READAHEAD_BLOCKS ||
+	    tmp.len < (count + 2) * INCFS_DATA_FILE_BLOCK_SIZE)
+		return -ERANGE;
+
+	if (index < 0 || index + count > df->df_data_block_count)
+		return -EINVAL;
+
+	if (df->df_blockmap_off <= 0)
+		return -ENODATA;
+
+	mi = df->df_mount_info;
+	bf = df->df_backing_file_context->bc_file;
+	raw_len = tmp.len - 2 * INCFS_DATA_FILE_BLOCK_SIZE;
+	hash_buf = tmp.data + raw_len;
+	hc.block = hash_buf + INCFS_DATA_FILE_BLOCK_SIZE;
+
+	error = lock_all_segments(df);
+	if (error)
+		return error;
+	error = incfs_read_blockmap_entries(df->df_backing_file_context, bme,
+					    index, count, df->df_blockmap_off);
+	unlock_all_segments(df);
+	if (error < 0)
+		return error;
+	count = error;
+
+	i = 0;
+	while (i < count) {
+		struct data_file_block block = {};
+		loff_t run_start;
+		size_t run_size;
+		int run_end, j;
+		ssize_t res;
+
+		convert_data_file_block(&bme[i], &block);
+		if (!is_data_block_present(&block) ||
+		    block.db_stored_size > raw_len)
+			break;
+
+		/* Extend the run while blocks follow each other on disk */
+		run_start = block.db_backing_file_data_offset;
+		run_size = block.db_stored_size;
+		for (run_end = i + 1; run_end < count; run_end++) {
+			convert_data_file_block(&bme[run_end], &block);
+			if (!is_data_block_present(&block) ||
+			    block.db_backing_file_data_offset !=
+					run_start + run_size ||
+			    run_size + block.db_stored_size > raw_len)
+				break;
+			run_size += block.db_stored_size;
+		}
+
+		res = incfs_kread(bf, tmp.data, run_size, run_start);
+		if (res >= 0 && res != run_size)
+			res = -EIO;
+		if (res < 0)
+			return done ? done : res;
+
+		for (j = i; j < run_end; j++) {
+			struct mem_range src;
+
+			convert_data_file_block(&bme[j], &block);
+			src = range(tmp.data +
+				    (block.db_backing_file_data_offset -
+				     run_start),
+				    block.db_stored_size);
+
+			if (block.db_comp_alg == COMPRESSION_NONE) {
+				res = min(dst[j].len, src.len);
+				memcpy(dst[j].data, src.data, res);
+			} else {
+				res = decompress(mi, block.db_comp_alg, src,
+						 dst[j]);
+				if (res < 0) {
+					pr_warn_once("incfs: Decompression error. %s",
+						bf->f_path.dentry->d_name.name);
+				}
+			}
+
+			if (res > 0) {
+				int err = validate_hash_tree(bf, f, index + j,
+						range(dst[j].data, res),
+						hash_buf, &hc);
+
+				if (err < 0)
+					res = err;
+			}
+			if (res < 0)
+				return done ? done : res;
+
+			log_block_read(mi, &df->df_id, index + j);
+			dst[j].len = res;
+			done++;
+		}
+		i = run_end;
+	}
+
+	return done;
+}
+
 int incfs_process_new_data_block(struct data_file *df,
 				 struct incfs_fill_block *block, u8 *data)
 {
@@ -999,6 +1297,10 @@ int incfs_process_new_data_block(struct data_file *df,
 		return -EFAULT;
 	if (block->compression == COMPRESSION_LZ4)
 		flags |= INCFS_BLOCK_COMPRESSED_LZ4;
+	else if (block->compression == COMPRESSION_ZSTD)
+		flags |= INCFS_BLOCK_COMPRESSED_ZSTD;
+	else if (block->compression != COMPRESSION_NONE)
+		return -EINVAL;
 
 	error = mutex_lock_interruptible(&segment->blockmap_mutex);
 	if (error)
@@ -11,6 +11,7 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/completion.h>
+#include <linux/mempool.h>
 #include <linux/wait.h>
 #include <crypto/hash.h>
 
@@ -20,6 +21,17 @@
 
 #define SEGMENTS_PER_FILE 3
 
+/* Largest batch incfs_read_data_file_blocks() reads */
+#define INCFS_MAX_READAHEAD_BLOCKS 32
+
+/* Scratch buffers kept in reserve for ->readpage() */
+#define INCFS_MIN_READ_BUFS 4
+
+/* Scratch buffers kept in reserve for ->readpages() */
+#define INCFS_MIN_READAHEAD_BUFS 2
+#define INCFS_READAHEAD_BUF_SIZE \
+	((INCFS_MAX_READAHEAD_BLOCKS + 2) * INCFS_DATA_FILE_BLOCK_SIZE)
+
 enum LOG_RECORD_TYPE {
 	FULL,
 	SAME_FILE,
@@ -151,6 +163,16 @@ struct mount_info {
 
 	void *pending_read_xattr;
 	size_t pending_read_xattr_size;
+
+	/* Scratch buffers for ->readpage(), two blocks each */
+	mempool_t *mi_read_buf_pool;
+
+	/* Scratch buffers for ->readpages(), INCFS_READAHEAD_BUF_SIZE each */
+	mempool_t *mi_readahead_buf_pool;
+
+	/* Decompression counters, indexed by enum incfs_compression_alg */
+	atomic64_t mi_decompress_blocks[COMPRESSION_ZSTD + 1];
+	atomic64_t mi_decompress_ns[COMPRESSION_ZSTD + 1];
 };
 
 struct data_file_block {
@@ -280,6 +302,12 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 				   int index, int timeout_ms,
 				   struct mem_range tmp);
 
+int incfs_read_data_file_blocks(struct mem_range *dst, struct file *f,
+				int index, int count, struct mem_range tmp);
+
+int incfs_alloc_decompression_workspaces(void);
+void incfs_free_decompression_workspaces(void);
+
 int incfs_get_filled_blocks(struct data_file *df,
 			    struct incfs_get_filled_blocks_args *arg);
 
@@ -8,6 +8,7 @@
 
 #include <uapi/linux/incrementalfs.h>
 
+#include "data_mgmt.h"
 #include "vfs.h"
 
 #define INCFS_NODE_FEATURES "features"
@@ -28,8 +29,17 @@ static ssize_t corefs_show(struct kobject *kobj,
 
 static struct kobj_attribute corefs_attr = __ATTR_RO(corefs);
 
+static ssize_t zstd_show(struct kobject *kobj,
+			 struct kobj_attribute *attr, char *buff)
+{
+	return snprintf(buff, PAGE_SIZE, "supported\n");
+}
+
+static struct kobj_attribute zstd_attr = __ATTR_RO(zstd);
+
 static struct attribute *attributes[] = {
 	&corefs_attr.attr,
+	&zstd_attr.attr,
 	NULL,
 };
 
@@ -76,14 +86,24 @@ static int __init init_incfs_module(void)
 {
 	int err = 0;
 
-	err = init_sysfs();
+	err = incfs_alloc_decompression_workspaces();
 	if (err)
 		return err;
 
+	err = init_sysfs();
+	if (err)
+		goto err_workspaces;
+
 	err = register_filesystem(&incfs_fs_type);
 	if (err)
-		cleanup_sysfs();
+		goto err_sysfs;
 
+	return 0;
+
+err_sysfs:
+	cleanup_sysfs();
+err_workspaces:
+	incfs_free_decompression_workspaces();
 	return err;
 }
 
@@ -91,6 +111,7 @@ static void __exit cleanup_incfs_module(void)
 {
 	cleanup_sysfs();
 	unregister_filesystem(&incfs_fs_type);
+	incfs_free_decompression_workspaces();
 }
 
 module_init(init_incfs_module);
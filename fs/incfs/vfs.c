@@ -9,6 +9,7 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/fs_stack.h>
+#include <linux/mm_inline.h>
 #include <linux/namei.h>
 #include <linux/parser.h>
 #include <linux/poll.h>
@@ -53,6 +54,8 @@ static int dir_rename(struct inode *old_dir, struct dentry *old_dentry,
 static int file_open(struct inode *inode, struct file *file);
 static int file_release(struct inode *inode, struct file *file);
 static int read_single_page(struct file *f, struct page *page);
+static int readpages(struct file *f, struct address_space *mapping,
+		     struct list_head *pages, unsigned int nr_pages);
 static long dispatch_ioctl(struct file *f, unsigned int req, unsigned long arg);
 
 static ssize_t pending_reads_read(struct file *f, char __user *buf, size_t len,
@@ -123,7 +126,7 @@ static const struct dentry_operations incfs_dentry_ops = {
 
 static const struct address_space_operations incfs_address_space_ops = {
 	.readpage = read_single_page,
-	/* .readpages = readpages */
+	.readpages = readpages
 };
 
 static const struct file_operations incfs_file_ops = {
@@ -811,17 +814,19 @@ static int read_single_page(struct file *f, struct page *page)
 	timeout_ms = df->df_mount_info->mi_options.read_timeout_ms;
 
 	if (offset < size) {
+		mempool_t *pool = df->df_mount_info->mi_read_buf_pool;
+		struct page *tmp_page = mempool_alloc(pool, GFP_NOFS);
 		struct mem_range tmp = {
+			.data = page_address(tmp_page),
 			.len = 2 * INCFS_DATA_FILE_BLOCK_SIZE
 		};
 
-		tmp.data = (u8 *)__get_free_pages(GFP_NOFS, get_order(tmp.len));
 		bytes_to_read = min_t(loff_t, size - offset, PAGE_SIZE);
 		read_result = incfs_read_data_file_block(
 			range(page_start, bytes_to_read), f, block_index,
 			timeout_ms, tmp);
 
-		free_pages((unsigned long)tmp.data, get_order(tmp.len));
+		mempool_free(tmp_page, pool);
 	} else {
 		bytes_to_read = 0;
 		read_result = 0;
@@ -843,6 +848,91 @@ static int read_single_page(struct file *f, struct page *page)
 	return result;
 }
 
+static void read_pages_batch(struct file *f, struct page **pages, int count,
+			     struct mem_range tmp)
+{
+	struct data_file *df = get_incfs_data_file(f);
+	struct mem_range dst[INCFS_MAX_READAHEAD_BLOCKS];
+	int read = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		dst[i] = range(kmap(pages[i]),
+			       min_t(loff_t, df->df_size - page_offset(pages[i]),
+				     PAGE_SIZE));
+
+	read = incfs_read_data_file_blocks(dst, f, pages[0]->index, count,
+					   tmp);
+
+	/*
+	 * Pages past the first missing or bad block are left !Uptodate,
+	 * ->readpage() waits for them or reports the error.
+	 */
+	for (i = 0; i < count; i++) {
+		if (i < read) {
+			if (dst[i].len < PAGE_SIZE)
+				zero_user(pages[i], dst[i].len,
+					  PAGE_SIZE - dst[i].len);
+			SetPageUptodate(pages[i]);
+			flush_dcache_page(pages[i]);
+		}
+		kunmap(pages[i]);
+		unlock_page(pages[i]);
+		put_page(pages[i]);
+	}
+}
+
+static int readpages(struct file *f, struct address_space *mapping,
+		     struct list_head *pages, unsigned int nr_pages)
+{
+	struct page *batch[INCFS_MAX_READAHEAD_BLOCKS];
+	struct data_file *df = get_incfs_data_file(f);
+	mempool_t *pool;
+	struct mem_range tmp = {
+		.len = INCFS_READAHEAD_BUF_SIZE
+	};
+
+	if (!df)
+		return -EBADF;
+
+	/*
+	 * Readahead is optional, pages left on the list are freed. Don't
+	 * wait for a buffer when all of the reserved ones are busy.
+	 */
+	pool = df->df_mount_info->mi_readahead_buf_pool;
+	tmp.data = mempool_alloc(pool, GFP_NOWAIT | __GFP_NOWARN);
+	if (!tmp.data)
+		return 0;
+
+	while (!list_empty(pages)) {
+		int count = 0;
+
+		/* Gather consecutive pages, the list is in ascending order */
+		while (!list_empty(pages) &&
+		       count < INCFS_MAX_READAHEAD_BLOCKS) {
+			struct page *page = lru_to_page(pages);
+
+			if (count && page->index != batch[count - 1]->index + 1)
+				break;
+
+			list_del(&page->lru);
+			if (page_offset(page) >= df->df_size ||
+			    add_to_page_cache_lru(page, mapping, page->index,
+					readahead_gfp_mask(mapping))) {
+				put_page(page);
+				break;
+			}
+			batch[count++] = page;
+		}
+
+		if (count)
+			read_pages_batch(f, batch, count, tmp);
+	}
+
+	mempool_free(tmp.data, pool);
+	return 0;
+}
+
 static char *file_id_to_str(incfs_uuid_t id)
 {
 	char *result = kmalloc(1 + sizeof(id.bytes) * 2, GFP_NOFS);
@@ -1474,6 +1564,26 @@ static long ioctl_get_filled_blocks(struct file *f, void __user *arg)
 	return error;
 }
 
+static long ioctl_get_decompression_stats(struct mount_info *mi,
+					  void __user *arg)
+{
+	struct incfs_get_decompression_stats_args args = {
+		.lz4_blocks = atomic64_read(
+			&mi->mi_decompress_blocks[COMPRESSION_LZ4]),
+		.lz4_time_us = div_u64(atomic64_read(
+			&mi->mi_decompress_ns[COMPRESSION_LZ4]), NSEC_PER_USEC),
+		.zstd_blocks = atomic64_read(
+			&mi->mi_decompress_blocks[COMPRESSION_ZSTD]),
+		.zstd_time_us = div_u64(atomic64_read(
+			&mi->mi_decompress_ns[COMPRESSION_ZSTD]), NSEC_PER_USEC),
+	};
+
+	if (copy_to_user(arg, &args, sizeof(args)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static long dispatch_ioctl(struct file *f, unsigned int req, unsigned long arg)
 {
 	struct mount_info *mi = get_mount_info(file_superblock(f));
@@ -1489,6 +1599,8 @@ static long dispatch_ioctl(struct file *f, unsigned int req, unsigned long arg)
 		return ioctl_read_file_signature(f, (void __user *)arg);
 	case INCFS_IOC_GET_FILLED_BLOCKS:
 		return ioctl_get_filled_blocks(f, (void __user *)arg);
+	case INCFS_IOC_GET_DECOMPRESSION_STATS:
+		return ioctl_get_decompression_stats(mi, (void __user *)arg);
 	default:
 		return -EINVAL;
 	}
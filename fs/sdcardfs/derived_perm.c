@@ -48,6 +48,43 @@ void setup_derived_state(struct inode *inode, perm_t perm, userid_t userid,
 	info->data->under_obb = false;
 }
 
+/*
+ * Resolve the owner of a package directory, skipping the package list
+ * lookups when the inode already resolved the same name for the same
+ * user and the list has not changed since.
+ */
+static uid_t get_package_uid(struct sdcardfs_inode_data *data,
+		const struct qstr *name, userid_t userid)
+{
+	unsigned int gen = packagelist_generation();
+	appid_t appid;
+	uid_t uid = 0;
+
+	if (smp_load_acquire(&data->pkg_gen) == gen &&
+			data->pkg_userid == userid &&
+			data->pkg_hash_len == name->hash_len)
+		return data->pkg_uid;
+
+	appid = get_appid(name->name);
+	if (appid != 0 && !is_excluded(name->name, userid))
+		uid = multiuser_get_uid(userid, appid);
+
+	data->pkg_userid = userid;
+	data->pkg_uid = uid;
+	data->pkg_hash_len = name->hash_len;
+	smp_store_release(&data->pkg_gen, gen);
+	return uid;
+}
+
+/*
+ * The cached package owner is keyed by the name hash only, so forget it
+ * when the directory gets a new name. packagelist_generation() is never 0.
+ */
+void reset_package_uid(struct inode *inode)
+{
+	smp_store_release(&SDCARDFS_I(inode)->data->pkg_gen, 0);
+}
+
 /* While renaming, there is a point where we want the path from dentry,
  * but the name from newdentry
  */
@@ -57,7 +94,7 @@ void get_derived_permission_new(struct dentry *parent, struct dentry *dentry,
 	struct sdcardfs_inode_info *info = SDCARDFS_I(d_inode(dentry));
 	struct sdcardfs_inode_info *parent_info = SDCARDFS_I(d_inode(parent));
 	struct sdcardfs_inode_data *parent_data = parent_info->data;
-	appid_t appid;
+	uid_t uid;
 	unsigned long user_num;
 	int err;
 	struct qstr q_Android = QSTR_LITERAL("Android");
@@ -126,10 +163,12 @@ void get_derived_permission_new(struct dentry *parent, struct dentry *dentry,
 	case PERM_ANDROID_DATA:
 	case PERM_ANDROID_MEDIA:
 		info->data->perm = PERM_ANDROID_PACKAGE;
-		appid = get_appid(name->name);
-		if (appid != 0 && !is_excluded(name->name, parent_data->userid))
-			info->data->d_uid =
-				multiuser_get_uid(parent_data->userid, appid);
+		/* the cache is keyed on the dentry's own name, not a rename target */
+		if (name != &dentry->d_name)
+			info->data->pkg_gen = 0;
+		uid = get_package_uid(info->data, name, parent_data->userid);
+		if (uid)
+			info->data->d_uid = uid;
 		break;
 	case PERM_ANDROID_PACKAGE:
 		if (qstr_case_eq(name, &q_cache)) {
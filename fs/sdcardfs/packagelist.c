@@ -19,7 +19,8 @@
  */
 
 #include "sdcardfs.h"
-#include <linux/hashtable.h>
+#include <linux/rhashtable.h>
+#include <linux/jhash.h>
 #include <linux/ctype.h>
 #include <linux/delay.h>
 #include <linux/radix-tree.h>
@@ -32,16 +33,32 @@
 #include <linux/configfs.h>
 
 struct hashtable_entry {
-	struct hlist_node hlist;
+	union {
+		struct rhash_head hnode;	/* package_to_appid, ext_to_groupid */
+		struct rhlist_head lnode;	/* package_to_userid */
+	};
 	struct hlist_node dlist; /* for deletion cleanup */
 	struct qstr key;
 	atomic_t value;
 };
 
-static DEFINE_HASHTABLE(package_to_appid, 8);
-static DEFINE_HASHTABLE(package_to_userid, 8);
-static DEFINE_HASHTABLE(ext_to_groupid, 8);
+/*
+ * All three tables are keyed on the case-insensitive name hash computed
+ * once by qstr_init(), so lookups are lock-free under RCU and the tables
+ * grow and shrink with the package list instead of being fixed at 256
+ * buckets. A package may be excluded for several users, which makes
+ * package_to_userid a list table.
+ */
+static struct rhashtable package_to_appid;
+static struct rhltable package_to_userid;
+static struct rhashtable ext_to_groupid;
 
+/*
+ * Bumped whenever package_to_appid or package_to_userid changes, so that
+ * derived permissions cached in inodes can tell when they went stale.
+ * Zero is never used, it marks an empty cache.
+ */
+static atomic_t packagelist_gen = ATOMIC_INIT(1);
 
 static struct kmem_cache *hashtable_entry_cachep;
 
@@ -68,23 +85,74 @@ static inline int qstr_copy(const struct qstr *src, struct qstr *dest)
 	return !!dest->name;
 }
 
+static u32 packagelist_key_hash(const void *data, u32 len, u32 seed)
+{
+	const struct qstr *key = data;
+
+	return jhash_1word(key->hash, seed);
+}
+
+static u32 packagelist_obj_hash(const void *data, u32 len, u32 seed)
+{
+	const struct hashtable_entry *entry = data;
+
+	return packagelist_key_hash(&entry->key, len, seed);
+}
+
+static int packagelist_obj_cmp(struct rhashtable_compare_arg *arg,
+		const void *obj)
+{
+	const struct hashtable_entry *entry = obj;
+
+	return !qstr_case_eq(arg->key, &entry->key);
+}
+
+static const struct rhashtable_params packagelist_params = {
+	.head_offset = offsetof(struct hashtable_entry, hnode),
+	.key_offset = offsetof(struct hashtable_entry, key),
+	.hashfn = packagelist_key_hash,
+	.obj_hashfn = packagelist_obj_hash,
+	.obj_cmpfn = packagelist_obj_cmp,
+	.automatic_shrinking = true,
+};
+
+static const struct rhashtable_params packagelist_userid_params = {
+	.head_offset = offsetof(struct hashtable_entry, lnode),
+	.key_offset = offsetof(struct hashtable_entry, key),
+	.hashfn = packagelist_key_hash,
+	.obj_hashfn = packagelist_obj_hash,
+	.obj_cmpfn = packagelist_obj_cmp,
+	.automatic_shrinking = true,
+};
+
+unsigned int packagelist_generation(void)
+{
+	unsigned int gen = atomic_read(&packagelist_gen);
+
+	/* pairs with the barrier in packagelist_changed() */
+	smp_rmb();
+	return gen;
+}
+
+/* called with sdcardfs_super_list_lock held, after the tables changed */
+static void packagelist_changed(void)
+{
+	if (unlikely(atomic_inc_return(&packagelist_gen) == 0))
+		atomic_inc(&packagelist_gen);
+}
+
 
 static appid_t __get_appid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	appid_t ret_id;
+	appid_t ret_id = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	hash_cur = rhashtable_lookup(&package_to_appid, key, packagelist_params);
+	if (hash_cur)
+		ret_id = atomic_read(&hash_cur->value);
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
 appid_t get_appid(const char *key)
@@ -98,19 +166,14 @@ appid_t get_appid(const char *key)
 static appid_t __get_ext_gid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	appid_t ret_id;
+	appid_t ret_id = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	hash_cur = rhashtable_lookup(&ext_to_groupid, key, packagelist_params);
+	if (hash_cur)
+		ret_id = atomic_read(&hash_cur->value);
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
 appid_t get_ext_gid(const char *key)
@@ -124,12 +187,13 @@ appid_t get_ext_gid(const char *key)
 static appid_t __is_excluded(const struct qstr *app_name, userid_t user)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = app_name->hash;
+	struct rhlist_head *list, *pos;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == user &&
-				qstr_case_eq(app_name, &hash_cur->key)) {
+	list = rhltable_lookup(&package_to_userid, app_name,
+			packagelist_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode) {
+		if (atomic_read(&hash_cur->value) == user) {
 			rcu_read_unlock();
 			return 1;
 		}
@@ -182,7 +246,6 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	if (!ret)
 		return NULL;
 	INIT_HLIST_NODE(&ret->dlist);
-	INIT_HLIST_NODE(&ret->hlist);
 
 	if (!qstr_copy(key, &ret->key)) {
 		kmem_cache_free(hashtable_entry_cachep, ret);
@@ -193,59 +256,95 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	return ret;
 }
 
+static void free_hashtable_entry(struct hashtable_entry *entry)
+{
+	kfree(entry->key.name);
+	kmem_cache_free(hashtable_entry_cachep, entry);
+}
+
+static void free_hashtable_entry_cb(void *ptr, void *arg)
+{
+	free_hashtable_entry(ptr);
+}
+
 static int insert_packagelist_appid_entry_locked(const struct qstr *key, appid_t value)
 {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			atomic_set(&hash_cur->value, value);
-			return 0;
-		}
+	rcu_read_lock();
+	hash_cur = rhashtable_lookup(&package_to_appid, key, packagelist_params);
+	if (hash_cur) {
+		atomic_set(&hash_cur->value, value);
+		rcu_read_unlock();
+		packagelist_changed();
+		return 0;
 	}
+	rcu_read_unlock();
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_appid, &new_entry->hlist, hash);
+	err = rhashtable_insert_fast(&package_to_appid, &new_entry->hnode,
+			packagelist_params);
+	if (err) {
+		free_hashtable_entry(new_entry);
+		return err;
+	}
+	packagelist_changed();
 	return 0;
 }
 
 static int insert_ext_gid_entry_locked(const struct qstr *key, appid_t value)
 {
-	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	bool exists;
+	int err;
 
 	/* An extension can only belong to one gid */
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key))
-			return -EINVAL;
-	}
+	rcu_read_lock();
+	exists = rhashtable_lookup(&ext_to_groupid, key, packagelist_params);
+	rcu_read_unlock();
+	if (exists)
+		return -EINVAL;
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(ext_to_groupid, &new_entry->hlist, hash);
-	return 0;
+	err = rhashtable_insert_fast(&ext_to_groupid, &new_entry->hnode,
+			packagelist_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
 }
 
 static int insert_userid_exclude_entry_locked(const struct qstr *key, userid_t value)
 {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	struct rhlist_head *list, *pos;
+	int err;
 
 	/* Only insert if not already present */
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == value &&
-				qstr_case_eq(key, &hash_cur->key))
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key,
+			packagelist_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode) {
+		if (atomic_read(&hash_cur->value) == value) {
+			rcu_read_unlock();
 			return 0;
+		}
 	}
+	rcu_read_unlock();
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_userid, &new_entry->hlist, hash);
+	err = rhltable_insert_key(&package_to_userid, &new_entry->key,
+			&new_entry->lnode, packagelist_userid_params);
+	if (err) {
+		free_hashtable_entry(new_entry);
+		return err;
+	}
+	packagelist_changed();
 	return 0;
 }
 
@@ -326,32 +425,34 @@ static int insert_userid_exclude_entry(const struct qstr *key, userid_t value)
 	return err;
 }
 
-static void free_hashtable_entry(struct hashtable_entry *entry)
-{
-	kfree(entry->key.name);
-	kmem_cache_free(hashtable_entry_cachep, entry);
-}
-
 static void remove_packagelist_entry_locked(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
+	struct rhlist_head *list, *pos;
 	struct hlist_node *h_t;
 	HLIST_HEAD(free_list);
 
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
-	}
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-			break;
-		}
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key,
+			packagelist_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode)
+		hlist_add_head(&hash_cur->dlist, &free_list);
+	rcu_read_unlock();
+	hlist_for_each_entry(hash_cur, &free_list, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->lnode,
+				packagelist_userid_params);
+
+	rcu_read_lock();
+	hash_cur = rhashtable_lookup(&package_to_appid, key, packagelist_params);
+	if (hash_cur) {
+		rhashtable_remove_fast(&package_to_appid, &hash_cur->hnode,
+				packagelist_params);
+		hlist_add_head(&hash_cur->dlist, &free_list);
 	}
+	rcu_read_unlock();
+	if (hlist_empty(&free_list))
+		return;
+	packagelist_changed();
 	synchronize_rcu();
 	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
 		free_hashtable_entry(hash_cur);
@@ -368,15 +469,18 @@ static void remove_packagelist_entry(const struct qstr *key)
 static void remove_ext_gid_entry_locked(const struct qstr *key, gid_t group)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
 
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) && atomic_read(&hash_cur->value) == group) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
-			break;
-		}
+	rcu_read_lock();
+	hash_cur = rhashtable_lookup(&ext_to_groupid, key, packagelist_params);
+	if (hash_cur && atomic_read(&hash_cur->value) != group)
+		hash_cur = NULL;
+	if (hash_cur)
+		rhashtable_remove_fast(&ext_to_groupid, &hash_cur->hnode,
+				packagelist_params);
+	rcu_read_unlock();
+	if (hash_cur) {
+		synchronize_rcu();
+		free_hashtable_entry(hash_cur);
 	}
 }
 
@@ -390,16 +494,32 @@ static void remove_ext_gid_entry(const struct qstr *key, gid_t group)
 static void remove_userid_all_entry_locked(userid_t userid)
 {
 	struct hashtable_entry *hash_cur;
+	struct rhashtable_iter iter;
 	struct hlist_node *h_t;
 	HLIST_HEAD(free_list);
-	int i;
 
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		if (atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
+	/*
+	 * Collect first and remove afterwards, the walk may restart on a
+	 * concurrent resize and hand out the same entry twice.
+	 */
+	rhltable_walk_enter(&package_to_userid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur))
+			continue;
+		if (atomic_read(&hash_cur->value) == userid &&
+				hlist_unhashed(&hash_cur->dlist))
 			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
 	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
+
+	if (hlist_empty(&free_list))
+		return;
+	hlist_for_each_entry(hash_cur, &free_list, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->lnode,
+				packagelist_userid_params);
+	packagelist_changed();
 	synchronize_rcu();
 	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist) {
 		free_hashtable_entry(hash_cur);
@@ -417,17 +537,26 @@ static void remove_userid_all_entry(userid_t userid)
 static void remove_userid_exclude_entry_locked(const struct qstr *key, userid_t userid)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) &&
-				atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
+	struct rhlist_head *list, *pos;
+	bool found = false;
+
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key,
+			packagelist_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode) {
+		if (atomic_read(&hash_cur->value) == userid) {
+			found = true;
 			break;
 		}
 	}
+	rcu_read_unlock();
+	if (!found)
+		return;
+	rhltable_remove(&package_to_userid, &hash_cur->lnode,
+			packagelist_userid_params);
+	packagelist_changed();
+	synchronize_rcu();
+	free_hashtable_entry(hash_cur);
 }
 
 static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
@@ -440,23 +569,14 @@ static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
 
 static void packagelist_destroy(void)
 {
-	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
-
 	mutex_lock(&sdcardfs_super_list_lock);
-	hash_for_each_rcu(package_to_appid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
-	}
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
-	}
 	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+	rhashtable_free_and_destroy(&package_to_appid,
+			free_hashtable_entry_cb, NULL);
+	rhltable_free_and_destroy(&package_to_userid,
+			free_hashtable_entry_cb, NULL);
+	rhashtable_free_and_destroy(&ext_to_groupid,
+			free_hashtable_entry_cb, NULL);
 	mutex_unlock(&sdcardfs_super_list_lock);
 	pr_info("sdcardfs: destroyed packagelist pkgld\n");
 }
@@ -524,15 +644,15 @@ static ssize_t package_details_excluded_userids_show(struct config_item *item,
 {
 	struct package_details *package_details = to_package_details(item);
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = package_details->name.hash;
+	struct rhlist_head *list, *pos;
 	int count = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(&package_details->name, &hash_cur->key))
-			count += scnprintf(page + count, PAGE_SIZE - count,
-					"%d ", atomic_read(&hash_cur->value));
-	}
+	list = rhltable_lookup(&package_to_userid, &package_details->name,
+			packagelist_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, lnode)
+		count += scnprintf(page + count, PAGE_SIZE - count,
+				"%d ", atomic_read(&hash_cur->value));
 	rcu_read_unlock();
 	if (count)
 		count--;
@@ -751,22 +871,24 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 {
 	struct hashtable_entry *hash_cur_app;
 	struct hashtable_entry *hash_cur_user;
-	int i;
+	struct rhashtable_iter iter;
+	struct rhlist_head *list, *pos;
 	int count = 0, written = 0;
 	const char errormsg[] = "<truncated>\n";
-	unsigned int hash;
 
-	rcu_read_lock();
-	hash_for_each_rcu(package_to_appid, i, hash_cur_app, hlist) {
+	rhashtable_walk_enter(&package_to_appid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur_app = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur_app))
+			continue;
 		written = scnprintf(page + count, PAGE_SIZE - sizeof(errormsg) - count, "%s %d\n",
 					hash_cur_app->key.name, atomic_read(&hash_cur_app->value));
-		hash = hash_cur_app->key.hash;
-		hash_for_each_possible_rcu(package_to_userid, hash_cur_user, hlist, hash) {
-			if (qstr_case_eq(&hash_cur_app->key, &hash_cur_user->key)) {
-				written += scnprintf(page + count + written - 1,
-					PAGE_SIZE - sizeof(errormsg) - count - written + 1,
-					" %d\n", atomic_read(&hash_cur_user->value)) - 1;
-			}
+		list = rhltable_lookup(&package_to_userid, &hash_cur_app->key,
+				packagelist_userid_params);
+		rhl_for_each_entry_rcu(hash_cur_user, pos, list, lnode) {
+			written += scnprintf(page + count + written - 1,
+				PAGE_SIZE - sizeof(errormsg) - count - written + 1,
+				" %d\n", atomic_read(&hash_cur_user->value)) - 1;
 		}
 		if (count + written == PAGE_SIZE - sizeof(errormsg) - 1) {
 			count += scnprintf(page + count, PAGE_SIZE - count, errormsg);
@@ -774,7 +896,8 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 		}
 		count += written;
 	}
-	rcu_read_unlock();
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 
 	return count;
 }
@@ -862,6 +985,8 @@ static void configfs_sdcardfs_exit(void)
 
 int packagelist_init(void)
 {
+	int err;
+
 	hashtable_entry_cachep =
 		kmem_cache_create("packagelist_hashtable_entry",
 					sizeof(struct hashtable_entry), 0, 0, NULL);
@@ -870,13 +995,36 @@ int packagelist_init(void)
 		return -ENOMEM;
 	}
 
+	err = rhashtable_init(&package_to_appid, &packagelist_params);
+	if (err)
+		goto out_cache;
+	err = rhltable_init(&package_to_userid, &packagelist_userid_params);
+	if (err)
+		goto out_appid;
+	err = rhashtable_init(&ext_to_groupid, &packagelist_params);
+	if (err)
+		goto out_userid;
+
 	configfs_sdcardfs_init();
 	return 0;
+
+out_userid:
+	rhltable_destroy(&package_to_userid);
+out_appid:
+	rhashtable_destroy(&package_to_appid);
+out_cache:
+	pr_err("sdcardfs: failed creating packagelist hashtables\n");
+	kmem_cache_destroy(hashtable_entry_cachep);
+	hashtable_entry_cachep = NULL;
+	return err;
 }
 
 void packagelist_exit(void)
 {
+	if (!hashtable_entry_cachep)
+		return;
 	configfs_sdcardfs_exit();
 	packagelist_destroy();
 	kmem_cache_destroy(hashtable_entry_cachep);
+	hashtable_entry_cachep = NULL;
 }
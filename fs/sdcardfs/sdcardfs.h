@@ -167,6 +167,16 @@ struct sdcardfs_inode_data {
 	bool under_android;
 	bool under_cache;
 	bool under_obb;
+
+	/*
+	 * Owner of an Android/{data,obb,media}/<package> directory as last
+	 * resolved from the package list, valid while pkg_gen matches
+	 * packagelist_generation().
+	 */
+	unsigned int pkg_gen;
+	userid_t pkg_userid;
+	uid_t pkg_uid;
+	u64 pkg_hash_len;
 };
 
 /* sdcardfs inode data in memory */
@@ -488,6 +498,7 @@ extern struct list_head sdcardfs_super_list;
 extern appid_t get_appid(const char *app_name);
 extern appid_t get_ext_gid(const char *app_name);
 extern appid_t is_excluded(const char *app_name, userid_t userid);
+extern unsigned int packagelist_generation(void);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
@@ -505,6 +516,7 @@ extern void setup_derived_state(struct inode *inode, perm_t perm,
 			userid_t userid, uid_t uid);
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
 extern void get_derived_permission_new(struct dentry *parent, struct dentry *dentry, const struct qstr *name);
+extern void reset_package_uid(struct inode *inode);
 extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
 
 extern void update_derived_permission_lock(struct dentry *dentry);
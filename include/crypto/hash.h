@@ -164,9 +164,15 @@ struct shash_desc {
  * @setkey: see struct ahash_alg
  * @digestsize: see struct ahash_alg
  * @statesize: see struct ahash_alg
+ * @finup_mb: Finish hashing several messages of the same length, each
+ *	      starting from the state in the descriptor, interleaving the
+ *	      computation where the CPU can overlap it. The state of the
+ *	      descriptor is undefined afterwards. Optional.
  * @descsize: Size of the operational state for the message digest. This state
  * 	      size is the memory size that needs to be allocated for
  *	      shash_desc.__ctx
+ * @mb_max_msgs: Maximum number of messages @finup_mb takes at once, 1 if it
+ *		 is not implemented.
  * @base: internally used
  */
 struct shash_alg {
@@ -182,8 +188,12 @@ struct shash_alg {
 	int (*import)(struct shash_desc *desc, const void *in);
 	int (*setkey)(struct crypto_shash *tfm, const u8 *key,
 		      unsigned int keylen);
+	int (*finup_mb)(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs);
 
 	unsigned int descsize;
+	unsigned int mb_max_msgs;
 
 	/* These fields must match hash_alg_common. */
 	unsigned int digestsize
@@ -758,6 +768,18 @@ static inline unsigned int crypto_shash_statesize(struct crypto_shash *tfm)
 	return crypto_shash_alg(tfm)->statesize;
 }
 
+/**
+ * crypto_shash_mb_max_msgs() - obtain the multibuffer hashing width
+ * @tfm: cipher handle
+ *
+ * Return: the maximum number of messages crypto_shash_finup_mb() hashes in
+ *	   an interleaved way; 1 if the algorithm has no such implementation
+ */
+static inline unsigned int crypto_shash_mb_max_msgs(struct crypto_shash *tfm)
+{
+	return crypto_shash_alg(tfm)->mb_max_msgs;
+}
+
 static inline u32 crypto_shash_get_flags(struct crypto_shash *tfm)
 {
 	return crypto_tfm_get_flags(crypto_shash_tfm(tfm));
@@ -934,6 +956,26 @@ int crypto_shash_final(struct shash_desc *desc, u8 *out);
 int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 		       unsigned int len, u8 *out);
 
+/**
+ * crypto_shash_finup_mb() - finish hashing several messages at once
+ * @desc: operational state handle holding the common prefix of the messages
+ * @data: the remaining data of each message
+ * @len: length of the remaining data, the same for all messages
+ * @outs: output buffers for the message digests
+ * @num_msgs: the number of messages
+ *
+ * This is equivalent to calling crypto_shash_finup() on a copy of @desc for
+ * each message, but lets the algorithm interleave up to
+ * crypto_shash_mb_max_msgs() of them. The state of @desc is undefined
+ * afterwards.
+ *
+ * Return: 0 if the message digest creation was successful; < 0 if an error
+ *	   occurred
+ */
+int crypto_shash_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			  unsigned int len, u8 * const outs[],
+			  unsigned int num_msgs);
+
 static inline void shash_desc_zero(struct shash_desc *desc)
 {
 	memzero_explicit(desc,
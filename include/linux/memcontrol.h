@@ -203,6 +203,13 @@ struct mem_cgroup {
 	 */
 	bool use_hierarchy;
 
+#ifdef CONFIG_ZRAM_MEMCG
+	/* compressed bytes stored in zram on behalf of this subtree */
+	atomic_long_t zram_usage;
+	unsigned long zram_limit;
+	atomic_long_t zram_failcnt;
+#endif
+
 	/* protected by memcg_oom_lock */
 	bool		oom_lock;
 	int		under_oom;
@@ -1020,6 +1027,13 @@ void count_memcg_event_mm(struct mm_struct *mm, enum vm_event_item idx)
 }
 #endif /* CONFIG_MEMCG */
 
+#ifdef CONFIG_ZRAM_MEMCG
+int mem_cgroup_zram_charge(struct page *page, unsigned long size,
+			   unsigned short *id);
+void mem_cgroup_zram_shrink(unsigned short id, unsigned long size);
+void mem_cgroup_zram_uncharge(unsigned short id, unsigned long size);
+#endif
+
 /* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline void __inc_memcg_state(struct mem_cgroup *memcg,
 				     int idx)
@@ -538,6 +538,9 @@ extern int register_cpu_cycle_counter_cb(struct cpu_cycle_counter_cb *cb);
 extern void sched_set_io_is_busy(int val);
 extern int sched_set_group_id(struct task_struct *p, unsigned int group_id);
 extern unsigned int sched_get_group_id(struct task_struct *p);
+extern int sched_set_group_frame(struct task_struct *p,
+				 unsigned int deadline_us);
+extern unsigned int sched_get_group_frame(struct task_struct *p);
 extern int sched_set_init_task_load(struct task_struct *p, int init_load_pct);
 extern u32 sched_get_init_task_load(struct task_struct *p);
 extern void sched_update_cpu_freq_min_max(const cpumask_t *cpus, u32 fmin,
@@ -810,6 +813,8 @@ struct task_struct {
 	struct sched_entity		se;
 	struct sched_rt_entity		rt;
 	u64 last_sleep_ts;
+	/* Placement and preemption favour latency, without any boost: */
+	bool				latency_sensitive;
 #ifdef CONFIG_SCHED_WALT
 	struct ravg ravg;
 	/*
@@ -2044,4 +2049,17 @@ static inline void set_wake_up_idle(bool enabled)
 		current->flags &= ~PF_WAKE_UP_IDLE;
 }
 
+static inline u32 sched_get_latency_sensitive(struct task_struct *p)
+{
+	return READ_ONCE(p->latency_sensitive);
+}
+
+static inline int sched_set_latency_sensitive(struct task_struct *p,
+						int latency_sensitive)
+{
+	WRITE_ONCE(p->latency_sensitive, !!latency_sensitive);
+
+	return 0;
+}
+
 #endif
@@ -77,11 +77,20 @@ struct idle_state {
 	unsigned long power;	 /* power consumption in this idle state */
 };
 
+/*
+ * The capacity lookup table maps a utilization bucket of
+ * (1 << SGE_CAP_LUT_SHIFT) units to the first capacity state whose
+ * capacity reaches the bottom of that bucket.
+ */
+#define SGE_CAP_LUT_SHIFT	4
+#define SGE_CAP_LUT_SIZE	((SCHED_CAPACITY_SCALE >> SGE_CAP_LUT_SHIFT) + 1)
+
 struct sched_group_energy {
 	unsigned int nr_idle_states;	/* number of idle states */
 	struct idle_state *idle_states;	/* ptr to idle state array */
 	unsigned int nr_cap_states;	/* number of capacity states */
 	struct capacity_state *cap_states; /* ptr to capacity state array */
+	u8 *cap_lut;			/* util bucket -> first cap state */
 };
 
 unsigned long capacity_curr_of(int cpu);
@@ -1067,6 +1067,40 @@ TRACE_EVENT(core_ctl_set_busy,
 		  __entry->is_busy, __entry->high_irqload)
 );
 
+TRACE_EVENT(core_ctl_pred_need,
+
+	TP_PROTO(unsigned int cpu, unsigned int pred_sum, unsigned int top_max,
+		 unsigned int nr_top, unsigned int prev_need,
+		 unsigned int prev_misfit, unsigned int old_need,
+		 unsigned int new_need),
+	TP_ARGS(cpu, pred_sum, top_max, nr_top, prev_need, prev_misfit,
+		old_need, new_need),
+	TP_STRUCT__entry(
+		__field(u32, cpu)
+		__field(u32, pred_sum)
+		__field(u32, top_max)
+		__field(u32, nr_top)
+		__field(u32, prev_need)
+		__field(u32, prev_misfit)
+		__field(u32, old_need)
+		__field(u32, new_need)
+	),
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->pred_sum = pred_sum;
+		__entry->top_max = top_max;
+		__entry->nr_top = nr_top;
+		__entry->prev_need = prev_need;
+		__entry->prev_misfit = prev_misfit;
+		__entry->old_need = old_need;
+		__entry->new_need = new_need;
+	),
+	TP_printk("cpu=%u, pred_sum=%u, top_max=%u, nr_top=%u, prev_need=%u, prev_misfit=%u, old_need=%u, new_need=%u",
+		  __entry->cpu, __entry->pred_sum, __entry->top_max,
+		  __entry->nr_top, __entry->prev_need, __entry->prev_misfit,
+		  __entry->old_need, __entry->new_need)
+);
+
 TRACE_EVENT(core_ctl_set_boost,
 
 	TP_PROTO(u32 refcount, s32 ret),
@@ -1361,6 +1395,36 @@ TRACE_EVENT(sched_energy_diff,
 		__entry->backup_cpu, __entry->backup_energy)
 );
 
+/*
+ * Tracepoint for the time spent estimating the energy of the wakeup
+ * candidates of a task.
+ */
+TRACE_EVENT(sched_energy_est,
+
+	TP_PROTO(struct task_struct *p, int nr_cpus, int nr_groups,
+		 u64 delta_ns),
+
+	TP_ARGS(p, nr_cpus, nr_groups, delta_ns),
+
+	TP_STRUCT__entry(
+		__field(int, pid		)
+		__field(int, nr_cpus		)
+		__field(int, nr_groups		)
+		__field(u64, delta_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->pid			= p->pid;
+		__entry->nr_cpus		= nr_cpus;
+		__entry->nr_groups		= nr_groups;
+		__entry->delta_ns		= delta_ns;
+	),
+
+	TP_printk("pid=%d nr_cpus=%d nr_groups=%d delta_ns=%llu",
+		__entry->pid, __entry->nr_cpus, __entry->nr_groups,
+		__entry->delta_ns)
+);
+
 TRACE_EVENT(sched_task_util,
 
 	TP_PROTO(struct task_struct *p, int next_cpu, int backup_cpu,
@@ -91,6 +91,31 @@ TRACE_EVENT(cpu_pred_hist,
 		__entry->sample, __entry->tmr)
 );
 
+TRACE_EVENT(cpu_pred_teo,
+
+	TP_PROTO(int idx, u32 resi, u32 sleep_us, int hit),
+
+	TP_ARGS(idx, resi, sleep_us, hit),
+
+	TP_STRUCT__entry(
+		__field(int, idx)
+		__field(u32, resi)
+		__field(u32, sleep_us)
+		__field(int, hit)
+	),
+
+	TP_fast_assign(
+		__entry->idx = idx;
+		__entry->resi = resi;
+		__entry->sleep_us = sleep_us;
+		__entry->hit = hit;
+	),
+
+	TP_printk("bin:%d resi:%u sleep_time:%u hit:%d",
+		__entry->idx, __entry->resi,
+		__entry->sleep_us, __entry->hit)
+);
+
 TRACE_EVENT(cpu_idle_enter,
 
 	TP_PROTO(int index),
@@ -377,6 +377,31 @@ TRACE_EVENT(sched_set_preferred_cluster,
 			__entry->cluster_first_cpu)
 );
 
+TRACE_EVENT(sched_group_frame,
+
+	TP_PROTO(struct related_thread_group *grp, unsigned int deadline_us),
+
+	TP_ARGS(grp, deadline_us),
+
+	TP_STRUCT__entry(
+		__field(	int,	id			)
+		__field(unsigned int,	deadline_us		)
+		__field(	u64,	est			)
+		__field(	u64,	last_work		)
+	),
+
+	TP_fast_assign(
+		__entry->id			= grp->id;
+		__entry->deadline_us		= deadline_us;
+		__entry->est			= grp->frame_est;
+		__entry->last_work		= grp->frame_last_work;
+	),
+
+	TP_printk("group_id %d deadline_us %u est %llu last_work %llu",
+			__entry->id, __entry->deadline_us,
+			__entry->est, __entry->last_work)
+);
+
 TRACE_EVENT(sched_migration_update_sum,
 
 	TP_PROTO(struct task_struct *p, enum migrate_types migrate_type, struct rq *rq),
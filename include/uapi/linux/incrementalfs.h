@@ -92,9 +92,19 @@
 #define INCFS_IOC_GET_FILLED_BLOCKS                                            \
 	_IOR(INCFS_IOCTL_BASE_CODE, 34, struct incfs_get_filled_blocks_args)
 
+/*
+ * Get decompression counters of the mount
+ *
+ * Returns 0 on success or error
+ */
+#define INCFS_IOC_GET_DECOMPRESSION_STATS                                      \
+	_IOR(INCFS_IOCTL_BASE_CODE, 35,                                        \
+	     struct incfs_get_decompression_stats_args)
+
 enum incfs_compression_alg {
 	COMPRESSION_NONE = 0,
-	COMPRESSION_LZ4 = 1
+	COMPRESSION_LZ4 = 1,
+	COMPRESSION_ZSTD = 2,
 };
 
 enum incfs_block_flags {
@@ -331,4 +341,23 @@ struct incfs_get_filled_blocks_args {
 	__u32 index_out;
 };
 
+/*
+ * Decompression counters of a mount
+ *
+ * Argument for INCFS_IOC_GET_DECOMPRESSION_STATS
+ */
+struct incfs_get_decompression_stats_args {
+	/* Number of LZ4 blocks decompressed */
+	__aligned_u64 lz4_blocks;
+
+	/* Total time spent decompressing LZ4 blocks, in microseconds */
+	__aligned_u64 lz4_time_us;
+
+	/* Number of zstd blocks decompressed */
+	__aligned_u64 zstd_blocks;
+
+	/* Total time spent decompressing zstd blocks, in microseconds */
+	__aligned_u64 zstd_time_us;
+};
+
 #endif /* _UAPI_LINUX_INCREMENTALFS_H */
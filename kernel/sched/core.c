@@ -3321,6 +3321,7 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 
 		p->prio = p->normal_prio = __normal_prio(p);
 		set_load_weight(p, false);
+		p->latency_sensitive = false;
 
 		/*
 		 * We don't need the reset flag anymore after the fork. It has
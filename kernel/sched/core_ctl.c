@@ -47,6 +47,8 @@ struct cluster_data {
 	unsigned int max_nr;
 	unsigned int nr_prev_assist;
 	unsigned int nr_prev_assist_thresh;
+	bool pred_enable;
+	unsigned int pred_need;
 	s64 need_ts;
 	struct list_head lru;
 	bool pending;
@@ -62,6 +64,8 @@ struct cluster_data {
 struct cpu_data {
 	bool is_busy;
 	unsigned int busy;
+	unsigned int pred_busy;
+	unsigned int top_busy;
 	unsigned int cpu;
 	bool not_preferred;
 	struct cluster_data *cluster;
@@ -188,6 +192,30 @@ static ssize_t store_nr_prev_assist_thresh(struct cluster_data *state,
 	return count;
 }
 
+static ssize_t show_pred_enable(const struct cluster_data *state, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", state->pred_enable);
+}
+
+static ssize_t store_pred_enable(struct cluster_data *state,
+				 const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u\n", &val) != 1)
+		return -EINVAL;
+
+	state->pred_enable = !!val;
+	apply_need(state);
+
+	return count;
+}
+
+static ssize_t show_pred_need(const struct cluster_data *state, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", state->pred_need);
+}
+
 static ssize_t show_offline_delay_ms(const struct cluster_data *state,
 				     char *buf)
 {
@@ -328,6 +356,10 @@ static ssize_t show_global_state(const struct cluster_data *state, char *buf)
 					"\tBusy%%: %u\n", c->busy);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"\tIs busy: %u\n", c->is_busy);
+		count += snprintf(buf + count, PAGE_SIZE - count,
+					"\tPred busy%%: %u\n", c->pred_busy);
+		count += snprintf(buf + count, PAGE_SIZE - count,
+					"\tTop task busy%%: %u\n", c->top_busy);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"\tNot preferred: %u\n",
 						c->not_preferred);
@@ -337,6 +369,8 @@ static ssize_t show_global_state(const struct cluster_data *state, char *buf)
 			"\tActive CPUs: %u\n", get_active_cpu_count(cluster));
 		count += snprintf(buf + count, PAGE_SIZE - count,
 				"\tNeed CPUs: %u\n", cluster->need_cpus);
+		count += snprintf(buf + count, PAGE_SIZE - count,
+				"\tPred need CPUs: %u\n", cluster->pred_need);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 				"\tNr isolated CPUs: %u\n",
 						cluster->nr_isolated_cpus);
@@ -416,6 +450,8 @@ core_ctl_attr_rw(busy_up_thres);
 core_ctl_attr_rw(busy_down_thres);
 core_ctl_attr_rw(task_thres);
 core_ctl_attr_rw(nr_prev_assist_thresh);
+core_ctl_attr_rw(pred_enable);
+core_ctl_attr_ro(pred_need);
 core_ctl_attr_ro(need_cpus);
 core_ctl_attr_ro(active_cpus);
 core_ctl_attr_ro(global_state);
@@ -430,6 +466,8 @@ static struct attribute *default_attrs[] = {
 	&busy_down_thres.attr,
 	&task_thres.attr,
 	&nr_prev_assist_thresh.attr,
+	&pred_enable.attr,
+	&pred_need.attr,
 	&enable.attr,
 	&need_cpus.attr,
 	&active_cpus.attr,
@@ -699,6 +737,123 @@ static unsigned int apply_task_need(const struct cluster_data *cluster,
 	return new_need;
 }
 
+/* ===================== prediction based core count =================== */
+
+/*
+ * prev_cluster_pred_assist:
+ *   Number of CPUs the previous cluster is predicted to
+ *   need beyond its active CPUs, which this cluster should
+ *   make up for. Like nr_prev_assist, this only counts once
+ *   it reaches nr_prev_assist_thresh and while the previous
+ *   cluster has no isolated CPUs of its own to bring back.
+ *
+ *   @nr_misfit returns the number of CPUs of the previous
+ *   cluster whose top task fills a whole CPU there. Such a
+ *   task has to move up regardless of the number of CPUs
+ *   the previous cluster has.
+ */
+static unsigned int prev_cluster_pred_assist(const struct cluster_data *cluster,
+					     unsigned int *nr_misfit)
+{
+	const struct cluster_data *prev_cluster;
+	unsigned int up_thres, pred_sum = 0, need;
+	int index = cluster - cluster_state;
+	struct cpu_data *c;
+
+	*nr_misfit = 0;
+	if (index == 0)
+		return 0;
+
+	prev_cluster = &cluster_state[index - 1];
+	if (!prev_cluster->inited)
+		return 0;
+
+	list_for_each_entry(c, &prev_cluster->lru, sib) {
+		pred_sum += c->pred_busy;
+		if (c->top_busy >= 100)
+			(*nr_misfit)++;
+	}
+
+	if (prev_cluster->nr_isolated_cpus)
+		return 0;
+
+	up_thres = prev_cluster->busy_up_thres[prev_cluster->active_cpus ?
+					       prev_cluster->active_cpus - 1 : 0];
+	if (!up_thres)
+		return 0;
+
+	need = DIV_ROUND_UP(pred_sum, up_thres);
+	if (need <= prev_cluster->active_cpus)
+		return 0;
+
+	need -= prev_cluster->active_cpus;
+	if (need < cluster->nr_prev_assist_thresh)
+		return 0;
+
+	return need;
+}
+
+/*
+ * pred_need:
+ *   Number of CPUs the cluster is expected to need in the
+ *   next window, from the WALT predicted demand of the
+ *   tasks runnable on its CPUs and from the biggest task
+ *   seen on each CPU in the last window, plus what the
+ *   previous cluster is predicted to overflow into it
+ *   (see prev_cluster_pred_assist).
+ *
+ *   The aggregated predicted demand is packed on CPUs up
+ *   to the busy up threshold. A CPU whose top task alone
+ *   crosses that threshold is counted as needed too, as
+ *   that task cannot be spread over several CPUs however
+ *   low the predicted sum is.
+ *
+ *   Like the busy state of each CPU, the predicted need is
+ *   subject to hysteresis: it only drops by a CPU once the
+ *   predicted demand would leave the remaining CPUs under
+ *   the busy down threshold.
+ */
+static unsigned int compute_pred_need(struct cluster_data *cluster,
+				      unsigned int thres_idx)
+{
+	unsigned int up_thres = cluster->busy_up_thres[thres_idx];
+	unsigned int down_thres = cluster->busy_down_thres[thres_idx];
+	unsigned int pred_sum = 0, nr_top = 0, top_max = 0;
+	unsigned int prev_need, prev_misfit;
+	unsigned int pred_need, old_need = cluster->pred_need;
+	struct cpu_data *c;
+
+	if (!cluster->pred_enable || !up_thres) {
+		cluster->pred_need = 0;
+		return 0;
+	}
+
+	list_for_each_entry(c, &cluster->lru, sib) {
+		pred_sum += c->pred_busy;
+		top_max = max(top_max, c->top_busy);
+		if (c->top_busy >= up_thres)
+			nr_top++;
+	}
+
+	prev_need = prev_cluster_pred_assist(cluster, &prev_misfit);
+	pred_sum += prev_need * up_thres;
+	nr_top += prev_misfit;
+
+	pred_need = max(DIV_ROUND_UP(pred_sum, up_thres), nr_top);
+	if (pred_need < old_need &&
+	    pred_sum > (old_need - 1) * down_thres)
+		pred_need = old_need;
+
+	pred_need = min(pred_need, cluster->num_cpus);
+	cluster->pred_need = pred_need;
+
+	trace_core_ctl_pred_need(cluster->first_cpu, pred_sum, top_max,
+				 nr_top, prev_need, prev_misfit, old_need,
+				 pred_need);
+
+	return pred_need;
+}
+
 /* ======================= load based core count  ====================== */
 
 static unsigned int apply_limits(const struct cluster_data *cluster,
@@ -759,6 +914,8 @@ static bool eval_need(struct cluster_data *cluster)
 			need_cpus += c->is_busy;
 		}
 		need_cpus = apply_task_need(cluster, need_cpus);
+		need_cpus = max(need_cpus, compute_pred_need(cluster,
+							     thres_idx));
 	}
 	new_need = apply_limits(cluster, need_cpus);
 	need_flag = adjustment_possible(cluster, new_need);
@@ -914,6 +1071,7 @@ void core_ctl_check(u64 window_start)
 			continue;
 
 		c->busy = sched_get_cpu_util(cpu);
+		c->pred_busy = walt_get_cpu_pred_busy(cpu, &c->top_busy);
 	}
 	spin_unlock_irqrestore(&state_lock, flags);
 
@@ -1252,6 +1410,7 @@ static int cluster_init(const struct cpumask *mask)
 	cluster->offline_delay_ms = 100;
 	cluster->task_thres = UINT_MAX;
 	cluster->nr_prev_assist_thresh = UINT_MAX;
+	cluster->pred_enable = true;
 	cluster->nrrun = cluster->num_cpus;
 	cluster->enable = true;
 	cluster->nr_not_preferred_cpus = 0;
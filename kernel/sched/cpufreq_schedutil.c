@@ -27,6 +27,7 @@ struct sugov_tunables {
 	unsigned int		up_rate_limit_us;
 	unsigned int		down_rate_limit_us;
 	bool iowait_boost_enable;
+	bool frame_deadline_enable;
 };
 
 struct sugov_policy {
@@ -206,6 +207,11 @@ static void sugov_deferred_update(struct sugov_policy *sg_policy, u64 time,
  *
  * Take C = 1.25 for the frequency tipping point at (util / max) = 0.8.
  *
+ * In frame deadline mode, when a frame reported by userspace is in flight on
+ * the policy, C = 1 is used instead and the utilization is raised to the one
+ * needed to complete the remaining work of the frame before its deadline, see
+ * sched_frame_util().
+ *
  * The lowest driver-supported frequency which is equal or greater than the raw
  * next_freq (as calculated above) is returned, subject to policy min/max and
  * cpufreq driver limitations.
@@ -216,8 +222,13 @@ static unsigned int get_next_freq(struct sugov_policy *sg_policy,
 	struct cpufreq_policy *policy = sg_policy->policy;
 	unsigned int freq = arch_scale_freq_invariant() ?
 				policy->cpuinfo.max_freq : policy->cur;
+	unsigned long frame_util;
 
-	freq = map_util_freq(util, freq, max);
+	if (sg_policy->tunables->frame_deadline_enable &&
+	    sched_frame_util(policy->cpus, sched_ktime_clock(), &frame_util))
+		freq = div64_ul((u64)freq * max(util, frame_util), max);
+	else
+		freq = map_util_freq(util, freq, max);
 
 	if (freq == sg_policy->cached_raw_freq && !sg_policy->need_freq_update)
 		return sg_policy->next_freq;
@@ -634,14 +645,38 @@ static ssize_t iowait_boost_enable_store(struct gov_attr_set *attr_set,
 	return count;
 }
 
+static ssize_t frame_deadline_enable_show(struct gov_attr_set *attr_set,
+					  char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->frame_deadline_enable);
+}
+
+static ssize_t frame_deadline_enable_store(struct gov_attr_set *attr_set,
+					   const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	tunables->frame_deadline_enable = enable;
+
+	return count;
+}
+
 static struct governor_attr up_rate_limit_us = __ATTR_RW(up_rate_limit_us);
 static struct governor_attr down_rate_limit_us = __ATTR_RW(down_rate_limit_us);
 static struct governor_attr iowait_boost_enable = __ATTR_RW(iowait_boost_enable);
+static struct governor_attr frame_deadline_enable = __ATTR_RW(frame_deadline_enable);
 
 static struct attribute *sugov_attributes[] = {
 	&up_rate_limit_us.attr,
 	&down_rate_limit_us.attr,
 	&iowait_boost_enable.attr,
+	&frame_deadline_enable.attr,
 	NULL
 };
 
@@ -775,6 +810,7 @@ static void sugov_tunables_save(struct cpufreq_policy *policy,
 
 	cached->up_rate_limit_us = tunables->up_rate_limit_us;
 	cached->down_rate_limit_us = tunables->down_rate_limit_us;
+	cached->frame_deadline_enable = tunables->frame_deadline_enable;
 }
 
 static void sugov_clear_global_tunables(void)
@@ -794,6 +830,7 @@ static void sugov_tunables_restore(struct cpufreq_policy *policy)
 
 	tunables->up_rate_limit_us = cached->up_rate_limit_us;
 	tunables->down_rate_limit_us = cached->down_rate_limit_us;
+	tunables->frame_deadline_enable = cached->frame_deadline_enable;
 	update_min_rate_limit_ns(sg_policy);
 }
 
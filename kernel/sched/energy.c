@@ -45,6 +45,7 @@ static void free_resources(void)
 			if (sge) {
 				kfree(sge->cap_states);
 				kfree(sge->idle_states);
+				kfree(sge->cap_lut);
 				kfree(sge);
 			}
 		}
@@ -52,6 +53,42 @@ static void free_resources(void)
 }
 static bool sge_ready;
 
+/*
+ * Build the capacity lookup table of @sge once the capacities of its
+ * states are known. For each utilization bucket it records the first
+ * capacity state whose capacity is at least the bottom of that bucket,
+ * so that the wakeup path can start its OPP search from there instead
+ * of walking the whole cap_states vector.
+ */
+static void build_cap_lut(struct sched_group_energy *sge)
+{
+	u8 *lut, *old_lut;
+	int i, idx = 0;
+
+	if (!sge->nr_cap_states || sge->nr_cap_states > U8_MAX)
+		return;
+
+	lut = kmalloc_array(SGE_CAP_LUT_SIZE, sizeof(*lut), GFP_KERNEL);
+	if (!lut)
+		return;
+
+	for (i = 0; i < SGE_CAP_LUT_SIZE; i++) {
+		unsigned long util = (unsigned long)i << SGE_CAP_LUT_SHIFT;
+
+		while (idx < sge->nr_cap_states - 1 &&
+		       sge->cap_states[idx].cap < util)
+			idx++;
+		lut[i] = idx;
+	}
+
+	old_lut = sge->cap_lut;
+	smp_store_release(&sge->cap_lut, lut);
+	if (old_lut) {
+		synchronize_rcu();
+		kfree(old_lut);
+	}
+}
+
 void check_max_cap_vs_cpu_scale(int cpu, struct sched_group_energy *sge)
 {
 	unsigned long max_cap, cpu_scale;
@@ -237,11 +274,10 @@ static int sched_energy_probe(struct platform_device *pdev)
 		 */
 		sge_l0 = sge_array[cpu][SD_LEVEL0];
 		if (sge_l0 && sge_l0->nr_cap_states > 0) {
-			int i;
+			int i, sd_level;
 			int ncapstates = sge_l0->nr_cap_states;
 
 			for (i = 0; i < ncapstates; i++) {
-				int sd_level;
 				unsigned long freq, cap;
 
 				/*
@@ -268,6 +304,13 @@ static int sched_energy_probe(struct platform_device *pdev)
 					sge_l0->cap_states[i].power);
 			}
 
+			for_each_possible_sd_level(sd_level) {
+				sge = sge_array[cpu][sd_level];
+				if (!sge)
+					break;
+				build_cap_lut(sge);
+			}
+
 			dev_info(&pdev->dev,
 				"cpu=%d eff=%d [freq=%ld cap=%ld power_d0=%ld] -> [freq=%ld cap=%ld power_d0=%ld]\n",
 				cpu, efficiency,
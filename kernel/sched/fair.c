@@ -750,6 +750,8 @@ static u64 __sched_period(unsigned long nr_running)
 static u64 sched_slice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
 	u64 slice = __sched_period(cfs_rq->nr_running + !se->on_rq);
+	bool latency_sensitive = entity_is_task(se) &&
+				 task_latency_sensitive(task_of(se));
 
 	for_each_sched_entity(se) {
 		struct load_weight *load;
@@ -766,6 +768,16 @@ static u64 sched_slice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		}
 		slice = __calc_delta(slice, se->load.weight, load);
 	}
+
+	/*
+	 * Latency sensitive tasks run in shorter slices, so they get back
+	 * on the cpu sooner. Their share of the period is unchanged, and
+	 * a slice already below min_granularity is never stretched.
+	 */
+	if (latency_sensitive)
+		slice = min(slice, max_t(u64, slice >> 1,
+					 sysctl_sched_min_granularity));
+
 	return slice;
 }
 
@@ -6194,6 +6206,29 @@ struct energy_env {
 	struct sched_group	*sg_top;
 	struct sched_group	*sg_cap;
 	struct sched_group	*sg;
+
+	/*
+	 * Utilization of each CPU without the task's contribution, indexed
+	 * by CPU id. It is sampled at most once per wakeup (see cpus_util)
+	 * and shared by all the candidates and sched group levels.
+	 */
+	unsigned long		*util_nrg;
+	unsigned long		*util_boost;
+	unsigned long		*util_freq;
+	cpumask_t		cpus_util;
+
+	/*
+	 * Candidate independent data of the SG being visited, computed
+	 * once by calc_sg_energy() before evaluating each candidate.
+	 */
+	unsigned long		sg_max_util;
+	long			sg_grp_util;
+	int			sg_idle_state;
+	int			sg_sum_cap_idx;
+	unsigned long		sg_util_sum;
+
+	/* Number of SGs whose energy has been computed */
+	int			nr_sg_visited;
 };
 
 /*
@@ -6307,37 +6342,59 @@ static unsigned long cpu_util_without(int cpu, struct task_struct *p, bool boost
 	return min_t(unsigned long, util, capacity_orig_of(cpu));
 }
 
+/*
+ * eenv_cpu_util_sample: sample the utilization of @cpu discounting the
+ * task's contribution, unless it has already been done for this wakeup.
+ */
+static void eenv_cpu_util_sample(struct energy_env *eenv, int cpu)
+{
+	unsigned long util;
+
+	if (cpumask_test_and_set_cpu(cpu, &eenv->cpus_util))
+		return;
+
+	eenv->util_nrg[cpu] = cpu_util_without(cpu, eenv->p, 0);
+
+	util = cpu_util_without(cpu, eenv->p, 1);
+	eenv->util_boost[cpu] = util;
+
+	/*
+	 * Performance domain frequency: utilization clamping
+	 * must be considered since it affects the selection
+	 * of the performance domain frequency.
+	 * NOTE: in case RT tasks are running, by default the
+	 * FREQUENCY_UTIL's utilization can be max OPP.
+	 */
+	eenv->util_freq[cpu] = effective_cpu_util(cpu, util,
+				arch_scale_cpu_capacity(NULL, cpu),
+				FREQUENCY_UTIL, NULL);
+}
+
 static unsigned long group_max_util(struct energy_env *eenv, int cpu_idx)
 {
+	int target = eenv->cpu[cpu_idx].cpu_id;
 	unsigned long max_util = 0;
 	unsigned long util;
-	unsigned long cpu_cap;
-	struct task_struct *tsk;
 	int cpu;
 
+	/* Without the task the SG's utilization is the same for everybody */
+	if (!cpumask_test_cpu(target, sched_group_span(eenv->sg_cap)))
+		return eenv->sg_max_util;
+
 	for_each_cpu(cpu, sched_group_span(eenv->sg_cap)) {
-		util = cpu_util_without(cpu, eenv->p, 1);
+		util = eenv->util_freq[cpu];
 
 		/*
 		 * If we are looking at the target CPU specified by the eenv,
 		 * then we should add the (estimated) utilization of the task
 		 * assuming we will wake it up on that CPU.
 		 */
-		if (unlikely(cpu == eenv->cpu[cpu_idx].cpu_id))
-			util += eenv->util_delta_boosted;
-
-		cpu_cap = arch_scale_cpu_capacity(NULL, cpu);
-
-		/*
-		 * Performance domain frequency: utilization clamping
-		 * must be considered since it affects the selection
-		 * of the performance domain frequency.
-		 * NOTE: in case RT tasks are running, by default the
-		 * FREQUENCY_UTIL's utilization can be max OPP.
-		 */
-		tsk = unlikely(cpu == eenv->cpu[cpu_idx].cpu_id) ? eenv->p : NULL;
-		util = effective_cpu_util(cpu, util, cpu_cap,
-					      FREQUENCY_UTIL, tsk);
+		if (unlikely(cpu == target)) {
+			util = eenv->util_boost[cpu] + eenv->util_delta_boosted;
+			util = effective_cpu_util(cpu, util,
+						  arch_scale_cpu_capacity(NULL, cpu),
+						  FREQUENCY_UTIL, eenv->p);
+		}
 
 		max_util = max(max_util, util);
 	}
@@ -6345,6 +6402,20 @@ static unsigned long group_max_util(struct energy_env *eenv, int cpu_idx)
 	return max_util;
 }
 
+static inline unsigned long
+cpu_norm_util_at(int cpu, unsigned long util, unsigned long capacity)
+{
+	/*
+	 * Busy time computation: utilization clamping is not
+	 * required since the ratio (sum_util / cpu_capacity)
+	 * is already enough to scale the EM reported power
+	 * consumption at the (eventually clamped) cpu_capacity.
+	 */
+	util += effective_cpu_util(cpu, util, capacity, ENERGY_UTIL, NULL);
+
+	return __cpu_norm_util(util, capacity);
+}
+
 /*
  * group_norm_util() returns the approximated group util relative to it's
  * current capacity (busy ratio) in the range [0..SCHED_CAPACITY_SCALE] for use
@@ -6353,35 +6424,41 @@ static unsigned long group_max_util(struct energy_env *eenv, int cpu_idx)
  * sum(cpu_norm_util(i)) when iterating over all cpus in the group, i. The
  * latter is used as the estimate as it leads to a more pessimistic energy
  * estimate (more busy).
+ *
+ * The sum over the SG's CPUs only depends on the candidate through the
+ * capacity it selects and the utilization it adds to a single CPU. Keep
+ * the sum without the task for the last capacity state seen, and fix it
+ * up for the target CPU, so that candidates landing on the same OPP of
+ * this SG share a single walk of its CPUs.
  */
 static unsigned
 long group_norm_util(struct energy_env *eenv, int cpu_idx)
 {
 	unsigned long capacity = eenv->cpu[cpu_idx].cap;
-	unsigned long util, util_sum = 0;
+	int target = eenv->cpu[cpu_idx].cpu_id;
+	unsigned long util, util_sum;
 	int cpu;
 
-	for_each_cpu(cpu, sched_group_span(eenv->sg)) {
-		util = cpu_util_without(cpu, eenv->p, 0);
-
-		/*
-		 * If we are looking at the target CPU specified by the eenv,
-		 * then we should add the (estimated) utilization of the task
-		 * assuming we will wake it up on that CPU.
-		 */
-		if (unlikely(cpu == eenv->cpu[cpu_idx].cpu_id))
-			util += eenv->util_delta;
-
-		/*
-		 * Busy time computation: utilization clamping is not
-		 * required since the ratio (sum_util / cpu_capacity)
-		 * is already enough to scale the EM reported power
-		 * consumption at the (eventually clamped) cpu_capacity.
-		 */
-		util += effective_cpu_util(cpu, util, capacity,
-					       ENERGY_UTIL, NULL);
+	if (eenv->sg_sum_cap_idx != eenv->cpu[cpu_idx].cap_idx) {
+		util_sum = 0;
+		for_each_cpu(cpu, sched_group_span(eenv->sg))
+			util_sum += cpu_norm_util_at(cpu, eenv->util_nrg[cpu],
+						     capacity);
+		eenv->sg_util_sum = util_sum;
+		eenv->sg_sum_cap_idx = eenv->cpu[cpu_idx].cap_idx;
+	}
+	util_sum = eenv->sg_util_sum;
 
-		util_sum += __cpu_norm_util(util, capacity);
+	/*
+	 * If we are looking at the target CPU specified by the eenv,
+	 * then we should add the (estimated) utilization of the task
+	 * assuming we will wake it up on that CPU.
+	 */
+	if (cpumask_test_cpu(target, sched_group_span(eenv->sg))) {
+		util = eenv->util_nrg[target];
+		util_sum -= cpu_norm_util_at(target, util, capacity);
+		util_sum += cpu_norm_util_at(target, util + eenv->util_delta,
+					     capacity);
 	}
 
 	if (util_sum > SCHED_CAPACITY_SCALE)
@@ -6393,11 +6470,17 @@ static int find_new_capacity(struct energy_env *eenv, int cpu_idx)
 {
 	const struct sched_group_energy *sge = eenv->sg_cap->sge;
 	unsigned long util = group_max_util(eenv, cpu_idx);
-	int idx, cap_idx;
+	const u8 *lut = READ_ONCE(sge->cap_lut);
+	int idx = 0, cap_idx;
 
 	cap_idx = sge->nr_cap_states - 1;
 
-	for (idx = 0; idx < sge->nr_cap_states; idx++) {
+	/* Skip the OPPs known to be too small for this utilization */
+	if (lut)
+		idx = lut[min_t(unsigned long, util >> SGE_CAP_LUT_SHIFT,
+				SGE_CAP_LUT_SIZE - 1)];
+
+	for (; idx < sge->nr_cap_states; idx++) {
 		if (sge->cap_states[idx].cap >= util) {
 			cap_idx = idx;
 			break;
@@ -6413,28 +6496,12 @@ static int find_new_capacity(struct energy_env *eenv, int cpu_idx)
 static int group_idle_state(struct energy_env *eenv, int cpu_idx)
 {
 	struct sched_group *sg = eenv->sg;
+	int state = eenv->sg_idle_state;
+	long grp_util = eenv->sg_grp_util;
 	int src_in_grp, dst_in_grp;
-	int i, state = INT_MAX;
 	int max_idle_state_idx;
-	long grp_util = 0;
 	int new_state;
 
-	/* Find the shallowest idle state in the sched group. */
-	for_each_cpu(i, sched_group_span(sg))
-		state = min(state, idle_get_state_idx(cpu_rq(i)));
-
-	if (unlikely(state == INT_MAX))
-		return -EINVAL;
-
-	/* Take non-cpuidle idling into account (active idle/arch_cpu_idle()) */
-	state++;
-	/*
-	 * Try to estimate if a deeper idle state is
-	 * achievable when we move the task.
-	 */
-	for_each_cpu(i, sched_group_span(sg))
-		grp_util += cpu_util_cfs(i, 0);
-
 	src_in_grp = cpumask_test_cpu(eenv->cpu[EAS_CPU_PRV].cpu_id,
 				      sched_group_span(sg));
 	dst_in_grp = cpumask_test_cpu(eenv->cpu[cpu_idx].cpu_id,
@@ -6525,6 +6592,49 @@ static void store_energy_calc_debug_info(struct energy_env *eenv, int cpu_idx, i
 #define store_energy_calc_debug_info(a,b,c,d) {}
 #endif /* DEBUG_EENV_DECISIONS */
 
+/*
+ * calc_sg_prepare: sample the candidate independent data of the eenv's
+ * SG and capacity SG, which calc_sg_energy() then reuses for each CPU
+ * candidate.
+ */
+static int calc_sg_prepare(struct energy_env *eenv)
+{
+	int i, state = INT_MAX;
+	long grp_util = 0;
+
+	for_each_cpu(i, sched_group_span(eenv->sg_cap))
+		eenv_cpu_util_sample(eenv, i);
+	for_each_cpu(i, sched_group_span(eenv->sg))
+		eenv_cpu_util_sample(eenv, i);
+
+	eenv->sg_max_util = 0;
+	for_each_cpu(i, sched_group_span(eenv->sg_cap))
+		eenv->sg_max_util = max(eenv->sg_max_util, eenv->util_freq[i]);
+
+	/* Find the shallowest idle state in the sched group. */
+	for_each_cpu(i, sched_group_span(eenv->sg))
+		state = min(state, idle_get_state_idx(cpu_rq(i)));
+
+	if (unlikely(state == INT_MAX))
+		return -EINVAL;
+
+	/* Take non-cpuidle idling into account (active idle/arch_cpu_idle()) */
+	eenv->sg_idle_state = state + 1;
+
+	/*
+	 * Try to estimate if a deeper idle state is
+	 * achievable when we move the task.
+	 */
+	for_each_cpu(i, sched_group_span(eenv->sg))
+		grp_util += cpu_util_cfs(i, 0);
+	eenv->sg_grp_util = grp_util;
+
+	eenv->sg_sum_cap_idx = -1;
+	eenv->nr_sg_visited++;
+
+	return 0;
+}
+
 /*
  * calc_sg_energy: compute energy for the eenv's SG (i.e. eenv->sg).
  *
@@ -6541,6 +6651,9 @@ static int calc_sg_energy(struct energy_env *eenv)
 	int cap_idx, idle_idx;
 	int cpu_idx;
 
+	if (calc_sg_prepare(eenv))
+		return -EINVAL;
+
 	for (cpu_idx = EAS_CPU_PRV; cpu_idx < eenv->max_cpu_count; ++cpu_idx) {
 		if (eenv->cpu[cpu_idx].cpu_id == -1)
 			continue;
@@ -6553,8 +6666,6 @@ static int calc_sg_energy(struct energy_env *eenv)
 
 		/* Compute IDLE energy */
 		idle_idx = group_idle_state(eenv, cpu_idx);
-		if (unlikely(idle_idx < 0))
-			return idle_idx;
 
 		if (idle_idx > sg->sge->nr_idle_states - 1)
 			idle_idx = sg->sge->nr_idle_states - 1;
@@ -6761,6 +6872,7 @@ static inline int select_energy_cpu_idx(struct energy_env *eenv)
 	struct sched_domain *sd;
 	struct sched_group *sg;
 	int sd_cpu = -1;
+	u64 start_t = 0;
 	int cpu_idx;
 	int margin;
 
@@ -6769,6 +6881,9 @@ static inline int select_energy_cpu_idx(struct energy_env *eenv)
 	if (!sd)
 		return -1;
 
+	if (trace_sched_energy_est_enabled())
+		start_t = sched_clock();
+
 	cpumask_clear(&eenv->cpus_mask);
 	for (cpu_idx = EAS_CPU_PRV; cpu_idx < eenv->max_cpu_count; ++cpu_idx) {
 		int cpu = eenv->cpu[cpu_idx].cpu_id;
@@ -6790,6 +6905,11 @@ static inline int select_energy_cpu_idx(struct energy_env *eenv)
 	} while (sg = sg->next, sg != sd->groups);
 	/* remember - eenv energy values are unscaled */
 
+	if (start_t)
+		trace_sched_energy_est(eenv->p, cpumask_weight(&eenv->cpus_mask),
+				       eenv->nr_sg_visited,
+				       sched_clock() - start_t);
+
 	/*
 	 * Compute the dead-zone margin used to prevent too many task
 	 * migrations with negligible energy savings.
@@ -7752,6 +7872,8 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 	unsigned long p_util_min = uclamp_is_used() ? uclamp_eff_value(p, UCLAMP_MIN) : 0;
 	unsigned long p_util_max = uclamp_is_used() ? uclamp_eff_value(p, UCLAMP_MAX) : 1024;
 	int best_idle_cstate = INT_MAX;
+	bool cstate_aware = sysctl_sched_cstate_aware ||
+			    task_latency_sensitive(p);
 	struct sched_domain *sd;
 	struct sched_group *sg;
 	int best_active_cpu = -1;
@@ -7964,7 +8086,7 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 					    capacity_orig > target_capacity)
 						continue;
 					if (capacity_orig == target_capacity &&
-					    sysctl_sched_cstate_aware) {
+					    cstate_aware) {
 						if (best_idle_cstate < idle_idx)
 							continue;
 						/*
@@ -8326,6 +8448,31 @@ static inline int eenv_debug_size(void)
 }
 #endif
 
+/* Set when the eenv buffers could not be allocated at boot */
+static bool eenv_disabled __read_mostly;
+
+static void free_eenv(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct energy_env *eenv = &per_cpu(eenv_cache, cpu);
+
+		kfree(eenv->cpu);
+		kfree(eenv->util_nrg);
+		kfree(eenv->util_boost);
+		kfree(eenv->util_freq);
+		eenv->cpu = NULL;
+		eenv->util_nrg = NULL;
+		eenv->util_boost = NULL;
+		eenv->util_freq = NULL;
+#ifdef DEBUG_EENV_DECISIONS
+		kfree(eenv->debug);
+		eenv->debug = NULL;
+#endif
+	}
+}
+
 static inline void alloc_eenv(void)
 {
 	int cpu;
@@ -8335,16 +8482,34 @@ static inline void alloc_eenv(void)
 		struct energy_env *eenv = &per_cpu(eenv_cache, cpu);
 		eenv->cpu = kmalloc(sizeof(struct eenv_cpu) * cpu_count, GFP_KERNEL);
 		eenv->eenv_cpu_count = cpu_count;
+		eenv->util_nrg = kcalloc(nr_cpu_ids, sizeof(unsigned long),
+					 GFP_KERNEL);
+		eenv->util_boost = kcalloc(nr_cpu_ids, sizeof(unsigned long),
+					   GFP_KERNEL);
+		eenv->util_freq = kcalloc(nr_cpu_ids, sizeof(unsigned long),
+					  GFP_KERNEL);
+		if (!eenv->cpu || !eenv->util_nrg || !eenv->util_boost ||
+		    !eenv->util_freq)
+			goto fail;
 #ifdef DEBUG_EENV_DECISIONS
 		eenv->debug = (struct _eenv_debug *)kmalloc(eenv_debug_size(), GFP_KERNEL);
+		if (!eenv->debug)
+			goto fail;
 #endif
 	}
+	return;
+
+fail:
+	free_eenv();
+	eenv_disabled = true;
+	pr_warn("sched: no memory for energy env, energy-aware placement disabled\n");
 }
 
 static inline void reset_eenv(struct energy_env *eenv)
 {
 	int cpu_count;
 	struct eenv_cpu *cpu;
+	unsigned long *util_nrg, *util_boost, *util_freq;
 #ifdef DEBUG_EENV_DECISIONS
 	struct _eenv_debug *debug;
 	int cpu_idx;
@@ -8353,10 +8518,17 @@ static inline void reset_eenv(struct energy_env *eenv)
 
 	cpu_count = eenv->eenv_cpu_count;
 	cpu = eenv->cpu;
+	util_nrg = eenv->util_nrg;
+	util_boost = eenv->util_boost;
+	util_freq = eenv->util_freq;
 	memset(eenv, 0, sizeof(struct energy_env));
 	eenv->cpu = cpu;
 	memset(eenv->cpu, 0, sizeof(struct eenv_cpu)*cpu_count);
 	eenv->eenv_cpu_count = cpu_count;
+	/* the util arrays are only read for CPUs set in cpus_util */
+	eenv->util_nrg = util_nrg;
+	eenv->util_boost = util_boost;
+	eenv->util_freq = util_freq;
 
 #ifdef DEBUG_EENV_DECISIONS
 	memset(debug, 0, eenv_debug_size());
@@ -8485,6 +8657,9 @@ static int find_energy_efficient_cpu(struct sched_domain *sd,
 		goto out;
 	}
 
+	if (unlikely(eenv_disabled))
+		goto out;
+
 	/* prepopulate energy diff environment */
 	eenv = get_eenv(p, prev_cpu);
 	if (eenv->max_cpu_count < 2)
@@ -8621,7 +8796,7 @@ static inline int wake_energy(struct task_struct *p, int prev_cpu,
 	if (!sd)
 		return false;
 
-	if (!energy_aware())
+	if (!energy_aware() || eenv_disabled)
 		return false;
 
 	if (sd_overutilized(sd))
@@ -8937,6 +9112,7 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 	struct cfs_rq *cfs_rq = task_cfs_rq(curr);
 	int scale = cfs_rq->nr_running >= sched_nr_latency;
 	int next_buddy_marked = 0;
+	int preempt;
 
 	if (unlikely(se == pse))
 		return;
@@ -8983,7 +9159,17 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 	find_matching_se(&se, &pse);
 	update_curr(cfs_rq_of(se));
 	BUG_ON(!pse);
-	if (wakeup_preempt_entity(se, pse) == 1) {
+	preempt = wakeup_preempt_entity(se, pse);
+
+	/*
+	 * A latency sensitive task does not wait for the wakeup granularity
+	 * to preempt a task which is not, it only has to be entitled to run.
+	 */
+	if (!preempt && task_latency_sensitive(p) &&
+	    !task_latency_sensitive(curr))
+		preempt = 1;
+
+	if (preempt == 1) {
 		/*
 		 * Bias pick_next to pick the sched entity that is
 		 * triggering this preemption.
@@ -2856,6 +2856,25 @@ static inline bool uclamp_latency_sensitive(struct task_struct *p)
 }
 #endif /* CONFIG_UCLAMP_TASK_GROUP */
 
+/*
+ * A task is latency sensitive when flagged so itself or when its cpu cgroup
+ * has uclamp.latency_sensitive set. Unlike boosting, this only affects task
+ * placement and preemption, never the frequency.
+ */
+static inline bool task_latency_sensitive(struct task_struct *p)
+{
+	bool latency_sensitive;
+
+	if (READ_ONCE(p->latency_sensitive))
+		return true;
+
+	rcu_read_lock();
+	latency_sensitive = uclamp_latency_sensitive(p);
+	rcu_read_unlock();
+
+	return latency_sensitive;
+}
+
 #ifdef CONFIG_SCHED_WALT
 
 static inline bool
@@ -2902,6 +2921,18 @@ struct related_thread_group {
 	struct sched_cluster *preferred_cluster;
 	struct rcu_head rcu;
 	u64 last_update;
+
+	/*
+	 * Frame in flight as reported by userspace, see
+	 * sched_set_group_frame(). frame_start is 0 when there is none.
+	 * The estimated and accounted work are WALT scaled busy time.
+	 */
+	u64 frame_start;
+	u64 frame_deadline;
+	u64 frame_est;
+	u64 frame_last_work;
+	atomic64_t frame_work;
+	cpumask_t frame_cpus;
 };
 
 extern struct list_head cluster_head;
@@ -3290,6 +3321,8 @@ static inline enum sched_boost_policy task_boost_policy(struct task_struct *p)
 
 extern void walt_map_freq_to_load(void);
 extern void walt_update_min_max_capacity(void);
+extern bool sched_frame_util(const struct cpumask *cpus, u64 now,
+			     unsigned long *util);
 
 static inline bool is_min_capacity_cluster(struct sched_cluster *cluster)
 {
@@ -3423,6 +3456,12 @@ static inline unsigned long thermal_cap(int cpu)
 
 static inline void clear_walt_request(int cpu) { }
 
+static inline bool sched_frame_util(const struct cpumask *cpus, u64 now,
+				    unsigned long *util)
+{
+	return false;
+}
+
 static inline enum sched_boost_policy sched_boost_policy(void)
 {
 	return SCHED_BOOST_NONE;
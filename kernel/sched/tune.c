@@ -631,10 +631,8 @@ int schedtune_prefer_idle(struct task_struct *p)
 	prefer_idle = st->prefer_idle;
 	rcu_read_unlock();
 
-#ifdef CONFIG_UCLAMP_TASK_GROUP
 	if (!prefer_idle)
-		prefer_idle = uclamp_latency_sensitive(p);
-#endif
+		prefer_idle = task_latency_sensitive(p);
 
 	return prefer_idle;
 }
@@ -32,11 +32,7 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu);
 #define schedtune_task_boost_rcu_locked(tsk) uclamp_boosted(tsk)
 #endif
 
-#ifndef CONFIG_UCLAMP_TASK_GROUP
-#define schedtune_prefer_idle(tsk) 0
-#else
-#define schedtune_prefer_idle(tsk) uclamp_latency_sensitive(tsk)
-#endif
+#define schedtune_prefer_idle(tsk) task_latency_sensitive(tsk)
 
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
 #define schedtune_dequeue_task(task, cpu) do { } while (0)
@@ -483,15 +483,12 @@ void sched_account_irqtime(int cpu, struct task_struct *curr,
  * Note that sched_load_granule can change underneath us if we are not
  * holding any runqueue locks while calling the two functions below.
  */
-static u32  top_task_load(struct rq *rq)
+static u32 __top_task_load(struct rq *rq, int index, u8 table)
 {
-	int index = rq->prev_top;
-	u8 prev = 1 - rq->curr_table;
-
 	if (!index) {
 		int msb = NUM_LOAD_INDICES - 1;
 
-		if (!test_bit(msb, rq->top_tasks_bitmap[prev]))
+		if (!test_bit(msb, rq->top_tasks_bitmap[table]))
 			return 0;
 		else
 			return sched_load_granule;
@@ -502,6 +499,44 @@ static u32  top_task_load(struct rq *rq)
 	}
 }
 
+static u32  top_task_load(struct rq *rq)
+{
+	return __top_task_load(rq, rq->prev_top, 1 - rq->curr_table);
+}
+
+static inline unsigned int walt_busy_pct(u64 util, unsigned long capacity)
+{
+	util = min_t(u64, util, capacity);
+	return div64_ul(util * 100, capacity);
+}
+
+/*
+ * Returns the CPU utilization % predicted for the next window from the
+ * prediction buckets of the tasks runnable on @cpu, and in @top_busy
+ * the utilization % of the biggest task seen in the last window.
+ * core_ctl samples this right after the window rollover, when the
+ * current window has barely started, so the previous window's top task
+ * is used like for the busy time. This is read without the rq lock and
+ * is only meant as a hint.
+ */
+unsigned int walt_get_cpu_pred_busy(int cpu, unsigned int *top_busy)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long capacity = capacity_orig_of(cpu);
+	u64 pred, top;
+
+	*top_busy = 0;
+	if (unlikely(walt_disabled || !sysctl_sched_use_walt_cpu_util))
+		return 0;
+
+	pred = READ_ONCE(rq->walt_stats.pred_demands_sum_scaled);
+	top = top_task_load(rq);
+	top = div64_u64(top, sched_ravg_window >> SCHED_CAPACITY_SHIFT);
+
+	*top_busy = walt_busy_pct(top, capacity);
+	return walt_busy_pct(pred, capacity);
+}
+
 u64 freq_policy_load(struct rq *rq)
 {
 	unsigned int reporting_policy = sysctl_sched_freq_reporting_policy;
@@ -1377,6 +1412,33 @@ static void rollover_cpu_window(struct rq *rq, bool full_window)
 	rq->grp_time.nt_curr_runnable_sum = 0;
 }
 
+static atomic_t nr_frame_groups;
+
+/*
+ * Account the busy time of a related thread group task to the frame in
+ * flight of its group, if any. Only the part of the busy period that
+ * follows the frame start is accounted.
+ */
+static inline void walt_frame_account(struct related_thread_group *grp,
+				      struct rq *rq, u64 mark_start,
+				      u64 wallclock)
+{
+	u64 frame_start;
+
+	if (likely(!atomic_read(&nr_frame_groups)))
+		return;
+
+	frame_start = READ_ONCE(grp->frame_start);
+	if (!frame_start || wallclock <= frame_start)
+		return;
+
+	mark_start = max(mark_start, frame_start);
+	atomic64_add(scale_exec_time(wallclock - mark_start, rq),
+		     &grp->frame_work);
+	if (!cpumask_test_cpu(cpu_of(rq), &grp->frame_cpus))
+		cpumask_set_cpu(cpu_of(rq), &grp->frame_cpus);
+}
+
 /*
  * Account cpu activity in its busy time counters (rq->curr/prev_runnable_sum)
  */
@@ -1428,6 +1490,8 @@ static void update_cpu_busy_time(struct task_struct *p, struct rq *rq,
 	if (grp) {
 		struct group_cpu_time *cpu_time = &rq->grp_time;
 
+		walt_frame_account(grp, rq, mark_start, wallclock);
+
 		curr_runnable_sum = &cpu_time->curr_runnable_sum;
 		prev_runnable_sum = &cpu_time->prev_runnable_sum;
 
@@ -2706,6 +2770,16 @@ int alloc_related_thread_groups(void)
 	return ret;
 }
 
+static void group_frame_end(struct related_thread_group *grp)
+{
+	if (!grp->frame_start)
+		return;
+
+	grp->frame_last_work = atomic64_read(&grp->frame_work);
+	WRITE_ONCE(grp->frame_start, 0);
+	atomic_dec(&nr_frame_groups);
+}
+
 static void remove_task_from_group(struct task_struct *p)
 {
 	struct related_thread_group *grp = p->grp;
@@ -2725,6 +2799,10 @@ static void remove_task_from_group(struct task_struct *p)
 	if (!list_empty(&grp->tasks)) {
 		empty_group = 0;
 		_set_preferred_cluster(grp);
+	} else {
+		/* Nobody is left to complete the frame in flight */
+		group_frame_end(grp);
+		grp->frame_last_work = 0;
 	}
 
 	raw_spin_unlock(&grp->lock);
@@ -2865,6 +2943,135 @@ unsigned int sched_get_group_id(struct task_struct *p)
 	return group_id;
 }
 
+/*
+ * sched_set_group_frame - report a frame of the related thread group of @p
+ *
+ * A non zero @deadline_us starts a frame which is due @deadline_us from
+ * now, completing the previous one if it is still in flight. A zero
+ * @deadline_us reports the completion of the frame in flight.
+ *
+ * The work of a frame is estimated as the larger of the work done during
+ * the previous frame and of the predicted demand of the group's tasks
+ * over the frame. schedutil uses it in frame deadline mode to pick the
+ * lowest frequency which completes the remaining work in time.
+ */
+int sched_set_group_frame(struct task_struct *p, unsigned int deadline_us)
+{
+	struct related_thread_group *grp;
+	struct task_struct *t;
+	unsigned long flags;
+	u64 now, duration, pred = 0;
+
+	rcu_read_lock();
+	grp = task_related_thread_group(p);
+	if (!grp) {
+		rcu_read_unlock();
+		return -EINVAL;
+	}
+
+	raw_spin_lock_irqsave(&grp->lock, flags);
+	group_frame_end(grp);
+
+	if (deadline_us) {
+		now = sched_ktime_clock();
+		duration = (u64)deadline_us * NSEC_PER_USEC;
+
+		/* Predictions are per window, scale them to the frame */
+		list_for_each_entry(t, &grp->tasks, grp_list)
+			pred += t->ravg.pred_demand;
+		pred = div64_u64(pred * min_t(u64, duration, sched_ravg_window),
+				 sched_ravg_window);
+
+		grp->frame_est = max(pred, grp->frame_last_work);
+		grp->frame_deadline = now + duration;
+		atomic64_set(&grp->frame_work, 0);
+		cpumask_clear(&grp->frame_cpus);
+		/* frame_start publishes the frame to the readers */
+		smp_store_release(&grp->frame_start, now);
+		atomic_inc(&nr_frame_groups);
+	}
+
+	trace_sched_group_frame(grp, deadline_us);
+	raw_spin_unlock_irqrestore(&grp->lock, flags);
+	rcu_read_unlock();
+
+	return 0;
+}
+
+/* Returns the time left until the deadline of the frame in flight, in us */
+unsigned int sched_get_group_frame(struct task_struct *p)
+{
+	struct related_thread_group *grp;
+	unsigned int left_us = 0;
+	u64 now;
+
+	rcu_read_lock();
+	grp = task_related_thread_group(p);
+	if (grp && READ_ONCE(grp->frame_start)) {
+		now = sched_ktime_clock();
+		if (grp->frame_deadline > now)
+			left_us = div64_u64(grp->frame_deadline - now,
+					    NSEC_PER_USEC);
+	}
+	rcu_read_unlock();
+
+	return left_us;
+}
+
+/*
+ * sched_frame_util - utilization needed by the frames in flight on @cpus
+ *
+ * Returns true when a frame of a related thread group which has run on
+ * @cpus is in flight and still within its estimate. @util is then set to
+ * the utilization, in capacity units of the biggest CPU at its max
+ * frequency, needed to complete the remaining work of those frames before
+ * their deadline, assuming it runs serially. A missed deadline asks for
+ * the full capacity for one more window. A frame whose completion is still
+ * not reported by then is stale and ignored.
+ */
+bool sched_frame_util(const struct cpumask *cpus, u64 now,
+		      unsigned long *util)
+{
+	struct related_thread_group *grp;
+	u64 start, work, sum = 0;
+	bool active = false;
+	int i;
+
+	if (likely(!atomic_read(&nr_frame_groups)))
+		return false;
+
+	for (i = 1; i < MAX_NUM_CGROUP_COLOC_ID; i++) {
+		grp = lookup_related_thread_group(i);
+		if (!grp)
+			continue;
+
+		start = smp_load_acquire(&grp->frame_start);
+		if (!start || !cpumask_intersects(&grp->frame_cpus, cpus))
+			continue;
+
+		if (now >= grp->frame_deadline + sched_ravg_window)
+			continue;
+
+		if (now >= grp->frame_deadline) {
+			sum = SCHED_CAPACITY_SCALE;
+			active = true;
+			break;
+		}
+
+		/* Over the estimate, leave it to the utilization */
+		work = atomic64_read(&grp->frame_work);
+		if (work >= grp->frame_est)
+			continue;
+
+		sum += div64_u64((grp->frame_est - work) << SCHED_CAPACITY_SHIFT,
+				 grp->frame_deadline - now);
+		active = true;
+	}
+
+	*util = min_t(u64, sum, SCHED_CAPACITY_SCALE);
+	return active;
+}
+
 #if defined(CONFIG_SCHED_TUNE)
 /*
  * We create a default colocation group at boot. There is no need to
@@ -304,6 +304,7 @@ extern void walt_rotate_work_init(void);
 extern void walt_rotation_checkpoint(int nr_big);
 extern unsigned int walt_rotation_enabled;
 extern unsigned int walt_get_default_coloc_group_load(void);
+extern unsigned int walt_get_cpu_pred_busy(int cpu, unsigned int *top_busy);
 
 extern __read_mostly bool sched_freq_aggr_en;
 static inline void walt_enable_frequency_aggregation(bool enable)
@@ -322,6 +323,12 @@ static inline unsigned int walt_get_default_coloc_group_load(void)
 {
 	return 0;
 }
+static inline unsigned int walt_get_cpu_pred_busy(int cpu,
+						 unsigned int *top_busy)
+{
+	*top_busy = 0;
+	return 0;
+}
 
 static inline void update_task_ravg(struct task_struct *p, struct rq *rq,
 				int event, u64 wallclock, u64 irqtime) { }
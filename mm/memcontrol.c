@@ -4010,6 +4010,47 @@ static ssize_t memcg_write_event_control(struct kernfs_open_file *of,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_MEMCG
+static u64 mem_cgroup_zram_usage_read(struct cgroup_subsys_state *css,
+				      struct cftype *cft)
+{
+	return atomic_long_read(&mem_cgroup_from_css(css)->zram_usage);
+}
+
+static u64 mem_cgroup_zram_failcnt_read(struct cgroup_subsys_state *css,
+					struct cftype *cft)
+{
+	return atomic_long_read(&mem_cgroup_from_css(css)->zram_failcnt);
+}
+
+static u64 mem_cgroup_zram_limit_read(struct cgroup_subsys_state *css,
+				      struct cftype *cft)
+{
+	return READ_ONCE(mem_cgroup_from_css(css)->zram_limit);
+}
+
+static ssize_t mem_cgroup_zram_limit_write(struct kernfs_open_file *of,
+					   char *buf, size_t nbytes,
+					   loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned long limit;
+	char *end;
+
+	buf = strstrip(buf);
+	if (!strcmp(buf, "-1")) {
+		limit = ULONG_MAX;
+	} else {
+		limit = memparse(buf, &end);
+		if (*end != '\0')
+			return -EINVAL;
+	}
+
+	WRITE_ONCE(memcg->zram_limit, limit);
+	return nbytes;
+}
+#endif
+
 static struct cftype mem_cgroup_legacy_files[] = {
 	{
 		.name = "usage_in_bytes",
@@ -4138,6 +4179,22 @@ static struct cftype mem_cgroup_legacy_files[] = {
 		.write = mem_cgroup_reset,
 		.read_u64 = mem_cgroup_read_u64,
 	},
+#ifdef CONFIG_ZRAM_MEMCG
+	{
+		.name = "zram.usage_in_bytes",
+		.read_u64 = mem_cgroup_zram_usage_read,
+	},
+	{
+		.name = "zram.limit_in_bytes",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.write = mem_cgroup_zram_limit_write,
+		.read_u64 = mem_cgroup_zram_limit_read,
+	},
+	{
+		.name = "zram.failcnt",
+		.read_u64 = mem_cgroup_zram_failcnt_read,
+	},
+#endif
 	{ },	/* terminate */
 };
 
@@ -4340,6 +4397,9 @@ mem_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 
 	memcg->high = PAGE_COUNTER_MAX;
 	memcg->soft_limit = PAGE_COUNTER_MAX;
+#ifdef CONFIG_ZRAM_MEMCG
+	memcg->zram_limit = ULONG_MAX;
+#endif
 	if (parent) {
 		memcg->swappiness = mem_cgroup_swappiness(parent);
 		memcg->oom_kill_disable = parent->oom_kill_disable;
@@ -4470,6 +4530,9 @@ static void mem_cgroup_css_reset(struct cgroup_subsys_state *css)
 	memcg->low = 0;
 	memcg->high = PAGE_COUNTER_MAX;
 	memcg->soft_limit = PAGE_COUNTER_MAX;
+#ifdef CONFIG_ZRAM_MEMCG
+	memcg->zram_limit = ULONG_MAX;
+#endif
 	memcg_wb_domain_size_changed(memcg);
 }
 
@@ -6231,6 +6294,105 @@ bool mem_cgroup_swap_full(struct page *page)
 	return false;
 }
 
+#ifdef CONFIG_ZRAM_MEMCG
+/* zram usage is hierarchical only where the memory counters are */
+static struct mem_cgroup *zram_parent(struct mem_cgroup *memcg)
+{
+	struct mem_cgroup *parent = parent_mem_cgroup(memcg);
+
+	if (parent && !parent->use_hierarchy)
+		return NULL;
+	return parent;
+}
+
+static void __mem_cgroup_zram_uncharge(struct mem_cgroup *memcg,
+				       struct mem_cgroup *last,
+				       unsigned long size)
+{
+	for (; memcg; memcg = zram_parent(memcg)) {
+		atomic_long_sub(size, &memcg->zram_usage);
+		if (memcg == last)
+			break;
+	}
+}
+
+/**
+ * mem_cgroup_zram_charge - charge compressed zram memory to a page's memcg
+ * @page: page being stored in zram
+ * @size: compressed size in bytes
+ * @id: memcg id the charge was recorded against, 0 if none
+ *
+ * Pins the memcg id until mem_cgroup_zram_uncharge(). Returns -ENOSPC
+ * if the zram limit of the memcg or one of its ancestors is exceeded.
+ */
+int mem_cgroup_zram_charge(struct page *page, unsigned long size,
+			   unsigned short *id)
+{
+	struct mem_cgroup *memcg, *iter;
+
+	*id = 0;
+	if (mem_cgroup_disabled())
+		return 0;
+
+	memcg = page->mem_cgroup;
+	if (!memcg)
+		return 0;
+
+	memcg = mem_cgroup_id_get_online(memcg);
+	for (iter = memcg; iter; iter = zram_parent(iter)) {
+		unsigned long usage;
+
+		usage = atomic_long_add_return(size, &iter->zram_usage);
+		if (usage > READ_ONCE(iter->zram_limit)) {
+			atomic_long_inc(&iter->zram_failcnt);
+			__mem_cgroup_zram_uncharge(memcg, iter, size);
+			mem_cgroup_id_put(memcg);
+			return -ENOSPC;
+		}
+	}
+
+	*id = mem_cgroup_id(memcg);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mem_cgroup_zram_charge);
+
+/**
+ * mem_cgroup_zram_shrink - reduce a zram charge without releasing it
+ * @id: memcg id returned by mem_cgroup_zram_charge()
+ * @size: number of bytes to give back
+ */
+void mem_cgroup_zram_shrink(unsigned short id, unsigned long size)
+{
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_id(id);
+	if (memcg)
+		__mem_cgroup_zram_uncharge(memcg, NULL, size);
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(mem_cgroup_zram_shrink);
+
+/**
+ * mem_cgroup_zram_uncharge - release a zram charge
+ * @id: memcg id returned by mem_cgroup_zram_charge()
+ * @size: compressed size in bytes that was charged
+ */
+void mem_cgroup_zram_uncharge(unsigned short id, unsigned long size)
+{
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_id(id);
+	if (memcg) {
+		__mem_cgroup_zram_uncharge(memcg, NULL, size);
+		mem_cgroup_id_put(memcg);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(mem_cgroup_zram_uncharge);
+#endif
+
 /* for remember boot option*/
 #ifdef CONFIG_MEMCG_SWAP_ENABLED
 static int really_do_swap_account __initdata = 1;